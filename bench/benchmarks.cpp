@@ -0,0 +1,664 @@
+#include <ibex/ibex.hpp>
+#include <ibex/compile.hpp>
+#include <ibex/batch.hpp>
+#include <ibex/parallel.hpp>
+#include <ibex/cache.hpp>
+#include <ibex/optimize.hpp>
+#include <ibex/autodiff.hpp>
+#include <ibex/static_expr.hpp>
+#include <ibex/archive.hpp>
+#include <ibex/symbols.hpp>
+#include <ibex/arrays.hpp>
+#include <ibex/memo.hpp>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
+#include <new>
+#include <variant>
+
+using namespace ibex;
+
+///==================
+/// Allocation Counting
+///==================
+
+// Every heap allocation of the process is counted, so a benchmark can report
+// how many allocations one iteration makes. All forms of new and delete are
+// replaced, so none of them reaches the default implementation.
+static std::atomic<size_t> allocations = 0;
+
+static void* allocate(size_t size, size_t alignment = 0)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size = size ? size : 1;
+    // aligned_alloc takes sizes that are a multiple of the alignment only
+    void* p = alignment ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                        : std::malloc(size);
+    if (!p) {throw std::bad_alloc();}
+    return p;
+}
+
+void* operator new(size_t size) {return allocate(size);}
+void* operator new[](size_t size) {return allocate(size);}
+void* operator new(size_t size, std::align_val_t alignment) {return allocate(size, static_cast<size_t>(alignment));}
+void* operator new[](size_t size, std::align_val_t alignment) {return allocate(size, static_cast<size_t>(alignment));}
+
+void operator delete(void* p) noexcept {std::free(p);}
+void operator delete[](void* p) noexcept {std::free(p);}
+void operator delete(void* p, size_t) noexcept {std::free(p);}
+void operator delete[](void* p, size_t) noexcept {std::free(p);}
+void operator delete(void* p, std::align_val_t) noexcept {std::free(p);}
+void operator delete[](void* p, std::align_val_t) noexcept {std::free(p);}
+void operator delete(void* p, size_t, std::align_val_t) noexcept {std::free(p);}
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {std::free(p);}
+
+///==================
+/// Corpus
+///==================
+
+struct Expression
+{
+    const char* category;
+    const char* text;
+};
+
+static const Expression EXPRESSIONS[] = {
+    {"short", "2+3*4"},
+    {"short", "3/(2*(10-4))"},
+    {"short", "(1 + 1/10000)^10000"},
+    {"short", "max(4,-7,2,4)"},
+    {"short", "5 <= 5 && 5 != 7"},
+    {"short", "a*x^2 + b*x + c"},
+    {"short", "sqrt(x*x + y*y) * exp(-t/tau)"},
+    {"long", "a*x^4 + b*x^3 + c*x^2 + a*x + b - (a + b + c)/3 + x*y*t - tau/2 + (x - y)*(x + y) - a*b*c + t*t/tau"},
+    {"long", "x > 0 && y > 0 || x < -1 && y < -1 || a == b || (c != 0 && t/tau >= 0.5) || !(x <= y)"},
+    {"nested", "((((((((((x + 1) * 2) - 3) / 4) + 5) * 6) - 7) / 8) + 9) * 10)"},
+    {"nested", "-(-(-(-(-(-(-(-(x + (y + (t + (tau + (a + (b + (c + 1)))))))))))))))"},
+    {"functions", "sin(x)*cos(y) + exp(-t/tau) + log(1 + abs(x)) + sqrt(x*x + y*y) + max(a, b, c) + min(x, y) + pow(x, 2)"},
+    {"functions", "sin(cos(tan(sin(cos(tan(x)))))) + log2(sqrt(exp(abs(y))))"},
+};
+
+static constexpr int CORPUS_SIZE = std::size(EXPRESSIONS);
+
+static Variables benchmark_variables()
+{
+    Variables vars = common_variables();
+    vars["a"] = 2; vars["b"] = 3; vars["c"] = 4;
+    vars["x"] = 0.5; vars["y"] = 1.5; vars["t"] = 2; vars["tau"] = 10;
+    return vars;
+}
+
+static const char* text(const benchmark::State& state) {return EXPRESSIONS[state.range(0)].text;}
+
+// Labels the run with its expression and adds the tokens per second and the
+// allocations per iteration since _allocations
+static void report(benchmark::State& state, size_t _allocations)
+{
+    const size_t allocated = allocations - _allocations;
+    const Expression& expression = EXPRESSIONS[state.range(0)];
+    state.SetLabel(std::string(expression.category) + ": " + expression.text);
+    state.counters["tokens/s"] = benchmark::Counter(state.iterations() * tokenize(expression.text).size(),
+                                                    benchmark::Counter::kIsRate);
+    state.counters["allocs"] = benchmark::Counter(allocated, benchmark::Counter::kAvgIterations);
+}
+
+///==================
+/// Reference Interpreter
+///==================
+
+// The interpreter eval_postfix started from, kept so BM_LegacyEvalPostfix shows
+// what the compiled paths are measured against. Operands are variants that
+// hold the name of a variable until it is read, every function call copies its
+// arguments and literals are parsed again on every evaluation.
+static double legacy_eval_postfix(const std::vector<Token>& _postfix, Variables& _vars, Functions& _funcs)
+{
+    constexpr double ERROR = std::numeric_limits<double>::quiet_NaN();
+    using Atom = std::variant<double,int,std::string>;
+    std::vector<Atom> stack;
+    auto atom_to_d = [&](const Atom& _atom) -> double {
+        if (const double* d = std::get_if<double>(&_atom)) {return *d;}
+        if (const int* i = std::get_if<int>(&_atom)) {return static_cast<double>(*i);}
+        auto it = _vars.find(std::get<std::string>(_atom));
+        return it != _vars.end() ? it->second : ERROR;
+    };
+
+    for (const Token& token : _postfix) {
+        switch (token.type) {
+        case Token::Type::INT: stack.push_back(std::stoi(token.lexeme)); break;
+        case Token::Type::FLOAT: stack.push_back(std::stod(token.lexeme)); break;
+
+        case Token::Type::IDENTIFIER: {
+            auto fit = _funcs.find(token.lexeme);
+            if (fit == _funcs.end()) {
+                stack.push_back(token.lexeme);
+                break;
+            }
+            std::vector<double> args;
+            for (uint64_t narg = 0; narg < token.metadata; ++narg) {
+                args.push_back(atom_to_d(stack.back()));
+                stack.pop_back();
+            }
+            std::reverse(args.begin(), args.end());
+            stack.push_back(fit->second(args));
+            break;
+        }
+
+        case Token::Type::PLUS:
+        case Token::Type::MINUS:
+        case Token::Type::TIMES:
+        case Token::Type::DIV:
+        case Token::Type::POW:
+        case Token::Type::EQ:
+        case Token::Type::NEQ:
+        case Token::Type::LESS:
+        case Token::Type::LEQ:
+        case Token::Type::GREATER:
+        case Token::Type::GEQ:
+        case Token::Type::LAND:
+        case Token::Type::LOR: {
+            if (stack.size() < 2) {return ERROR;}
+            double rhs = atom_to_d(stack.back()); stack.pop_back();
+            double lhs = atom_to_d(stack.back()); stack.pop_back();
+            double result = ERROR;
+            switch (token.type) {
+            case Token::Type::PLUS: result = lhs + rhs; break;
+            case Token::Type::MINUS: result = lhs - rhs; break;
+            case Token::Type::TIMES: result = lhs * rhs; break;
+            case Token::Type::DIV: result = lhs / rhs; break;
+            case Token::Type::POW: result = std::pow(lhs, rhs); break;
+            case Token::Type::EQ: result = lhs == rhs; break;
+            case Token::Type::NEQ: result = lhs != rhs; break;
+            case Token::Type::LESS: result = lhs < rhs; break;
+            case Token::Type::LEQ: result = lhs <= rhs; break;
+            case Token::Type::GREATER: result = lhs > rhs; break;
+            case Token::Type::GEQ: result = lhs >= rhs; break;
+            case Token::Type::LAND: result = (lhs != 0.0 && rhs != 0.0); break;
+            case Token::Type::LOR: result = (lhs != 0.0 || rhs != 0.0); break;
+            default: break;
+            }
+            stack.push_back(result);
+            break;
+        }
+
+        case Token::Type::UNARY_PLUS:
+        case Token::Type::UNARY_MINUS:
+        case Token::Type::NOT: {
+            if (stack.empty()) {return ERROR;}
+            double val = atom_to_d(stack.back()); stack.pop_back();
+            double result = token.type == Token::Type::UNARY_PLUS ? val : token.type == Token::Type::UNARY_MINUS ? -val : !val;
+            stack.push_back(result);
+            break;
+        }
+
+        case Token::Type::ASSIGN: {
+            double rhs = atom_to_d(stack.back()); stack.pop_back();
+            if (!std::holds_alternative<std::string>(stack.back())) {return ERROR;}
+            std::string lhs = std::get<std::string>(stack.back()); stack.pop_back();
+            _vars[lhs] = rhs;
+            stack.push_back(rhs);
+            break;
+        }
+
+        default:
+            return ERROR;
+        }
+    }
+
+    return stack.size() == 1 ? atom_to_d(stack.back()) : ERROR;
+}
+
+///==================
+/// Pipeline Stages
+///==================
+
+static void BM_Tokenize(benchmark::State& state)
+{
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(tokenize(text(state)));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_Tokenize)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_TokenizeView(benchmark::State& state)
+{
+    std::vector<TokenView> tokens;
+    size_t before = allocations;
+    for (auto _ : state) {
+        tokenize(text(state), tokens);
+        benchmark::DoNotOptimize(tokens.data());
+    }
+    report(state, before);
+}
+BENCHMARK(BM_TokenizeView)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_GeneratePostfix(benchmark::State& state)
+{
+    std::vector<Token> tokens = tokenize(text(state));
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(generate_postfix(tokens));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_GeneratePostfix)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_Compile(benchmark::State& state)
+{
+    Functions funcs = common_functions();
+    CompiledExpression expr;
+    size_t before = allocations;
+    for (auto _ : state) {
+        compile(text(state), funcs, expr);
+        benchmark::DoNotOptimize(expr.bytecode().code.data());
+    }
+    report(state, before);
+}
+BENCHMARK(BM_Compile)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_EvalPostfix(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    Functions funcs = common_functions();
+    std::vector<Token> postfix = generate_postfix(tokenize(text(state)));
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(eval_postfix(postfix, vars, funcs));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_EvalPostfix)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_LegacyEvalPostfix(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    Functions funcs = common_functions();
+    std::vector<Token> postfix = generate_postfix(tokenize(text(state)));
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(legacy_eval_postfix(postfix, vars, funcs));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_LegacyEvalPostfix)->DenseRange(0, CORPUS_SIZE - 1);
+
+// End to end from text to result
+static void BM_Eval(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    Functions funcs = common_functions();
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(eval(text(state), vars, funcs));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_Eval)->DenseRange(0, CORPUS_SIZE - 1);
+
+// Requests that each need the common environment with variables of their own,
+// by copying it or by a scope over the shared default scope
+static void BM_CopiedEnvironmentEval(benchmark::State& state)
+{
+    size_t before = allocations;
+    for (auto _ : state) {
+        Variables vars = benchmark_variables();
+        Functions funcs = common_functions();
+        benchmark::DoNotOptimize(eval(text(state), vars, funcs));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_CopiedEnvironmentEval)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_ScopeEval(benchmark::State& state)
+{
+    size_t before = allocations;
+    for (auto _ : state) {
+        Scope scope(&default_scope());
+        Variables& vars = scope.variables();
+        vars["a"] = 2; vars["b"] = 3; vars["c"] = 4;
+        vars["x"] = 0.5; vars["y"] = 1.5; vars["t"] = 2; vars["tau"] = 10;
+        benchmark::DoNotOptimize(eval(text(state), scope));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_ScopeEval)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_CachedEval(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    ExpressionCache cache;
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.eval(text(state), vars));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_CachedEval)->DenseRange(0, CORPUS_SIZE - 1);
+
+///==================
+/// Compiled Evaluation
+///==================
+
+static void BM_CompiledEvaluate(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    CompiledExpression expr = compile(text(state));
+    std::vector<double> values = expr.bind(vars);
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(expr.evaluate(values));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_CompiledEvaluate)->DenseRange(0, CORPUS_SIZE - 1);
+
+// Variables looked up by name in a map on every evaluation, compare with BM_BoundEvaluate
+static void BM_MapEvaluate(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    CompiledExpression expr = compile(text(state));
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(expr.evaluate(vars));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_MapEvaluate)->DenseRange(0, CORPUS_SIZE - 1);
+
+// Variables resolved to ids once and read from caller memory
+static void BM_BoundEvaluate(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    std::vector<double> memory;
+    memory.reserve(vars.size());
+    SymbolTable symbols;
+    for (const auto& [name, value] : vars) {symbols.bind(name, &memory.emplace_back(value));}
+    BoundExpression expr(compile(text(state)), symbols);
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(expr.evaluate());
+    }
+    report(state, before);
+}
+BENCHMARK(BM_BoundEvaluate)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_OptimizedEvaluate(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    Functions funcs = common_functions();
+    OptimizeStats stats;
+    std::vector<Token> postfix = optimize(generate_postfix(tokenize(text(state))), funcs, common_variables(), &stats);
+    CompiledExpression expr = compile(postfix, funcs);
+    std::vector<double> values = expr.bind(vars);
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(expr.evaluate(values));
+    }
+    report(state, before);
+    state.counters["removed"] = stats.removed();
+}
+BENCHMARK(BM_OptimizedEvaluate)->DenseRange(0, CORPUS_SIZE - 1);
+
+// A formula with parameters a, b, c, mode and phase, evaluated with all of them as
+// variables and specialized for their values, so only x is read
+static constexpr const char* PARAMETRIC = "a*x^2 + b*x + c + (mode > 1 ? sin(phase) : cos(phase)) * x";
+
+static void BM_ParametricEvaluate(benchmark::State& state)
+{
+    Variables vars = {{"a", 2}, {"b", -3}, {"c", 0.5}, {"mode", 2}, {"phase", 0.25}, {"x", 1}};
+    CompiledExpression expr = compile(PARAMETRIC);
+    std::vector<double> values = expr.bind(vars);
+    const int x = expr.slot("x");
+    for (auto _ : state) {
+        values[x] += 1e-9;
+        benchmark::DoNotOptimize(expr.evaluate(values));
+    }
+}
+BENCHMARK(BM_ParametricEvaluate);
+
+static void BM_SpecializedEvaluate(benchmark::State& state)
+{
+    Specializer spec(PARAMETRIC);
+    CompiledExpression expr = spec.specialize({{"a", 2}, {"b", -3}, {"c", 0.5}, {"mode", 2}, {"phase", 0.25}});
+    std::vector<double> values = {1};
+    for (auto _ : state) {
+        values[0] += 1e-9;
+        benchmark::DoNotOptimize(expr.evaluate(values));
+    }
+}
+BENCHMARK(BM_SpecializedEvaluate);
+
+// Cost of specializing again when the parameters change
+static void BM_Specialize(benchmark::State& state)
+{
+    Specializer spec(PARAMETRIC);
+    Variables params = {{"a", 2}, {"b", -3}, {"c", 0.5}, {"mode", 2}, {"phase", 0.25}};
+    CompiledExpression expr;
+    for (auto _ : state) {
+        params["phase"] += 1e-9;
+        spec.specialize(params, expr);
+        benchmark::DoNotOptimize(expr.bytecode().code.data());
+    }
+}
+BENCHMARK(BM_Specialize);
+
+// Expressions of the corpus parsed at compile time, compare with BM_CompiledEvaluate
+template<FixedString Text>
+static void BM_StaticExpression(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    std::vector<double> values = compile(Text.text).bind(vars);
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(values.data());
+        benchmark::DoNotOptimize(static_expr<Text>.evaluate(values));
+    }
+    state.SetLabel(Text.text);
+    state.counters["allocs"] = benchmark::Counter(allocations - before, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK_TEMPLATE(BM_StaticExpression, "a*x^2 + b*x + c");
+BENCHMARK_TEMPLATE(BM_StaticExpression, "sqrt(x*x + y*y) * exp(-t/tau)");
+BENCHMARK_TEMPLATE(BM_StaticExpression, "x > 0 && y > 0 || x < -1 && y < -1 || a == b || (c != 0 && t/tau >= 0.5) || !(x <= y)");
+
+// Value and full gradient in one forward and one reverse sweep
+static void BM_Gradient(benchmark::State& state)
+{
+    Variables vars = benchmark_variables();
+    CompiledExpression expr = compile(text(state));
+    std::vector<double> values = expr.bind(vars);
+    std::vector<double> partials(values.size());
+    size_t before = allocations;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(gradient(expr, values, partials));
+    }
+    report(state, before);
+}
+BENCHMARK(BM_Gradient)->DenseRange(0, CORPUS_SIZE - 1);
+
+///==================
+/// Batch Evaluation
+///==================
+
+static constexpr size_t BATCH_ROWS = 1 << 16;
+
+static void BM_RowByRow(benchmark::State& state)
+{
+    CompiledExpression expr = compile(text(state));
+    std::vector<std::vector<double>> columns(expr.slots().size(), std::vector<double>(BATCH_ROWS, 1.5));
+    std::vector<double> values(expr.slots().size());
+    std::vector<double> out(BATCH_ROWS);
+    for (auto _ : state) {
+        for (size_t row = 0; row < BATCH_ROWS; ++row) {
+            for (size_t i = 0; i < values.size(); ++i) {values[i] = columns[i][row];}
+            out[row] = expr.evaluate(values);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH_ROWS);
+    state.SetLabel(text(state));
+}
+BENCHMARK(BM_RowByRow)->DenseRange(0, CORPUS_SIZE - 1);
+
+static void BM_Batch(benchmark::State& state)
+{
+    CompiledExpression expr = compile(text(state));
+    std::vector<std::vector<double>> data(expr.slots().size(), std::vector<double>(BATCH_ROWS, 1.5));
+    std::vector<std::span<const double>> columns(data.begin(), data.end());
+    std::vector<double> out(BATCH_ROWS);
+    for (auto _ : state) {
+        evaluate_batch(expr, columns, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH_ROWS);
+    state.SetLabel(text(state));
+}
+BENCHMARK(BM_Batch)->DenseRange(0, CORPUS_SIZE - 1);
+
+// Same in single precision, with twice the rows per vector instruction and half the memory
+static void BM_BatchFloat(benchmark::State& state)
+{
+    BasicExpression<float> expr;
+    compile(text(state), common_functions<float>(), expr);
+    std::vector<std::vector<float>> data(expr.slots().size(), std::vector<float>(BATCH_ROWS, 1.5f));
+    std::vector<std::span<const float>> columns(data.begin(), data.end());
+    std::vector<float> out(BATCH_ROWS);
+    for (auto _ : state) {
+        evaluate_batch(expr, columns, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * BATCH_ROWS);
+    state.SetLabel(text(state));
+}
+BENCHMARK(BM_BatchFloat)->DenseRange(0, CORPUS_SIZE - 1);
+
+// Rows per second of the parallel evaluator for a growing number of threads
+static void BM_Parallel(benchmark::State& state)
+{
+    static constexpr size_t ROWS = 1 << 22;
+    const char* expression = "a*x^2 + b*x + c";
+    CompiledExpression expr = compile(expression);
+    std::vector<std::vector<double>> data(expr.slots().size(), std::vector<double>(ROWS, 1.5));
+    std::vector<std::span<const double>> columns(data.begin(), data.end());
+    std::vector<double> out(ROWS);
+    ParallelOptions options{.threads = static_cast<size_t>(state.range(0))};
+    for (auto _ : state) {
+        evaluate_parallel(expr, columns, out, options);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * ROWS);
+    state.SetLabel(expression);
+}
+BENCHMARK(BM_Parallel)->RangeMultiplier(2)->Range(1, 64)->UseRealTime();
+
+///==================
+/// Arrays
+///==================
+
+static constexpr size_t ARRAY_LENGTH = 1 << 20;
+
+// A weighted mean with the reductions fused into one pass over the arrays
+static void BM_ArrayReduction(benchmark::State& state)
+{
+    std::vector<double> w(ARRAY_LENGTH, 1.5), x(ARRAY_LENGTH, 0.5);
+    Arrays arrays = {{"w", w}, {"x", x}};
+    Variables vars;
+    ArrayExpression expr;
+    compile("sum(w*x)/sum(w)", {"w", "x"}, common_functions(), expr);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(expr.evaluate(arrays, vars));
+    }
+    state.SetItemsProcessed(state.iterations() * ARRAY_LENGTH);
+}
+BENCHMARK(BM_ArrayReduction);
+
+// Same by evaluating w*x into a temporary of the full length and summing it afterwards
+static void BM_MaterializedReduction(benchmark::State& state)
+{
+    std::vector<double> w(ARRAY_LENGTH, 1.5), x(ARRAY_LENGTH, 0.5), product(ARRAY_LENGTH);
+    CompiledExpression expr = compile("w*x");
+    for (auto _ : state) {
+        evaluate_batch(expr, Columns{{"w", w}, {"x", x}}, product);
+        double sw = 0, swx = 0;
+        for (size_t i = 0; i < ARRAY_LENGTH; ++i) {swx += product[i]; sw += w[i];}
+        benchmark::DoNotOptimize(swx / sw);
+    }
+    state.SetItemsProcessed(state.iterations() * ARRAY_LENGTH);
+}
+BENCHMARK(BM_MaterializedReduction);
+
+///==================
+/// Memoization
+///==================
+
+// An expensive function: the cube root by a fixed number of Newton steps
+static double cube_root(double a)
+{
+    double x = a > 1 ? a : 1;
+    for (int i = 0; i < 40; ++i) {x -= (x * x * x - a) / (3 * x * x);}
+    return x;
+}
+
+// The function called three times per evaluation with arguments that repeat across
+// evaluations: as an impure function, as a pure one whose calls the compiler shares
+// and memoized on top
+static void BM_RepeatedCall(benchmark::State& state)
+{
+    Functions funcs = common_functions();
+    if (state.range(0) == 0) {funcs["root"] = cube_root;}
+    if (state.range(0) == 1) {funcs["root"] = pure(cube_root);}
+    if (state.range(0) == 2) {funcs["root"] = memoized(cube_root, 64);}
+    CompiledExpression expr = compile("root(x)*y + root(x)/(1 + y) - root(x)^2", funcs);
+    std::vector<double> values = {0, 2};
+    size_t i = 0;
+    for (auto _ : state) {
+        values[0] = (i++ % 32) + 0.5;
+        benchmark::DoNotOptimize(expr.evaluate(values));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RepeatedCall)->DenseRange(0, 2);
+
+///==================
+/// Cold Start
+///==================
+
+static constexpr size_t STORED_FORMULAS = 50000;
+
+// Compiling every stored formula from text against opening an archive of them
+static void BM_CompileFormulas(benchmark::State& state)
+{
+    Functions funcs = common_functions();
+    std::vector<CompiledExpression> exprs(STORED_FORMULAS);
+    for (auto _ : state) {
+        for (size_t i = 0; i < STORED_FORMULAS; ++i) {compile(EXPRESSIONS[i % CORPUS_SIZE].text, funcs, exprs[i]);}
+        benchmark::DoNotOptimize(exprs.data());
+    }
+    state.SetItemsProcessed(state.iterations() * STORED_FORMULAS);
+}
+BENCHMARK(BM_CompileFormulas)->Unit(benchmark::kMillisecond);
+
+static void BM_OpenArchive(benchmark::State& state)
+{
+    Functions funcs = common_functions();
+    std::vector<CompiledExpression> exprs;
+    for (size_t i = 0; i < STORED_FORMULAS; ++i) {exprs.push_back(compile(EXPRESSIONS[i % CORPUS_SIZE].text, funcs));}
+    const std::string path = (std::filesystem::temp_directory_path() / "ibex_benchmark.bin").string();
+    save_archive(path.c_str(), exprs);
+
+    ExpressionArchive archive;
+    for (auto _ : state) {
+        archive.open(path.c_str(), funcs);
+        benchmark::DoNotOptimize(archive.size());
+    }
+    state.SetItemsProcessed(state.iterations() * STORED_FORMULAS);
+    state.counters["bytes"] = std::filesystem::file_size(path);
+    std::filesystem::remove(path);
+}
+BENCHMARK(BM_OpenArchive)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
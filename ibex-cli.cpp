@@ -1,14 +1,311 @@
 #include <iostream>
 #include <ibex/ibex.hpp>
+#include <ibex/compile.hpp>
+#include <ibex/table.hpp>
+#include <ibex/profile.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
 
-int main(int argc, char* argv[])
+///==================
+/// Output
+///==================
+
+// Collects the output in a large buffer, so millions of results cost a few write calls
+class Writer
+{
+public:
+    explicit Writer(FILE* _file, int _precision) : file_(_file), precision_(_precision) {}
+    ~Writer() {flush();}
+
+    /// Longest precision of the output, enough for every digit of any double
+    static constexpr int MAX_PRECISION = 767;
+
+    void write(double _value) {
+        // Digits plus sign, point, exponent and newline
+        reserve(precision_ + 32);
+        // Same format as std::ostream with the given precision
+        auto format = [&]() {
+            return std::to_chars(pos_, buffer_ + SIZE - 1, _value, std::chars_format::general, precision_);
+        };
+        std::to_chars_result result = format();
+        if (result.ec != std::errc()) {
+            flush();
+            result = format();
+            if (result.ec != std::errc()) {return;}
+        }
+        pos_ = result.ptr;
+        *pos_++ = '\n';
+    }
+
+    // Raw bytes, e.g. results as binary doubles
+    void write(const void* _data, size_t _bytes) {
+        const char* data = static_cast<const char*>(_data);
+        while (_bytes > 0) {
+            reserve(_bytes);
+            size_t n = std::min<size_t>(_bytes, buffer_ + SIZE - pos_);
+            std::memcpy(pos_, data, n);
+            pos_ += n;
+            data += n;
+            _bytes -= n;
+        }
+    }
+
+    void newline() {
+        reserve(1);
+        *pos_++ = '\n';
+    }
+
+    void flush() {
+        std::fwrite(buffer_, 1, pos_ - buffer_, file_);
+        std::fflush(file_);
+        pos_ = buffer_;
+    }
+
+private:
+    static constexpr size_t SIZE = 1 << 20;
+
+    void reserve(size_t _bytes) {
+        if (pos_ + _bytes > buffer_ + SIZE) {flush();}
+    }
+
+    FILE* file_;
+    int precision_;
+    char buffer_[SIZE];
+    char* pos_ = buffer_;
+};
+
+///==================
+/// Streaming
+///==================
+
+// Evaluates newline separated expressions in one environment, so assignments
+// are visible to the following lines. All buffers are reused between lines.
+class Stream
 {
-    if (argc != 2) {
-        std::cerr << "Usage: <Expression>" << std::endl;
+public:
+    explicit Stream(Writer& _writer) :
+        vars_(ibex::common_variables()), funcs_(ibex::common_functions()), writer_(_writer) {}
+
+    void line(std::string_view _line) {
+        if (!_line.empty() && _line.back() == '\r') {_line.remove_suffix(1);}
+        if (_line.find_first_not_of(" \t") == std::string_view::npos) {
+            writer_.newline();
+            return;
+        }
+        ibex::compile(_line, funcs_, expr_);
+        writer_.write(expr_.valid() ? expr_.evaluate(vars_) : std::numeric_limits<double>::quiet_NaN());
+    }
+
+    // Splits a buffer into lines and returns the length of the trailing incomplete line
+    size_t lines(std::string_view _text) {
+        size_t begin = 0;
+        for (size_t end; (end = _text.find('\n', begin)) != std::string_view::npos; begin = end + 1) {
+            line(_text.substr(begin, end - begin));
+        }
+        return _text.size() - begin;
+    }
+
+private:
+    ibex::Variables vars_;
+    ibex::Functions funcs_;
+    ibex::CompiledExpression expr_;
+    Writer& writer_;
+};
+
+static int stream_file(const char* _path, Stream& _stream)
+{
+    ibex::MappedFile file(_path);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open " << _path << std::endl;
         return 1;
     }
-    double res = ibex::eval(argv[1]);
-    if (std::isnan(res)) {return 1;}
-    std::cout << res << std::endl;
+
+    std::string_view text = file.text();
+    size_t rest = _stream.lines(text);
+    if (rest > 0) {_stream.line(text.substr(text.size() - rest));}
+    return 0;
+}
+
+static int stream_stdin(Stream& _stream)
+{
+    std::string buffer(1 << 20, '\0');
+    size_t filled = 0;
+    while (true)
+    {
+        if (filled == buffer.size()) {buffer.resize(2 * buffer.size());} // a line longer than the buffer
+        size_t n = std::fread(buffer.data() + filled, 1, buffer.size() - filled, stdin);
+        if (n == 0) {break;}
+        filled += n;
+
+        size_t rest = _stream.lines(std::string_view(buffer.data(), filled));
+        std::memmove(buffer.data(), buffer.data() + filled - rest, rest);
+        filled = rest;
+    }
+    if (filled > 0) {_stream.line(std::string_view(buffer.data(), filled));}
     return 0;
 }
+
+///==================
+/// Tables
+///==================
+
+struct TableArguments
+{
+    const char* expression = nullptr;
+    const char* input = nullptr;
+    const char* output = nullptr;
+    bool binaryOutput = false;
+    int precision = 6;
+    ibex::TableOptions options = {};
+};
+
+// Evaluates the expression for every row of the input table and writes one result
+// per line, or all results as little-endian doubles
+static int table(const TableArguments& _args)
+{
+    ibex::CompiledExpression expr = ibex::compile(_args.expression);
+    if (!expr.valid()) {return 1;}
+
+    FILE* file = _args.output ? std::fopen(_args.output, _args.binaryOutput ? "wb" : "w") : stdout;
+    if (!file) {
+        std::cerr << "Cannot open " << _args.output << std::endl;
+        return 1;
+    }
+
+    auto writer = std::make_unique<Writer>(file, _args.precision);
+    ibex::TableSink sink = [&](std::span<const double> _values) {
+        if (_args.binaryOutput) {
+            writer->write(_values.data(), _values.size_bytes());
+        } else {
+            for (double value : _values) {writer->write(value);}
+        }
+    };
+    int status = ibex::evaluate_table(expr, _args.input, sink, _args.options) ? 0 : 1;
+    writer.reset();
+    if (file != stdout) {std::fclose(file);}
+    return status;
+}
+
+// Parses the digits of --precision, clamped to what the output supports
+static bool parse_precision(const char* _text, int& _precision)
+{
+    long digits;
+    const char* end = _text + std::strlen(_text);
+    auto [ptr, ec] = std::from_chars(_text, end, digits);
+    if (ptr != end || (ec != std::errc() && ec != std::errc::result_out_of_range)) {return false;}
+    if (ec == std::errc::result_out_of_range) {digits = _text[0] == '-' ? 0 : Writer::MAX_PRECISION;}
+    _precision = static_cast<int>(std::clamp<long>(digits, 0, Writer::MAX_PRECISION));
+    return true;
+}
+
+static std::vector<std::string> split(std::string_view _text, char _delimiter)
+{
+    std::vector<std::string> parts;
+    for (size_t begin = 0, end; begin <= _text.size(); begin = end + 1) {
+        end = std::min(_text.find(_delimiter, begin), _text.size());
+        parts.emplace_back(_text.substr(begin, end - begin));
+    }
+    return parts;
+}
+
+///==================
+/// Main
+///==================
+
+static void usage()
+{
+    std::cerr << "Usage: ibex-cli <Expression>\n"
+              << "       ibex-cli --stream [--precision <digits>] [<file>]\n"
+              << "       ibex-cli --table <Expression> <file> [--columns <a,b,...>] [--delimiter <c>]\n"
+              << "                [--output <file>] [--binary-output] [--precision <digits>]\n"
+              << "Streaming evaluates one expression per line of <file> or stdin and prints one result per line.\n"
+              << "Tables evaluate the expression for every row of a CSV file with a header line, or of a binary\n"
+              << "file of little-endian doubles stored column after column with the names given by --columns.\n"
+              << "--profile prints the calls and times of every stage and function to stderr when done."
+              << std::endl;
+}
+
+static int run(int argc, char* argv[])
+{
+    if (argc >= 4 && std::strcmp(argv[1], "--table") == 0) {
+        TableArguments args{.expression = argv[2], .input = argv[3]};
+        for (int i = 4; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--columns") == 0 && i + 1 < argc) {
+                args.options.format = ibex::TableFormat::BINARY;
+                args.options.columns = split(argv[++i], ',');
+            } else if (std::strcmp(argv[i], "--delimiter") == 0 && i + 1 < argc) {
+                args.options.delimiter = argv[++i][0];
+            } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+                args.output = argv[++i];
+            } else if (std::strcmp(argv[i], "--binary-output") == 0) {
+                args.binaryOutput = true;
+            } else if (std::strcmp(argv[i], "--precision") == 0 && i + 1 < argc && parse_precision(argv[i + 1], args.precision)) {
+                ++i;
+            } else {
+                usage();
+                return 1;
+            }
+        }
+        return table(args);
+    }
+
+    if (argc == 2 && std::strcmp(argv[1], "--stream") != 0) {
+        double res = ibex::eval(argv[1]);
+        if (std::isnan(res)) {return 1;}
+        std::cout << res << std::endl;
+        return 0;
+    }
+
+    if (argc < 2 || std::strcmp(argv[1], "--stream") != 0) {
+        usage();
+        return 1;
+    }
+
+    int precision = 6;
+    const char* path = nullptr;
+    for (int i = 2; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--precision") == 0) {
+            if (i + 1 == argc || !parse_precision(argv[++i], precision)) {
+                usage();
+                return 1;
+            }
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    static Writer writer(stdout, precision);
+    Stream stream(writer);
+    int status = path ? stream_file(path, stream) : stream_stdin(stream);
+    writer.flush();
+    return status;
+}
+
+int main(int argc, char* argv[])
+{
+    // --profile may be given anywhere and applies to every mode
+    bool profile = false;
+    int n = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--profile") == 0) {profile = true;}
+        else {argv[n++] = argv[i];}
+    }
+
+    // The library only reports errors, printing them is up to the application
+    ibex::set_diagnostics_sink(ibex::print_error);
+    const int status = run(n, argv);
+    if (profile) {
+        if (ibex::PROFILING_ENABLED) {std::cerr << ibex::profile();}
+        else {std::cerr << "Profiling is disabled, configure with -DIBEX_ENABLE_PROFILING=ON" << std::endl;}
+    }
+    return status;
+}
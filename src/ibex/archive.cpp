@@ -0,0 +1,284 @@
+#include <ibex/archive.hpp>
+#include <ibex/profile.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+static size_t padded(size_t _bytes) {return (_bytes + 7) / 8 * 8;}
+
+// Byte offsets of the sections, which follow each other in the order of the header
+struct ArchiveLayout
+{
+    size_t expressions, functions, slots, constants, code, strings, end;
+
+    explicit ArchiveLayout(const ArchiveHeader& _header) {
+        expressions = padded(sizeof(ArchiveHeader));
+        functions = expressions + padded(size_t(_header.expressions) * sizeof(ArchiveExpression));
+        slots = functions + padded(size_t(_header.functions) * sizeof(ArchiveFunction));
+        constants = slots + padded(size_t(_header.slots) * sizeof(ArchiveSlot));
+        code = constants + padded(size_t(_header.constants) * sizeof(double));
+        strings = code + padded(size_t(_header.instructions) * sizeof(Instruction));
+        end = strings + padded(_header.string_bytes);
+    }
+};
+
+///==================
+/// Saving
+///==================
+
+bool save_archive(const char* _path, std::span<const CompiledExpression> _exprs, Error* _error)
+{
+    auto fail = [&](ErrorCode code, std::string_view token) {
+        const Error error = report(Error(code, token));
+        if (_error) {*_error = error;}
+        return false;
+    };
+
+    std::vector<ArchiveExpression> expressions;
+    std::vector<ArchiveFunction> functions;
+    std::vector<ArchiveSlot> slots;
+    std::vector<double> constants;
+    std::vector<Instruction> code;
+    std::string strings;
+
+    // Names are stored once, e.g. a variable that many expressions share
+    std::unordered_map<std::string, ArchiveString> stringIds;
+    std::unordered_map<std::string, uint16_t> functionIds;
+    auto intern = [&](const std::string& _name) {
+        auto [it, inserted] = stringIds.try_emplace(_name);
+        if (inserted) {
+            it->second = {static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(_name.size())};
+            strings += _name;
+        }
+        return it->second;
+    };
+
+    for (const CompiledExpression& expr : _exprs)
+    {
+        ArchiveExpression& record = expressions.emplace_back();
+        if (!expr.valid()) {continue;}
+        const Bytecode& bytecode = expr.bytecode();
+        record = {.code = static_cast<uint32_t>(code.size()), .code_size = static_cast<uint32_t>(bytecode.code.size()),
+                  .constants = static_cast<uint32_t>(constants.size()),
+                  .constant_count = static_cast<uint32_t>(bytecode.constants.size()),
+                  .slots = static_cast<uint32_t>(slots.size()), .slot_count = static_cast<uint32_t>(expr.slots().size()),
+                  .stack_size = static_cast<uint32_t>(bytecode.stack_size)};
+
+        for (Instruction ins : bytecode.code) {
+            if (ins.op == OpCode::CALL) {
+                const std::string& name = expr.function_names()[ins.arg];
+                auto [it, inserted] = functionIds.try_emplace(name, functions.size());
+                if (inserted) {
+                    if (functions.size() > std::numeric_limits<uint16_t>::max()) {
+                        return fail(ErrorCode::LIMIT_EXCEEDED, name);
+                    }
+                    functions.push_back({intern(name)});
+                }
+                ins.arg = it->second;
+            }
+            code.push_back(ins);
+        }
+        constants.insert(constants.end(), bytecode.constants.begin(), bytecode.constants.end());
+        for (size_t i = 0; i < expr.slots().size(); ++i) {
+            slots.push_back({.name = intern(expr.slots()[i]), .reads = expr.reads(i), .assigns = expr.assigns(i)});
+        }
+    }
+    if (strings.size() > std::numeric_limits<uint32_t>::max() || code.size() > std::numeric_limits<uint32_t>::max()) {
+        return fail(ErrorCode::LIMIT_EXCEEDED, _path);
+    }
+
+    ArchiveHeader header;
+    header.expressions = expressions.size();
+    header.functions = functions.size();
+    header.slots = slots.size();
+    header.constants = constants.size();
+    header.instructions = code.size();
+    header.string_bytes = strings.size();
+
+    std::ofstream file(_path, std::ios::binary);
+    auto write = [&](const void* _data, size_t _bytes) {
+        static constexpr char zeros[8] = {};
+        file.write(static_cast<const char*>(_data), _bytes);
+        file.write(zeros, padded(_bytes) - _bytes);
+    };
+    write(&header, sizeof(header));
+    write(expressions.data(), expressions.size() * sizeof(ArchiveExpression));
+    write(functions.data(), functions.size() * sizeof(ArchiveFunction));
+    write(slots.data(), slots.size() * sizeof(ArchiveSlot));
+    write(constants.data(), constants.size() * sizeof(double));
+    write(code.data(), code.size() * sizeof(Instruction));
+    write(strings.data(), strings.size());
+    file.close();
+    if (!file) {return fail(ErrorCode::IO, _path);}
+    return true;
+}
+
+///==================
+/// Loading
+///==================
+
+bool ExpressionArchive::open(const char* _path, const Functions& _funcs, Error* _error)
+{
+    *this = ExpressionArchive();
+    auto fail = [&](ErrorCode code, std::string_view token) {
+        const Error error = report(Error(code, token));
+        if (_error) {*_error = error;}
+        *this = ExpressionArchive();
+        return false;
+    };
+
+    MappedFile file(_path);
+    if (!file.is_open() || file.size() < sizeof(ArchiveHeader)) {return fail(ErrorCode::IO, _path);}
+    std::memcpy(&header_, file.data(), sizeof(ArchiveHeader));
+    const ArchiveHeader expected;
+    if (std::memcmp(header_.magic, expected.magic, sizeof(expected.magic)) != 0 ||
+        header_.version != expected.version || header_.byte_order != expected.byte_order) {
+        return fail(ErrorCode::IO, _path);
+    }
+    const ArchiveLayout layout(header_);
+    if (layout.end != file.size()) {return fail(ErrorCode::IO, _path);}
+
+    // Sections are 8 byte aligned in the file and the mapping is page aligned
+    const char* data = file.data();
+    expressions_ = reinterpret_cast<const ArchiveExpression*>(data + layout.expressions);
+    functionRecords_ = reinterpret_cast<const ArchiveFunction*>(data + layout.functions);
+    slots_ = reinterpret_cast<const ArchiveSlot*>(data + layout.slots);
+    constants_ = reinterpret_cast<const double*>(data + layout.constants);
+    code_ = reinterpret_cast<const Instruction*>(data + layout.code);
+    strings_ = data + layout.strings;
+
+    auto inside = [](uint64_t _begin, uint64_t _count, uint64_t _size) {return _begin + _count <= _size;};
+    auto valid = [&](ArchiveString _string) {return inside(_string.offset, _string.size, header_.string_bytes);};
+
+    // Resolve every function once, expressions share the results
+    std::vector<int> arities;
+    std::string name;
+    for (size_t i = 0; i < header_.functions; ++i) {
+        if (!valid(functionRecords_[i].name)) {return fail(ErrorCode::IO, _path);}
+        name.assign(string(functionRecords_[i].name));
+        auto it = _funcs.find(name);
+        if (it == _funcs.end()) {return fail(ErrorCode::UNKNOWN_FUNCTION, name);}
+        functions_.push_back(profiled(it->first, it->second.impl));
+        derivatives_.push_back(it->second.derivative);
+        arities.push_back(it->second.arity);
+    }
+    for (size_t i = 0; i < header_.slots; ++i) {
+        if (!valid(slots_[i].name)) {return fail(ErrorCode::IO, _path);}
+    }
+
+    for (size_t i = 0; i < header_.expressions; ++i) {
+        const ArchiveExpression& record = expressions_[i];
+        if (!inside(record.code, record.code_size, header_.instructions) ||
+            !inside(record.constants, record.constant_count, header_.constants) ||
+            !inside(record.slots, record.slot_count, header_.slots)) {
+            return fail(ErrorCode::IO, _path);
+        }
+        if (record.code_size == 0) {continue;}
+        const std::span<const Instruction> code(code_ + record.code, record.code_size);
+        size_t stackSize;
+        if (!verify(code, record.constant_count, record.slot_count, functions_.size(), stackSize) ||
+            stackSize != record.stack_size) {
+            return fail(ErrorCode::IO, _path);
+        }
+        for (const Instruction& ins : code) {
+            if (ins.op == OpCode::CALL && arities[ins.arg] >= 0 && ins.nargs != arities[ins.arg]) {
+                return fail(ErrorCode::WRONG_ARGUMENT_COUNT, string(functionRecords_[ins.arg].name));
+            }
+        }
+    }
+
+    file_ = std::move(file);
+    return true;
+}
+
+ArchivedExpression ExpressionArchive::operator[](size_t _index) const
+{
+    ArchivedExpression expr;
+    const ArchiveExpression& record = expressions_[_index];
+    expr.record_ = &record;
+    expr.code_ = code_ + record.code;
+    expr.constants_ = constants_ + record.constants;
+    expr.slots_ = slots_ + record.slots;
+    expr.strings_ = strings_;
+    expr.functions_ = functions_.data();
+    return expr;
+}
+
+bool ExpressionArchive::load(size_t _index, CompiledExpression& _expr) const
+{
+    _expr.clear();
+    const ArchivedExpression archived = (*this)[_index];
+    if (!archived.valid()) {
+        _expr.error_ = Error(ErrorCode::NOT_COMPILED);
+        return false;
+    }
+
+    // Calls get the indices of the functions of this expression only
+    Bytecode& bytecode = _expr.bytecode_;
+    std::vector<uint16_t> ids(functions_.size(), std::numeric_limits<uint16_t>::max());
+    for (Instruction ins : archived.code()) {
+        if (ins.op == OpCode::CALL) {
+            if (ids[ins.arg] == std::numeric_limits<uint16_t>::max()) {
+                ids[ins.arg] = _expr.functions_.size();
+                _expr.functions_.push_back(functions_[ins.arg]);
+                _expr.functionNames_.emplace_back(string(functionRecords_[ins.arg].name));
+                _expr.derivatives_.push_back(derivatives_[ins.arg]);
+            }
+            ins.arg = ids[ins.arg];
+        }
+        bytecode.code.push_back(ins);
+    }
+    const ArchiveExpression& record = *archived.record_;
+    bytecode.constants.assign(archived.constants_, archived.constants_ + record.constant_count);
+    bytecode.stack_size = record.stack_size;
+    for (size_t i = 0; i < record.slot_count; ++i) {
+        _expr.slots_.emplace_back(archived.slot_name(i));
+        _expr.reads_.push_back(archived.reads(i));
+        _expr.assigns_.push_back(archived.assigns(i));
+    }
+    return true;
+}
+
+///==================
+/// Archived Expressions
+///==================
+
+std::string_view ArchivedExpression::slot_name(size_t _slot) const
+{
+    const ArchiveString name = slots_[_slot].name;
+    return {strings_ + name.offset, name.size};
+}
+
+int ArchivedExpression::slot(std::string_view _name) const
+{
+    for (size_t i = 0; i < slot_count(); ++i) {
+        if (slot_name(i) == _name) {return static_cast<int>(i);}
+    }
+    return -1;
+}
+
+double ArchivedExpression::evaluate(std::span<double> _values) const
+{
+    ProfileScope profile(Stage::EVALUATE);
+    if (!valid()) {
+        profile.fail();
+        return ERRD;
+    }
+    if (_values.size() < slot_count()) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        profile.fail();
+        return ERRD;
+    }
+    const double result = execute(code_, constants_, functions_, _values.data(), record_->stack_size);
+    profile.result(result);
+    return result;
+}
+
+}
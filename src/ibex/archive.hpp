@@ -0,0 +1,158 @@
+#pragma once
+
+#include <ibex/compile.hpp>
+#include <ibex/table.hpp>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace ibex
+{
+
+///==================
+/// Archive Format
+///==================
+
+/// An archive is a header followed by the sections expressions, functions, slots,
+/// constants, code and strings, each as an array of the types below and padded to
+/// 8 bytes. Numbers are stored in the byte order of the machine that wrote the
+/// archive. ARCHIVE_VERSION changes with the format and with the bytecode.
+inline constexpr uint16_t ARCHIVE_VERSION = 2;
+
+struct ArchiveHeader
+{
+    char magic[4] = {'I', 'B', 'E', 'X'};
+    uint16_t version = ARCHIVE_VERSION;
+    uint16_t byte_order = 0x0102; // reads 0x0201 on a machine of the other byte order
+    uint32_t expressions = 0;
+    uint32_t functions = 0;
+    uint32_t slots = 0;
+    uint32_t constants = 0;
+    uint32_t instructions = 0;
+    uint32_t string_bytes = 0;
+};
+
+/// A string in the strings section
+struct ArchiveString
+{
+    uint32_t offset = 0;
+    uint32_t size = 0;
+};
+
+/// Ranges of the sections that belong to one expression. An invalid expression has no code.
+struct ArchiveExpression
+{
+    uint32_t code = 0;
+    uint32_t code_size = 0;
+    uint32_t constants = 0;
+    uint32_t constant_count = 0;
+    uint32_t slots = 0;
+    uint32_t slot_count = 0;
+    uint32_t stack_size = 0;
+    uint32_t reserved = 0;
+};
+
+struct ArchiveSlot
+{
+    ArchiveString name;
+    uint8_t reads = 0;
+    uint8_t assigns = 0;
+    uint16_t reserved = 0;
+};
+
+/// Functions are stored by name and shared by all expressions, CALL instructions
+/// refer to their index in the functions section.
+struct ArchiveFunction
+{
+    ArchiveString name;
+};
+
+/// Writes compiled expressions into one archive file. Invalid expressions are
+/// stored as invalid, so they keep their index. Returns false and sets _error if
+/// the file cannot be written.
+bool save_archive(const char* _path, std::span<const CompiledExpression> _exprs, Error* _error = nullptr);
+
+///==================
+/// Archives
+///==================
+
+/// An expression of an archive. It refers to the mapped file and the functions of
+/// the archive, so it is as cheap to copy as a few pointers, does not allocate and
+/// stays valid while the archive is open, even if the archive is moved.
+class ArchivedExpression
+{
+public:
+    ArchivedExpression() = default;
+
+    bool valid() const {return record_ && record_->code_size > 0;}
+
+    size_t slot_count() const {return record_ ? record_->slot_count : 0;}
+
+    std::string_view slot_name(size_t _slot) const;
+
+    /// Slot index of a variable or -1 if the expression does not reference it.
+    int slot(std::string_view _name) const;
+
+    bool reads(size_t _slot) const {return slots_[_slot].reads;}
+
+    bool assigns(size_t _slot) const {return slots_[_slot].assigns;}
+
+    /// Same as CompiledExpression::evaluate()
+    double evaluate(std::span<double> _values) const;
+
+    std::span<const Instruction> code() const {return {code_, record_ ? record_->code_size : 0};}
+
+private:
+    friend class ExpressionArchive;
+
+    const ArchiveExpression* record_ = nullptr;
+    const Instruction* code_ = nullptr;
+    const double* constants_ = nullptr;
+    const ArchiveSlot* slots_ = nullptr;
+    const char* strings_ = nullptr;
+    const NativeImpl* functions_ = nullptr;
+};
+
+/// Compiled expressions loaded from an archive. Opening maps the file and
+/// resolves the function names once each, expressions are used in place, so
+/// there is no parsing and no allocation per expression.
+class ExpressionArchive
+{
+public:
+    ExpressionArchive() = default;
+
+    /// Maps an archive and looks up its functions in _funcs. The bytecode of every
+    /// expression is verified, so a corrupt file cannot be evaluated out of bounds.
+    /// Returns false and sets _error if the file cannot be read, is no archive of
+    /// this version and byte order, or is corrupt (IO), or if a function is missing
+    /// from _funcs (UNKNOWN_FUNCTION) or now takes another number of arguments
+    /// (WRONG_ARGUMENT_COUNT).
+    bool open(const char* _path, const Functions& _funcs, Error* _error = nullptr);
+
+    bool is_open() const {return file_.is_open();}
+
+    /// Number of expressions
+    size_t size() const {return header_.expressions;}
+
+    ArchivedExpression operator[](size_t _index) const;
+
+    /// Copies an expression into a CompiledExpression, e.g. for evaluate_batch()
+    /// or gradient(). Returns false if the expression is invalid.
+    bool load(size_t _index, CompiledExpression& _expr) const;
+
+private:
+    std::string_view string(ArchiveString _string) const {return {strings_ + _string.offset, _string.size};}
+
+    MappedFile file_;
+    ArchiveHeader header_;
+    const ArchiveExpression* expressions_ = nullptr;
+    const ArchiveFunction* functionRecords_ = nullptr;
+    const ArchiveSlot* slots_ = nullptr;
+    const double* constants_ = nullptr;
+    const Instruction* code_ = nullptr;
+    const char* strings_ = nullptr;
+    std::vector<NativeImpl> functions_;
+    std::vector<DerivativeImpl> derivatives_;
+};
+
+}
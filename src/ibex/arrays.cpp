@@ -0,0 +1,348 @@
+#include <ibex/arrays.hpp>
+#include <ibex/scratch.hpp>
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+// Values of the variables and reductions during one evaluation
+struct ArrayExpression::Inputs
+{
+    std::vector<std::span<const double>> arrays;
+    std::vector<double> scalars;
+    std::vector<double> results;
+    size_t length = 0; // of every array
+};
+
+///==================
+/// Compilation
+///==================
+
+bool compile(std::string_view _text, const std::vector<std::string>& _arrays, const Functions& _funcs,
+             ArrayExpression& _expr)
+{
+    using Reduce = ArrayExpression::Reduce;
+    using Source = ArrayExpression::Source;
+
+    _expr = ArrayExpression();
+    auto fail = [&](const Error& error) {
+        _expr = ArrayExpression();
+        _expr.error_ = error;
+        return false;
+    };
+
+    Scratch<std::vector<TokenView>> tokens;
+    Scratch<std::vector<TokenView>> postfix;
+    Error error;
+    if (!tokenize(_text, *tokens, &error) || !generate_postfix(*tokens, *postfix, &error, _text)) {
+        return fail(error);
+    }
+    auto isArray = [&](std::string_view name) {return std::find(_arrays.begin(), _arrays.end(), name) != _arrays.end();};
+
+    // Every entry of the simulated stack knows where its tokens start in out, whether
+    // it is an array and the highest level of the reductions in it. A reduction of an
+    // array is cut out of out and replaced by a variable named #index for its result.
+    struct Entry {size_t start; bool array; size_t level;};
+    struct Pending {Reduce op; size_t level; std::vector<TokenView> postfix;};
+    std::vector<Entry> stack;
+    std::vector<TokenView> out;
+    std::vector<Pending> pending;
+    std::deque<std::string> names; // of the results, which tokens refer to
+
+    // Replaces the top _count entries by one for _token
+    auto merge = [&](size_t _count, const TokenView& _token) {
+        if (stack.size() < _count) {return false;}
+        Entry entry{_count > 0 ? stack[stack.size() - _count].start : out.size(), false, 0};
+        for (size_t i = stack.size() - _count; i < stack.size(); ++i) {
+            entry.array |= stack[i].array;
+            entry.level = std::max(entry.level, stack[i].level);
+        }
+        stack.resize(stack.size() - _count);
+        stack.push_back(entry);
+        out.push_back(_token);
+        return true;
+    };
+
+    for (const TokenView& token : *postfix)
+    {
+        switch (token.type)
+        {
+        case Token::Type::IDENTIFIER:
+        {
+            const size_t nargs = token.metadata;
+            const bool dot = token.lexeme == "dot";
+            Reduce op = Reduce::SUM;
+            if (token.lexeme == "mean") {op = Reduce::MEAN;}
+            else if (token.lexeme == "max") {op = Reduce::MAX;}
+            else if (token.lexeme == "min") {op = Reduce::MIN;}
+            const bool reduces = dot || op != Reduce::SUM || token.lexeme == "sum";
+            const bool arrayArgs = std::any_of(stack.end() - std::min(nargs, stack.size()), stack.end(),
+                                               [](const Entry& entry) {return entry.array;});
+
+            if (reduces && arrayArgs) {
+                if (nargs != (dot ? 2u : 1u) || stack.size() < nargs) {
+                    return fail(report(Error(ErrorCode::WRONG_ARGUMENT_COUNT, token.lexeme, _text)));
+                }
+                // dot(a, b) is the sum of a*b
+                const size_t start = stack[stack.size() - nargs].start;
+                Entry entry{start, false, 0};
+                for (size_t i = stack.size() - nargs; i < stack.size(); ++i) {
+                    entry.level = std::max(entry.level, stack[i].level + 1);
+                }
+                Pending& reduction = pending.emplace_back(op, entry.level, std::vector<TokenView>(out.begin() + start, out.end()));
+                if (dot) {reduction.postfix.push_back({.type = Token::Type::TIMES, .lexeme = "*"});}
+                names.push_back(std::string("#").append(std::to_string(pending.size() - 1)));
+                out.resize(start);
+                out.push_back({.type = Token::Type::IDENTIFIER, .lexeme = names.back()});
+                stack.resize(stack.size() - nargs);
+                stack.push_back(entry);
+            } else if (nargs > 0 || _funcs.contains(std::string(token.lexeme))) {
+                // Functions of arrays apply element-wise
+                if (!merge(nargs, token)) {
+                    return fail(report(Error(ErrorCode::WRONG_ARGUMENT_COUNT, token.lexeme, _text)));
+                }
+            } else {
+                merge(0, token);
+                stack.back().array = isArray(token.lexeme);
+            }
+            break;
+        }
+        case Token::Type::ASSIGN:
+            if (stack.size() >= 2 && (stack.back().array || stack[stack.size() - 2].array)) {
+                return fail(report(Error(ErrorCode::UNSUPPORTED, token.lexeme, _text)));
+            }
+            if (!merge(2, token)) {return fail(report(Error(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme, _text)));}
+            break;
+        case Token::Type::INT:
+        case Token::Type::FLOAT:
+            merge(0, token);
+            break;
+        default:
+        {
+            // The compiler checks the operators themselves
+            const size_t operands = token.type == Token::Type::QUESTION ? token.metadata : is_unary_operator(token.type) ? 1 : 2;
+            if (!merge(operands, token)) {
+                return fail(report(Error(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme, _text)));
+            }
+            break;
+        }
+        }
+    }
+    if (stack.size() != 1) {return fail(report(Error(ErrorCode::INVALID_EXPRESSION)));}
+    _expr.isArray_ = stack.back().array;
+
+    // Slots refer to arrays, scalars or the results of reductions
+    std::vector<bool> scalarReads;
+    auto resolve = [&](ArrayExpression::Kernel& kernel) {
+        const CompiledExpression& expr = kernel.expr;
+        for (size_t i = 0; i < expr.slots().size(); ++i) {
+            const std::string& slot = expr.slots()[i];
+            if (slot[0] == '#') {
+                kernel.sources.push_back({Source::Kind::RESULT, static_cast<uint32_t>(std::stoul(slot.substr(1)))});
+                continue;
+            }
+            const bool array = isArray(slot);
+            std::vector<std::string>& names = array ? _expr.arrays_ : _expr.scalars_;
+            const size_t index = std::find(names.begin(), names.end(), slot) - names.begin();
+            if (index == names.size()) {
+                names.push_back(slot);
+                if (!array) {scalarReads.push_back(false);}
+            }
+            if (!array && expr.reads(i)) {scalarReads[index] = true;}
+            kernel.sources.push_back({array ? Source::Kind::ARRAY : Source::Kind::SCALAR, static_cast<uint32_t>(index)});
+        }
+        const std::vector<Instruction>& code = expr.bytecode().code;
+        if (code.size() == 2 && code[0].op == OpCode::LOAD && kernel.sources[code[0].arg].kind == Source::Kind::ARRAY) {
+            kernel.array = static_cast<int>(kernel.sources[code[0].arg].index);
+        }
+    };
+
+    for (const Pending& reduction : pending) {
+        ArrayExpression::Reduction& compiled = _expr.reductions_.emplace_back();
+        compiled.op = reduction.op;
+        compiled.level = reduction.level;
+        if (!compile(reduction.postfix, _funcs, compiled.kernel.expr)) {return fail(compiled.kernel.expr.error());}
+        resolve(compiled.kernel);
+        _expr.levels_ = std::max(_expr.levels_, reduction.level);
+    }
+    if (!compile(out, _funcs, _expr.outer_.expr)) {return fail(_expr.outer_.expr.error());}
+    resolve(_expr.outer_);
+    _expr.scalarReads_ = std::move(scalarReads);
+    return true;
+}
+
+///==================
+/// Evaluation
+///==================
+
+// Four independent sums, so the additions do not wait for each other
+static double sum(std::span<const double> _values)
+{
+    double sums[4] = {};
+    size_t i = 0;
+    for (; i + 4 <= _values.size(); i += 4) {
+        sums[0] += _values[i];
+        sums[1] += _values[i + 1];
+        sums[2] += _values[i + 2];
+        sums[3] += _values[i + 3];
+    }
+    for (; i < _values.size(); ++i) {sums[0] += _values[i];}
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+}
+
+bool ArrayExpression::prepare(const Arrays& _arrays, const Variables& _vars, Inputs& _in) const
+{
+    _in.arrays.clear();
+    _in.scalars.clear();
+    _in.length = 0;
+    for (size_t i = 0; i < arrays_.size(); ++i) {
+        auto it = _arrays.find(arrays_[i]);
+        if (it == _arrays.end()) {
+            report(Error(ErrorCode::UNKNOWN_VARIABLE, arrays_[i]));
+            return false;
+        }
+        if (i > 0 && it->second.size() != _in.length) {
+            report(Error(ErrorCode::WRONG_VALUE_COUNT, arrays_[i]));
+            return false;
+        }
+        _in.length = it->second.size();
+        _in.arrays.push_back(it->second);
+    }
+    for (size_t i = 0; i < scalars_.size(); ++i) {
+        auto it = _vars.find(scalars_[i]);
+        if (it == _vars.end() && scalarReads_[i]) {report(Error(ErrorCode::UNKNOWN_VARIABLE, scalars_[i]));}
+        _in.scalars.push_back(it != _vars.end() ? it->second : ERRD);
+    }
+
+    // One pass per level, a level only depends on the results of lower ones
+    _in.results.assign(reductions_.size(), 0.0);
+    Scratch<std::vector<const Kernel*>> kernels;
+    Scratch<std::vector<size_t>> ids;
+    for (size_t level = 1; level <= levels_; ++level) {
+        kernels->clear();
+        ids->clear();
+        for (size_t i = 0; i < reductions_.size(); ++i) {
+            if (reductions_[i].level != level) {continue;}
+            kernels->push_back(&reductions_[i].kernel);
+            ids->push_back(i);
+            const Reduce op = reductions_[i].op;
+            _in.results[i] = op == Reduce::MAX ? -std::numeric_limits<double>::infinity() :
+                             op == Reduce::MIN ? std::numeric_limits<double>::infinity() : 0.0;
+        }
+        sweep(*kernels, _in, [&](size_t _kernel, size_t, std::span<const double> _values) {
+            const size_t id = (*ids)[_kernel];
+            double& result = _in.results[id];
+            switch (reductions_[id].op) {
+            case Reduce::SUM: case Reduce::MEAN: result += sum(_values); break;
+            case Reduce::MAX: for (double value : _values) {if (value > result) {result = value;}} break;
+            case Reduce::MIN: for (double value : _values) {if (value < result) {result = value;}} break;
+            }
+        });
+        for (size_t id : *ids) {
+            if (reductions_[id].op == Reduce::MEAN) {_in.results[id] /= _in.length;}
+        }
+    }
+    return true;
+}
+
+template<typename Consume>
+void ArrayExpression::sweep(std::span<const Kernel* const> _kernels, const Inputs& _in, Consume&& _consume) const
+{
+    // Scalars and results are broadcast into a column of one block each, filled once per pass
+    const size_t width = std::min(ARRAY_BLOCK_SIZE, _in.length);
+    Scratch<std::vector<double>> broadcast;
+    Scratch<std::vector<std::span<const double>>> columns;
+    Scratch<std::vector<double>> block;
+    broadcast->clear();
+    for (const Kernel* kernel : _kernels) {
+        for (const Source& source : kernel->sources) {
+            if (source.kind == Source::Kind::ARRAY) {continue;}
+            const double value = source.kind == Source::Kind::SCALAR ? _in.scalars[source.index] : _in.results[source.index];
+            broadcast->insert(broadcast->end(), width, value);
+        }
+    }
+    block->resize(width);
+
+    for (size_t begin = 0; begin < _in.length; begin += ARRAY_BLOCK_SIZE)
+    {
+        const size_t rows = std::min(ARRAY_BLOCK_SIZE, _in.length - begin);
+        const double* scalar = broadcast->data();
+        for (size_t k = 0; k < _kernels.size(); ++k) {
+            const Kernel& kernel = *_kernels[k];
+            if (kernel.array >= 0) {
+                _consume(k, begin, _in.arrays[kernel.array].subspan(begin, rows));
+                continue;
+            }
+            columns->clear();
+            for (const Source& source : kernel.sources) {
+                if (source.kind == Source::Kind::ARRAY) {
+                    columns->push_back(_in.arrays[source.index].subspan(begin, rows));
+                } else {
+                    columns->emplace_back(scalar, rows);
+                    scalar += width;
+                }
+            }
+            const std::span<double> values(block->data(), rows);
+            evaluate_batch(kernel.expr, *columns, values);
+            _consume(k, begin, std::span<const double>(values));
+        }
+    }
+}
+
+double ArrayExpression::scalar(const Inputs& _in, std::vector<double>& _values) const
+{
+    _values.clear();
+    for (const Source& source : outer_.sources) {
+        _values.push_back(source.kind == Source::Kind::SCALAR ? _in.scalars[source.index] : _in.results[source.index]);
+    }
+    return outer_.expr.evaluate(_values);
+}
+
+double ArrayExpression::evaluate(const Arrays& _arrays, Variables& _vars) const
+{
+    if (!valid()) {return ERRD;}
+    if (isArray_) {
+        report(Error(ErrorCode::UNSUPPORTED));
+        return ERRD;
+    }
+    Scratch<Inputs> in;
+    if (!prepare(_arrays, _vars, *in)) {return ERRD;}
+    Scratch<std::vector<double>> values;
+    const double result = scalar(*in, *values);
+    for (size_t i = 0; i < outer_.sources.size(); ++i) {
+        if (outer_.expr.assigns(i) && outer_.sources[i].kind == Source::Kind::SCALAR) {
+            _vars[outer_.expr.slots()[i]] = (*values)[i];
+        }
+    }
+    return result;
+}
+
+bool ArrayExpression::evaluate(const Arrays& _arrays, const Variables& _vars, std::span<double> _out) const
+{
+    Scratch<Inputs> in;
+    if (!valid() || !prepare(_arrays, _vars, *in)) {
+        std::fill(_out.begin(), _out.end(), ERRD);
+        return false;
+    }
+    if (!isArray_) {
+        Scratch<std::vector<double>> values;
+        std::fill(_out.begin(), _out.end(), scalar(*in, *values));
+        return true;
+    }
+    if (_out.size() != in->length) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        std::fill(_out.begin(), _out.end(), ERRD);
+        return false;
+    }
+    const Kernel* outer = &outer_;
+    sweep(std::span(&outer, 1), *in, [&](size_t, size_t _begin, std::span<const double> _values) {
+        std::copy(_values.begin(), _values.end(), _out.begin() + _begin);
+    });
+    return true;
+}
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <ibex/batch.hpp>
+#include <ibex/compile.hpp>
+#include <span>
+
+namespace ibex
+{
+
+///==================
+/// Arrays
+///==================
+
+/// Array variables by name, views of memory of the caller
+using Arrays = Columns;
+
+/// Elements per block of a pass over the arrays
+static constexpr size_t ARRAY_BLOCK_SIZE = 8 * BATCH_CHUNK_SIZE;
+
+/// An expression over array and scalar variables. Operators and functions apply
+/// element-wise to arrays and broadcast scalars, so x*w + 1 is an array. The
+/// reductions sum(a), mean(a), max(a), min(a) and dot(a, b) of array arguments
+/// are scalars, e.g. sum(w*x)/sum(w). Arrays must all have the same length.
+///
+/// Reductions at the same nesting depth are fused: one pass over the arrays
+/// evaluates their arguments block by block with the batch kernels and
+/// accumulates every reduction, so no temporary is larger than a block. A
+/// reduction over a plain array reads it in place. sum(x - mean(x)) takes two
+/// passes, one per depth, and an array result one more.
+class ArrayExpression
+{
+public:
+    ArrayExpression() = default;
+
+    bool valid() const {return outer_.expr.valid();}
+
+    const Error& error() const {return error_;}
+
+    /// True if the result is an array, false if it is a scalar
+    bool is_array() const {return isArray_;}
+
+    /// Number of passes over the arrays per evaluation
+    size_t passes() const {return levels_ + isArray_;}
+
+    /// Names of the array and scalar variables the expression reads
+    const std::vector<std::string>& arrays() const {return arrays_;}
+    const std::vector<std::string>& scalars() const {return scalars_;}
+
+    /// Evaluates a scalar result and writes assignments to scalars back into _vars.
+    /// Reports and returns NaN if an array is missing, the lengths differ or the result is an array.
+    double evaluate(const Arrays& _arrays, Variables& _vars) const;
+
+    /// Evaluates an array result into _out, which must have the length of the arrays.
+    /// A scalar result fills _out. Assignments are local to an element like in batches.
+    bool evaluate(const Arrays& _arrays, const Variables& _vars, std::span<double> _out) const;
+
+private:
+    friend bool compile(std::string_view _text, const std::vector<std::string>& _arrays, const Functions& _funcs,
+                        ArrayExpression& _expr);
+
+    enum class Reduce : unsigned char {SUM, MEAN, MAX, MIN};
+
+    // Where the value of a slot comes from
+    struct Source
+    {
+        enum class Kind : unsigned char {ARRAY, SCALAR, RESULT} kind;
+        uint32_t index; // into arrays_, scalars_ or reductions_
+    };
+
+    struct Kernel
+    {
+        CompiledExpression expr;
+        std::vector<Source> sources; // by slot
+        int array = -1; // the array if the kernel only loads it
+    };
+
+    struct Reduction
+    {
+        Reduce op;
+        size_t level; // 1 + the highest level of the reductions in its argument
+        Kernel kernel; // the argument, element-wise
+    };
+
+    struct Inputs;
+
+    // Resolves the variables and computes the reductions
+    bool prepare(const Arrays& _arrays, const Variables& _vars, Inputs& _in) const;
+
+    // Runs kernels over the arrays block by block, _consume(kernel, begin, values) gets their values
+    template<typename Consume>
+    void sweep(std::span<const Kernel* const> _kernels, const Inputs& _in, Consume&& _consume) const;
+
+    // Evaluates a scalar result, _values receives the slots of outer_
+    double scalar(const Inputs& _in, std::vector<double>& _values) const;
+
+    Kernel outer_; // the expression with reductions replaced by their results
+    std::vector<Reduction> reductions_;
+    std::vector<std::string> arrays_;
+    std::vector<std::string> scalars_;
+    std::vector<bool> scalarReads_; // scalars that are read before they are assigned
+    size_t levels_ = 0;
+    bool isArray_ = false;
+    Error error_;
+};
+
+/// Compiles text in which the variables named in _arrays are arrays. Returns
+/// false if compilation failed, the reason is then in _expr.error(). Arrays
+/// cannot be assigned and reductions take one array argument, dot() two.
+bool compile(std::string_view _text, const std::vector<std::string>& _arrays, const Functions& _funcs,
+             ArrayExpression& _expr);
+
+}
@@ -0,0 +1,401 @@
+#include <ibex/autodiff.hpp>
+#include <ibex/scratch.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+///==================
+/// Derivative Rules
+///==================
+
+// Value of an operator and its partial derivatives with respect to the operands
+struct Local
+{
+    double value;
+    double da;
+    double db = 0.0;
+};
+
+// The operator applied by a fused instruction
+static OpCode base(OpCode op)
+{
+    switch (op) {
+    case OpCode::ADD_C: case OpCode::ADD_L: return OpCode::ADD;
+    case OpCode::SUB_C: case OpCode::SUB_L: return OpCode::SUB;
+    case OpCode::MUL_C: case OpCode::MUL_L: return OpCode::MUL;
+    case OpCode::DIV_C: case OpCode::DIV_L: return OpCode::DIV;
+    default: return op;
+    }
+}
+
+static Local binary(OpCode op, double a, double b)
+{
+    switch (op) {
+    case OpCode::ADD: return {a + b, 1.0, 1.0};
+    case OpCode::SUB: return {a - b, 1.0, -1.0};
+    case OpCode::MUL: return {a * b, b, a};
+    case OpCode::DIV: return {a / b, 1.0 / b, -a / (b * b)};
+    case OpCode::POW: {
+        const double value = std::pow(a, b);
+        return {value, (b == 0.0) ? 0.0 : b * std::pow(a, b - 1.0), (a > 0.0) ? value * std::log(a) : 0.0};
+    }
+    case OpCode::EQ: return {static_cast<double>(a == b), 0.0};
+    case OpCode::NEQ: return {static_cast<double>(a != b), 0.0};
+    case OpCode::LESS: return {static_cast<double>(a < b), 0.0};
+    case OpCode::LEQ: return {static_cast<double>(a <= b), 0.0};
+    case OpCode::GREATER: return {static_cast<double>(a > b), 0.0};
+    case OpCode::GEQ: return {static_cast<double>(a >= b), 0.0};
+    case OpCode::LAND: return {static_cast<double>(a != 0.0 && b != 0.0), 0.0};
+    case OpCode::LOR: return {static_cast<double>(a != 0.0 || b != 0.0), 0.0};
+    default: return {ERRD, ERRD, ERRD};
+    }
+}
+
+static Local unary(OpCode op, double a)
+{
+    switch (op) {
+    case OpCode::NEG: return {-a, -1.0};
+    case OpCode::NOT: return {static_cast<double>(!a), 0.0};
+    case OpCode::SQR: return {a * a, 2.0 * a};
+    default: return {ERRD, ERRD};
+    }
+}
+
+// Partial derivatives of a call, by central differences if the function has none registered
+static void call_partials(const NativeImpl& f, const DerivativeImpl& d, FunctionArgsView args, std::span<double> partials)
+{
+    if (d) {
+        d(args, partials);
+        return;
+    }
+    Scratch<std::vector<double>> shifted;
+    shifted->assign(args.begin(), args.end());
+    for (size_t i = 0; i < args.size(); ++i) {
+        const double h = std::cbrt(std::numeric_limits<double>::epsilon()) * std::max(1.0, std::abs(args[i]));
+        (*shifted)[i] = args[i] + h;
+        const double up = f(*shifted);
+        (*shifted)[i] = args[i] - h;
+        const double down = f(*shifted);
+        (*shifted)[i] = args[i];
+        partials[i] = (up - down) / (2.0 * h);
+    }
+}
+
+///==================
+/// Reverse Mode
+///==================
+
+// Every value computed in the forward sweep is a node that records the partial
+// derivatives with respect to the nodes it was computed from
+struct Tape
+{
+    struct Edge
+    {
+        uint32_t node;
+        double partial;
+    };
+
+    std::vector<double> values; // of every node, the first ones are the slots
+    std::vector<uint32_t> ends; // one past the last edge of every node
+    std::vector<Edge> edges;
+    std::vector<double> adjoints;
+    std::vector<uint32_t> stack; // nodes
+    std::vector<uint32_t> slots; // current node of every slot
+    std::vector<double> args;
+    std::vector<double> partials;
+
+    void clear() {
+        values.clear();
+        ends.clear();
+        edges.clear();
+        stack.clear();
+        slots.clear();
+    }
+
+    // Edges are added before the node they belong to
+    void edge(uint32_t _node, double _partial) {
+        if (_partial != 0.0) {edges.push_back({_node, _partial});}
+    }
+
+    uint32_t add(double _value) {
+        values.push_back(_value);
+        ends.push_back(edges.size());
+        return values.size() - 1;
+    }
+};
+
+double gradient(const CompiledExpression& _expr, std::span<double> _values, std::span<double> _gradient)
+{
+    if (!_expr.valid()) {
+        std::fill(_gradient.begin(), _gradient.end(), ERRD);
+        return ERRD;
+    }
+    if (_values.size() < _expr.slots().size() || _gradient.size() < _expr.slots().size()) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        std::fill(_gradient.begin(), _gradient.end(), ERRD);
+        return ERRD;
+    }
+
+    Scratch<Tape> scratch;
+    Tape& tape = *scratch;
+    tape.clear();
+    const Bytecode& bytecode = _expr.bytecode();
+    const size_t nslots = _expr.slots().size();
+    for (size_t i = 0; i < nslots; ++i) {tape.slots.push_back(tape.add(_values[i]));}
+
+    std::vector<uint32_t>& stack = tape.stack;
+    for (const Instruction* ip = bytecode.code.data(); ip->op != OpCode::RET; ++ip)
+    {
+        const Instruction& ins = *ip;
+        switch (ins.op)
+        {
+        case OpCode::CONST:
+            stack.push_back(tape.add(bytecode.constants[ins.arg]));
+            break;
+        case OpCode::LOAD:
+            stack.push_back(tape.slots[ins.arg]);
+            break;
+        case OpCode::STORE:
+            tape.slots[ins.arg] = stack.back();
+            _values[ins.arg] = tape.values[stack.back()];
+            break;
+        case OpCode::CALL: {
+            const size_t first = stack.size() - ins.nargs;
+            tape.args.resize(ins.nargs);
+            tape.partials.resize(ins.nargs);
+            for (size_t k = 0; k < ins.nargs; ++k) {tape.args[k] = tape.values[stack[first + k]];}
+            const double value = _expr.functions()[ins.arg](tape.args);
+            call_partials(_expr.functions()[ins.arg], _expr.derivatives()[ins.arg], tape.args, tape.partials);
+            for (size_t k = 0; k < ins.nargs; ++k) {tape.edge(stack[first + k], tape.partials[k]);}
+            stack.resize(first);
+            stack.push_back(tape.add(value));
+            break;
+        }
+        case OpCode::JUMP:
+            ip = bytecode.code.data() + ins.arg - 1;
+            break;
+        case OpCode::JUMP_IF_NOT: {
+            const double condition = tape.values[stack.back()];
+            stack.pop_back();
+            if (condition == 0.0) {ip = bytecode.code.data() + ins.arg - 1;}
+            break;
+        }
+        case OpCode::AND_JUMP:
+        case OpCode::OR_JUMP: {
+            // The left operand decides the result, a constant
+            const bool decided = (tape.values[stack.back()] != 0.0) == (ins.op == OpCode::OR_JUMP);
+            stack.pop_back();
+            if (decided) {
+                stack.push_back(tape.add(ins.op == OpCode::OR_JUMP));
+                ip = bytecode.code.data() + ins.arg - 1;
+            }
+            break;
+        }
+        case OpCode::BOOL:
+            stack.back() = tape.add(tape.values[stack.back()] != 0.0);
+            break;
+        case OpCode::PICK:
+            stack.push_back(stack[ins.arg]);
+            break;
+        case OpCode::NEG:
+        case OpCode::NOT:
+        case OpCode::SQR: {
+            Local local = unary(ins.op, tape.values[stack.back()]);
+            tape.edge(stack.back(), local.da);
+            stack.back() = tape.add(local.value);
+            break;
+        }
+        case OpCode::ADD_C:
+        case OpCode::SUB_C:
+        case OpCode::MUL_C:
+        case OpCode::DIV_C: {
+            Local local = binary(base(ins.op), tape.values[stack.back()], bytecode.constants[ins.arg]);
+            tape.edge(stack.back(), local.da);
+            stack.back() = tape.add(local.value);
+            break;
+        }
+        case OpCode::ADD_L:
+        case OpCode::SUB_L:
+        case OpCode::MUL_L:
+        case OpCode::DIV_L: {
+            const uint32_t b = tape.slots[ins.arg];
+            Local local = binary(base(ins.op), tape.values[stack.back()], tape.values[b]);
+            tape.edge(stack.back(), local.da);
+            tape.edge(b, local.db);
+            stack.back() = tape.add(local.value);
+            break;
+        }
+        default: {
+            const uint32_t b = stack.back();
+            stack.pop_back();
+            Local local = binary(ins.op, tape.values[stack.back()], tape.values[b]);
+            tape.edge(stack.back(), local.da);
+            tape.edge(b, local.db);
+            stack.back() = tape.add(local.value);
+            break;
+        }
+        }
+    }
+
+    // Propagate the derivative of the result back to the slots
+    const uint32_t result = stack.back();
+    tape.adjoints.assign(tape.values.size(), 0.0);
+    tape.adjoints[result] = 1.0;
+    for (size_t n = tape.values.size() - 1; n >= nslots && n > 0; --n) {
+        const double adjoint = tape.adjoints[n];
+        if (adjoint == 0.0) {continue;}
+        for (uint32_t e = tape.ends[n - 1]; e < tape.ends[n]; ++e) {
+            tape.adjoints[tape.edges[e].node] += adjoint * tape.edges[e].partial;
+        }
+    }
+    std::copy_n(tape.adjoints.begin(), nslots, _gradient.begin());
+    return tape.values[result];
+}
+
+double gradient(const CompiledExpression& _expr, Variables& _vars, Variables& _gradient)
+{
+    std::vector<double> values = _expr.bind(_vars);
+    std::vector<double> partials(values.size());
+    const double result = gradient(_expr, values, partials);
+    _expr.unbind(values, _vars);
+    for (size_t i = 0; i < partials.size(); ++i) {
+        if (_expr.reads(i)) {_gradient[_expr.slots()[i]] = partials[i];}
+    }
+    return result;
+}
+
+///==================
+/// Forward Mode
+///==================
+
+struct DualStack
+{
+    std::vector<Dual> stack;
+    std::vector<Dual> slots;
+    std::vector<double> args;
+    std::vector<double> partials;
+};
+
+// partial * derivative, where a zero derivative stays zero even for infinite partials
+static double chain(double partial, double derivative)
+{
+    return derivative == 0.0 ? 0.0 : partial * derivative;
+}
+
+Dual derivative(const CompiledExpression& _expr, std::span<double> _values, std::span<const double> _direction)
+{
+    if (!_expr.valid()) {return {ERRD, ERRD};}
+    const size_t nslots = _expr.slots().size();
+    if (_values.size() < nslots || _direction.size() < nslots) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        return {ERRD, ERRD};
+    }
+
+    Scratch<DualStack> scratch;
+    std::vector<Dual>& stack = scratch->stack;
+    std::vector<Dual>& slots = scratch->slots;
+    stack.clear();
+    slots.resize(nslots);
+    for (size_t i = 0; i < nslots; ++i) {slots[i] = {_values[i], _direction[i]};}
+
+    const Bytecode& bytecode = _expr.bytecode();
+    for (const Instruction* ip = bytecode.code.data(); ip->op != OpCode::RET; ++ip)
+    {
+        const Instruction& ins = *ip;
+        switch (ins.op)
+        {
+        case OpCode::CONST:
+            stack.push_back({bytecode.constants[ins.arg], 0.0});
+            break;
+        case OpCode::LOAD:
+            stack.push_back(slots[ins.arg]);
+            break;
+        case OpCode::STORE:
+            slots[ins.arg] = stack.back();
+            _values[ins.arg] = stack.back().value;
+            break;
+        case OpCode::CALL: {
+            std::vector<double>& args = scratch->args;
+            const Dual* first = stack.data() + stack.size() - ins.nargs;
+            args.resize(ins.nargs);
+            bool constant = true;
+            for (size_t k = 0; k < ins.nargs; ++k) {
+                args[k] = first[k].value;
+                constant = constant && first[k].derivative == 0.0;
+            }
+            Dual result{_expr.functions()[ins.arg](args), 0.0};
+            if (!constant) {
+                scratch->partials.resize(ins.nargs);
+                call_partials(_expr.functions()[ins.arg], _expr.derivatives()[ins.arg], args, scratch->partials);
+                for (size_t k = 0; k < ins.nargs; ++k) {
+                    result.derivative += chain(scratch->partials[k], first[k].derivative);
+                }
+            }
+            stack.resize(stack.size() - ins.nargs);
+            stack.push_back(result);
+            break;
+        }
+        case OpCode::JUMP:
+            ip = bytecode.code.data() + ins.arg - 1;
+            break;
+        case OpCode::JUMP_IF_NOT: {
+            const double condition = stack.back().value;
+            stack.pop_back();
+            if (condition == 0.0) {ip = bytecode.code.data() + ins.arg - 1;}
+            break;
+        }
+        case OpCode::AND_JUMP:
+        case OpCode::OR_JUMP: {
+            const bool decided = (stack.back().value != 0.0) == (ins.op == OpCode::OR_JUMP);
+            stack.pop_back();
+            if (decided) {
+                stack.push_back({static_cast<double>(ins.op == OpCode::OR_JUMP), 0.0});
+                ip = bytecode.code.data() + ins.arg - 1;
+            }
+            break;
+        }
+        case OpCode::BOOL:
+            stack.back() = {static_cast<double>(stack.back().value != 0.0), 0.0};
+            break;
+        case OpCode::PICK:
+            stack.push_back(stack[ins.arg]);
+            break;
+        case OpCode::NEG:
+        case OpCode::NOT:
+        case OpCode::SQR: {
+            Local local = unary(ins.op, stack.back().value);
+            stack.back() = {local.value, chain(local.da, stack.back().derivative)};
+            break;
+        }
+        case OpCode::ADD_C:
+        case OpCode::SUB_C:
+        case OpCode::MUL_C:
+        case OpCode::DIV_C: {
+            Local local = binary(base(ins.op), stack.back().value, bytecode.constants[ins.arg]);
+            stack.back() = {local.value, chain(local.da, stack.back().derivative)};
+            break;
+        }
+        default: {
+            Dual b;
+            if (ins.op >= OpCode::ADD_L && ins.op <= OpCode::DIV_L) {
+                b = slots[ins.arg];
+            } else {
+                b = stack.back();
+                stack.pop_back();
+            }
+            const Dual a = stack.back();
+            Local local = binary(base(ins.op), a.value, b.value);
+            stack.back() = {local.value, chain(local.da, a.derivative) + chain(local.db, b.derivative)};
+            break;
+        }
+        }
+    }
+    return stack.back();
+}
+
+}
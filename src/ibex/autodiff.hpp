@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ibex/compile.hpp>
+
+namespace ibex
+{
+
+///==================
+/// Automatic Differentiation
+///==================
+
+/// Derivatives are exact for the operators and the common functions. Comparisons
+/// and logical operators are piecewise constant and have derivative 0, abs, max,
+/// min and conditionals use the derivative of the branch taken. Functions can register their
+/// partial derivatives with differentiable(), those that do not are
+/// differentiated numerically with central differences.
+
+/// Evaluates a compiled expression and its gradient in one forward and one
+/// reverse sweep. _values holds one entry per slot and receives the results of
+/// assignments, like CompiledExpression::evaluate(). _gradient receives one entry
+/// per slot, the derivative of the result with respect to the value the slot had
+/// before evaluation. Slots that are only assigned have derivative 0.
+/// Reports WRONG_VALUE_COUNT and returns NaN if either span is shorter than the slots.
+double gradient(const CompiledExpression& _expr, std::span<double> _values, std::span<double> _gradient);
+
+/// Same with the values of a variable map, writing assignments back. _gradient
+/// receives the derivative with respect to every variable the expression reads.
+double gradient(const CompiledExpression& _expr, Variables& _vars, Variables& _gradient);
+
+/// A value and its derivative in one direction
+struct Dual
+{
+    double value = 0.0;
+    double derivative = 0.0;
+};
+
+/// Evaluates a compiled expression and its directional derivative in one forward
+/// sweep of dual numbers. _direction holds one entry per slot, e.g. 1 for the
+/// variable to differentiate by and 0 for all others. Cheaper than gradient()
+/// when there are only a few inputs to differentiate by. Reports WRONG_VALUE_COUNT
+/// and returns NaN if either span is shorter than the slots.
+Dual derivative(const CompiledExpression& _expr, std::span<double> _values, std::span<const double> _direction);
+
+}
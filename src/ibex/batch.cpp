@@ -0,0 +1,529 @@
+#include <ibex/batch.hpp>
+#include <ibex/scratch.hpp>
+#include <ibex/profile.hpp>
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+///==================
+/// Kernels
+///==================
+
+// Every operator provides a scalar implementation and, where the instruction set
+// has one, AVX and SSE implementations for double and float. Comparisons and
+// logical operators yield 1 or 0 like their scalar counterparts, which is why
+// their masks are and-ed with one. The float bodies are those of double with
+// _pd replaced by _ps.
+
+#if defined(__AVX__)
+#define IBEX_AVX(body, float_body) \
+    static __m256d avx(__m256d a, __m256d b) {const __m256d one = _mm256_set1_pd(1.0); (void)one; body} \
+    static __m256 avx(__m256 a, __m256 b) {const __m256 one = _mm256_set1_ps(1.0f); (void)one; float_body}
+#else
+#define IBEX_AVX(body, float_body)
+#endif
+
+#if defined(__SSE2__)
+#define IBEX_SSE(body, float_body) \
+    static __m128d sse(__m128d a, __m128d b) {const __m128d one = _mm_set1_pd(1.0); (void)one; body} \
+    static __m128 sse(__m128 a, __m128 b) {const __m128 one = _mm_set1_ps(1.0f); (void)one; float_body}
+#else
+#define IBEX_SSE(body, float_body)
+#endif
+
+#define IBEX_KERNEL(name, scalar_body, avx_body, sse_body, avx_float_body, sse_float_body) \
+    struct name { \
+        static constexpr bool vectorized = true; \
+        template<typename T> static T scalar(T a, T b) {scalar_body} \
+        IBEX_AVX(avx_body, avx_float_body) \
+        IBEX_SSE(sse_body, sse_float_body) \
+    };
+
+IBEX_KERNEL(Add, return a + b;, return _mm256_add_pd(a, b);, return _mm_add_pd(a, b);,
+    return _mm256_add_ps(a, b);, return _mm_add_ps(a, b);)
+IBEX_KERNEL(Sub, return a - b;, return _mm256_sub_pd(a, b);, return _mm_sub_pd(a, b);,
+    return _mm256_sub_ps(a, b);, return _mm_sub_ps(a, b);)
+IBEX_KERNEL(Mul, return a * b;, return _mm256_mul_pd(a, b);, return _mm_mul_pd(a, b);,
+    return _mm256_mul_ps(a, b);, return _mm_mul_ps(a, b);)
+IBEX_KERNEL(Div, return a / b;, return _mm256_div_pd(a, b);, return _mm_div_pd(a, b);,
+    return _mm256_div_ps(a, b);, return _mm_div_ps(a, b);)
+IBEX_KERNEL(Eq, return a == b;,
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ), one);,
+    return _mm_and_pd(_mm_cmpeq_pd(a, b), one);,
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ), one);,
+    return _mm_and_ps(_mm_cmpeq_ps(a, b), one);)
+IBEX_KERNEL(Neq, return a != b;,
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_NEQ_UQ), one);,
+    return _mm_and_pd(_mm_cmpneq_pd(a, b), one);,
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_NEQ_UQ), one);,
+    return _mm_and_ps(_mm_cmpneq_ps(a, b), one);)
+IBEX_KERNEL(Less, return a < b;,
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ), one);,
+    return _mm_and_pd(_mm_cmplt_pd(a, b), one);,
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ), one);,
+    return _mm_and_ps(_mm_cmplt_ps(a, b), one);)
+IBEX_KERNEL(Leq, return a <= b;,
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_LE_OQ), one);,
+    return _mm_and_pd(_mm_cmple_pd(a, b), one);,
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ), one);,
+    return _mm_and_ps(_mm_cmple_ps(a, b), one);)
+IBEX_KERNEL(Greater, return a > b;,
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ), one);,
+    return _mm_and_pd(_mm_cmpgt_pd(a, b), one);,
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ), one);,
+    return _mm_and_ps(_mm_cmpgt_ps(a, b), one);)
+IBEX_KERNEL(Geq, return a >= b;,
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ), one);,
+    return _mm_and_pd(_mm_cmpge_pd(a, b), one);,
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ), one);,
+    return _mm_and_ps(_mm_cmpge_ps(a, b), one);)
+IBEX_KERNEL(Land, return (a != 0 && b != 0);,
+    const __m256d zero = _mm256_setzero_pd();
+    return _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_NEQ_UQ), _mm256_cmp_pd(b, zero, _CMP_NEQ_UQ)), one);,
+    const __m128d zero = _mm_setzero_pd();
+    return _mm_and_pd(_mm_and_pd(_mm_cmpneq_pd(a, zero), _mm_cmpneq_pd(b, zero)), one);,
+    const __m256 zero = _mm256_setzero_ps();
+    return _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(a, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(b, zero, _CMP_NEQ_UQ)), one);,
+    const __m128 zero = _mm_setzero_ps();
+    return _mm_and_ps(_mm_and_ps(_mm_cmpneq_ps(a, zero), _mm_cmpneq_ps(b, zero)), one);)
+IBEX_KERNEL(Lor, return (a != 0 || b != 0);,
+    const __m256d zero = _mm256_setzero_pd();
+    return _mm256_and_pd(_mm256_or_pd(_mm256_cmp_pd(a, zero, _CMP_NEQ_UQ), _mm256_cmp_pd(b, zero, _CMP_NEQ_UQ)), one);,
+    const __m128d zero = _mm_setzero_pd();
+    return _mm_and_pd(_mm_or_pd(_mm_cmpneq_pd(a, zero), _mm_cmpneq_pd(b, zero)), one);,
+    const __m256 zero = _mm256_setzero_ps();
+    return _mm256_and_ps(_mm256_or_ps(_mm256_cmp_ps(a, zero, _CMP_NEQ_UQ), _mm256_cmp_ps(b, zero, _CMP_NEQ_UQ)), one);,
+    const __m128 zero = _mm_setzero_ps();
+    return _mm_and_ps(_mm_or_ps(_mm_cmpneq_ps(a, zero), _mm_cmpneq_ps(b, zero)), one);)
+// Unary operators ignore b
+IBEX_KERNEL(Neg, (void)b; return -a;,
+    (void)b; return _mm256_xor_pd(a, _mm256_set1_pd(-0.0));,
+    (void)b; return _mm_xor_pd(a, _mm_set1_pd(-0.0));,
+    (void)b; return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f));,
+    (void)b; return _mm_xor_ps(a, _mm_set1_ps(-0.0f));)
+IBEX_KERNEL(Not, (void)b; return !a;,
+    (void)b; return _mm256_and_pd(_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_EQ_OQ), one);,
+    (void)b; return _mm_and_pd(_mm_cmpeq_pd(a, _mm_setzero_pd()), one);,
+    (void)b; return _mm256_and_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_EQ_OQ), one);,
+    (void)b; return _mm_and_ps(_mm_cmpeq_ps(a, _mm_setzero_ps()), one);)
+IBEX_KERNEL(Sqr, (void)b; return a * a;,
+    (void)b; return _mm256_mul_pd(a, a);,
+    (void)b; return _mm_mul_pd(a, a);,
+    (void)b; return _mm256_mul_ps(a, a);,
+    (void)b; return _mm_mul_ps(a, a);)
+IBEX_KERNEL(Bool, (void)b; return a != 0;,
+    (void)b; return _mm256_and_pd(_mm256_cmp_pd(a, _mm256_setzero_pd(), _CMP_NEQ_UQ), one);,
+    (void)b; return _mm_and_pd(_mm_cmpneq_pd(a, _mm_setzero_pd()), one);,
+    (void)b; return _mm256_and_ps(_mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_NEQ_UQ), one);,
+    (void)b; return _mm_and_ps(_mm_cmpneq_ps(a, _mm_setzero_ps()), one);)
+
+#undef IBEX_KERNEL
+#undef IBEX_AVX
+#undef IBEX_SSE
+
+// There is no vector instruction for pow
+struct Pow
+{
+    static constexpr bool vectorized = false;
+    template<typename T> static T scalar(T a, T b) {return std::pow(a, b);}
+};
+
+// Loads, broadcasts and stores vectors of T, for the types that have vector instructions
+template<typename T> struct Lanes {static constexpr size_t avx = 0, sse = 0;};
+
+#if defined(__SSE2__)
+template<> struct Lanes<double>
+{
+    static constexpr size_t sse = 2;
+    static __m128d load_sse(const double* p) {return _mm_loadu_pd(p);}
+    static __m128d set_sse(double v) {return _mm_set1_pd(v);}
+    static void store(double* p, __m128d v) {_mm_storeu_pd(p, v);}
+#if defined(__AVX__)
+    static constexpr size_t avx = 4;
+    static __m256d load_avx(const double* p) {return _mm256_loadu_pd(p);}
+    static __m256d set_avx(double v) {return _mm256_set1_pd(v);}
+    static void store(double* p, __m256d v) {_mm256_storeu_pd(p, v);}
+#else
+    static constexpr size_t avx = 0;
+#endif
+};
+
+template<> struct Lanes<float>
+{
+    static constexpr size_t sse = 4;
+    static __m128 load_sse(const float* p) {return _mm_loadu_ps(p);}
+    static __m128 set_sse(float v) {return _mm_set1_ps(v);}
+    static void store(float* p, __m128 v) {_mm_storeu_ps(p, v);}
+#if defined(__AVX__)
+    static constexpr size_t avx = 8;
+    static __m256 load_avx(const float* p) {return _mm256_loadu_ps(p);}
+    static __m256 set_avx(float v) {return _mm256_set1_ps(v);}
+    static void store(float* p, __m256 v) {_mm256_storeu_ps(p, v);}
+#else
+    static constexpr size_t avx = 0;
+#endif
+};
+#endif
+
+// out[i] = K(a[i], b[i]), or K(a[i], b) if B is a scalar
+template<typename K, typename T, typename B>
+static void kernel(T* out, const T* a, B b, size_t n)
+{
+    using L = Lanes<T>;
+    constexpr bool scalarB = std::is_same_v<B, T>;
+    size_t i = 0;
+    if constexpr (K::vectorized && L::avx > 0) {
+#if defined(__AVX__)
+        for (; i + L::avx <= n; i += L::avx) {
+            decltype(L::load_avx(a)) vb;
+            if constexpr (scalarB) {vb = L::set_avx(b);} else {vb = L::load_avx(b + i);}
+            L::store(out + i, K::avx(L::load_avx(a + i), vb));
+        }
+#endif
+    } else if constexpr (K::vectorized && L::sse > 0) {
+#if defined(__SSE2__)
+        for (; i + L::sse <= n; i += L::sse) {
+            decltype(L::load_sse(a)) vb;
+            if constexpr (scalarB) {vb = L::set_sse(b);} else {vb = L::load_sse(b + i);}
+            L::store(out + i, K::sse(L::load_sse(a + i), vb));
+        }
+#endif
+    }
+    for (; i < n; ++i) {
+        if constexpr (scalarB) {out[i] = K::scalar(a[i], b);} else {out[i] = K::scalar(a[i], b[i]);}
+    }
+}
+
+///==================
+/// Batch Evaluation
+///==================
+
+// Conditionals run each branch on the rows of a chunk that take it, given by a
+// mask of active rows. Arithmetic still runs on all rows, which is cheaper than
+// gathering the active ones and has no side effects, while calls and assignments
+// only run for active rows. A branch that no row of a chunk takes is skipped.
+template<typename T>
+struct Branch
+{
+    const Instruction* end = nullptr; // where the branches join
+    OpCode op = OpCode::JUMP_IF_NOT; // AND_JUMP, OR_JUMP or JUMP_IF_NOT
+    const uint8_t* outer = nullptr; // active rows before the branch, nullptr for all
+    uint8_t* taken = nullptr; // rows of the right operand or the then-branch
+    uint8_t* other = nullptr; // rows of the else-branch
+    T* values = nullptr; // results of the then-branch
+    size_t otherRows = 0;
+    bool blend = false; // both parts have rows, so the results are merged
+};
+
+template<typename T>
+static bool check(const CompiledExpression& _expr, std::span<const std::span<const T>> _columns, size_t _rows)
+{
+    const size_t nslots = _expr.slots().size();
+    if (!_expr.valid()) {return false;}
+    if (_columns.size() < nslots) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        return false;
+    }
+    for (size_t i = 0; i < nslots; ++i) {
+        if (_expr.reads(i) && _columns[i].size() < _rows) {
+            report(Error(ErrorCode::WRONG_VALUE_COUNT, _expr.slots()[i]));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_columns(const CompiledExpression& _expr, std::span<const std::span<const double>> _columns, size_t _rows)
+{
+    return check(_expr, _columns, _rows);
+}
+
+// Evaluates the bytecode of _expr with constants and functions of T
+template<typename T>
+static bool batch(const CompiledExpression& _expr, const T* constants, const BasicNativeImpl<T>* funcs,
+                  std::span<const std::span<const T>> _columns, std::span<T> _out)
+{
+    const size_t nslots = _expr.slots().size();
+    const size_t nrows = _out.size();
+    const T NaN = std::numeric_limits<T>::quiet_NaN();
+    ProfileScope profile(Stage::BATCH);
+
+    if (!check(_expr, _columns, nrows)) {
+        profile.fail();
+        std::fill(_out.begin(), _out.end(), NaN);
+        return false;
+    }
+
+    const Bytecode& bytecode = _expr.bytecode();
+
+    // Every stack entry and every assigned slot owns a chunk sized buffer.
+    // An entry refers to its own buffer or directly to a column chunk.
+    // Nested conditionals own two masks and a buffer for results each.
+    const size_t depth = bytecode.stack_size;
+    const size_t nesting = std::count_if(bytecode.code.begin(), bytecode.code.end(), [](const Instruction& ins) {
+        return ins.op == OpCode::JUMP_IF_NOT || ins.op == OpCode::AND_JUMP || ins.op == OpCode::OR_JUMP;
+    });
+    Scratch<std::vector<T>> memory;
+    Scratch<std::vector<const T*>> pointers;
+    Scratch<std::vector<uint8_t>> masks;
+    Scratch<std::vector<Branch<T>>> branches;
+    memory->resize((depth + nslots + nesting) * BATCH_CHUNK_SIZE);
+    pointers->resize(depth + nslots);
+    masks->resize(2 * nesting * BATCH_CHUNK_SIZE);
+    T* buffers = memory->data();
+    T* slotBuffers = buffers + depth * BATCH_CHUNK_SIZE;
+    T* branchBuffers = slotBuffers + nslots * BATCH_CHUNK_SIZE;
+    const T** entries = pointers->data();
+    const T** slots = entries + depth;
+    Scratch<BasicFunctionArgs<T>> args;
+    const Instruction* code = bytecode.code.data();
+
+    for (size_t begin = 0; begin < nrows; begin += BATCH_CHUNK_SIZE)
+    {
+        const size_t n = std::min(BATCH_CHUNK_SIZE, nrows - begin);
+        for (size_t i = 0; i < nslots; ++i) {
+            slots[i] = _columns[i].empty() ? nullptr : _columns[i].data() + begin;
+        }
+
+        // sp is the number of entries on the stack
+        size_t sp = 0;
+        auto buffer = [&](size_t entry) {return buffers + entry * BATCH_CHUNK_SIZE;};
+        auto unary = [&]<typename K>(K) {
+            T* out = buffer(sp - 1);
+            kernel<K>(out, entries[sp - 1], T(0), n);
+            entries[sp - 1] = out;
+        };
+        auto binary = [&]<typename K>(K) {
+            T* out = buffer(sp - 2);
+            kernel<K>(out, entries[sp - 2], entries[sp - 1], n);
+            entries[sp - 2] = out;
+            --sp;
+        };
+        auto with = [&]<typename K>(K, T rhs) {
+            T* out = buffer(sp - 1);
+            kernel<K>(out, entries[sp - 1], rhs, n);
+            entries[sp - 1] = out;
+        };
+        auto withSlot = [&]<typename K>(K, size_t slot) {
+            T* out = buffer(sp - 1);
+            kernel<K>(out, entries[sp - 1], slots[slot], n);
+            entries[sp - 1] = out;
+        };
+
+        const uint8_t* mask = nullptr; // active rows, all if nullptr
+        auto active = [&](size_t row) {return !mask || mask[row];};
+        branches->clear();
+
+        for (const Instruction* ip = code; ; ++ip)
+        {
+            // Join the branches that end here
+            while (!branches->empty() && branches->back().end == ip) {
+                const Branch<T>& branch = branches->back();
+                if (branch.blend) {
+                    T* out = buffer(sp - 1);
+                    const T* in = entries[sp - 1];
+                    for (size_t row = 0; row < n; ++row) {
+                        if (branch.op == OpCode::JUMP_IF_NOT) {out[row] = branch.taken[row] ? branch.values[row] : in[row];}
+                        else if (!branch.taken[row]) {out[row] = branch.op == OpCode::OR_JUMP;}
+                        else {out[row] = in[row];}
+                    }
+                    entries[sp - 1] = out;
+                }
+                mask = branch.outer;
+                branches->pop_back();
+            }
+            if (ip->op == OpCode::RET) {break;}
+
+            switch (ip->op)
+            {
+            case OpCode::CONST: {
+                T* out = buffer(sp);
+                std::fill(out, out + n, constants[ip->arg]);
+                entries[sp++] = out;
+                break;
+            }
+            case OpCode::LOAD:
+                if (_expr.assigns(ip->arg)) {
+                    // A later STORE would overwrite the slot buffer, so take a copy
+                    T* out = buffer(sp);
+                    std::copy(slots[ip->arg], slots[ip->arg] + n, out);
+                    entries[sp++] = out;
+                } else {
+                    entries[sp++] = slots[ip->arg];
+                }
+                break;
+            case OpCode::STORE: {
+                T* out = slotBuffers + ip->arg * BATCH_CHUNK_SIZE;
+                if (mask) {
+                    // Rows of other branches keep the value the slot had
+                    if (slots[ip->arg] != out) {
+                        if (slots[ip->arg]) {std::copy(slots[ip->arg], slots[ip->arg] + n, out);}
+                        else {std::fill(out, out + n, NaN);}
+                    }
+                    for (size_t row = 0; row < n; ++row) {
+                        if (mask[row]) {out[row] = entries[sp - 1][row];}
+                    }
+                } else if (entries[sp - 1] != out) {
+                    std::copy(entries[sp - 1], entries[sp - 1] + n, out);
+                }
+                slots[ip->arg] = out;
+                break;
+            }
+            case OpCode::CALL: {
+                // Functions are opaque, so they are called row by row
+                sp -= ip->nargs;
+                T* out = buffer(sp);
+                args->resize(ip->nargs);
+                for (size_t row = 0; row < n; ++row) {
+                    if (!active(row)) {out[row] = NaN; continue;}
+                    for (size_t a = 0; a < ip->nargs; ++a) {(*args)[a] = entries[sp + a][row];}
+                    out[row] = funcs[ip->arg](*args);
+                }
+                entries[sp++] = out;
+                break;
+            }
+            case OpCode::AND_JUMP:
+            case OpCode::OR_JUMP: {
+                // Rows whose left operand does not decide the result run the right one
+                const size_t level = branches->size();
+                const bool decides = ip->op == OpCode::OR_JUMP;
+                uint8_t* taken = masks->data() + 2 * level * BATCH_CHUNK_SIZE;
+                size_t rows = 0, takenRows = 0;
+                for (size_t row = 0; row < n; ++row) {
+                    taken[row] = active(row) && (entries[sp - 1][row] != 0.0) != decides;
+                    rows += active(row);
+                    takenRows += taken[row];
+                }
+                if (takenRows == 0) {
+                    T* out = buffer(sp - 1);
+                    std::fill(out, out + n, decides ? 1.0 : 0.0);
+                    entries[sp - 1] = out;
+                    ip = code + ip->arg - 1;
+                    break;
+                }
+                const bool blend = takenRows < rows;
+                branches->push_back({.end = code + ip->arg, .op = ip->op, .outer = mask, .taken = taken, .blend = blend});
+                if (blend) {mask = taken;}
+                --sp;
+                break;
+            }
+            case OpCode::JUMP_IF_NOT: {
+                const size_t level = branches->size();
+                uint8_t* taken = masks->data() + 2 * level * BATCH_CHUNK_SIZE;
+                uint8_t* other = taken + BATCH_CHUNK_SIZE;
+                const T* condition = entries[--sp];
+                size_t takenRows = 0, otherRows = 0;
+                for (size_t row = 0; row < n; ++row) {
+                    taken[row] = active(row) && condition[row] != 0.0;
+                    other[row] = active(row) && !taken[row];
+                    takenRows += taken[row];
+                    otherRows += other[row];
+                }
+                // The then-branch ends with a JUMP to the end of the conditional
+                const Instruction* jump = code + ip->arg - 1;
+                const bool blend = takenRows > 0 && otherRows > 0;
+                branches->push_back({.end = code + jump->arg, .op = ip->op, .outer = mask, .taken = taken,
+                                     .other = other, .values = branchBuffers + level * BATCH_CHUNK_SIZE,
+                                     .otherRows = otherRows, .blend = blend});
+                if (takenRows == 0) {
+                    ip = jump;
+                } else if (blend) {
+                    mask = taken;
+                }
+                break;
+            }
+            case OpCode::JUMP: {
+                Branch<T>& branch = branches->back();
+                if (branch.otherRows == 0) {
+                    ip = code + ip->arg - 1;
+                    break;
+                }
+                // Keep the results of the then-branch and continue with the else-branch
+                std::copy(entries[sp - 1], entries[sp - 1] + n, branch.values);
+                --sp;
+                mask = branch.other;
+                break;
+            }
+            case OpCode::PICK:
+                // Operators write into the buffer of their own entry, so the picked one stays intact
+                entries[sp] = entries[ip->arg];
+                ++sp;
+                break;
+            case OpCode::BOOL: unary(Bool{}); break;
+            case OpCode::ADD: binary(Add{}); break;
+            case OpCode::SUB: binary(Sub{}); break;
+            case OpCode::MUL: binary(Mul{}); break;
+            case OpCode::DIV: binary(Div{}); break;
+            case OpCode::POW: binary(Pow{}); break;
+            case OpCode::EQ: binary(Eq{}); break;
+            case OpCode::NEQ: binary(Neq{}); break;
+            case OpCode::LESS: binary(Less{}); break;
+            case OpCode::LEQ: binary(Leq{}); break;
+            case OpCode::GREATER: binary(Greater{}); break;
+            case OpCode::GEQ: binary(Geq{}); break;
+            case OpCode::LAND: binary(Land{}); break;
+            case OpCode::LOR: binary(Lor{}); break;
+            case OpCode::NEG: unary(Neg{}); break;
+            case OpCode::NOT: unary(Not{}); break;
+            case OpCode::SQR: unary(Sqr{}); break;
+            case OpCode::ADD_C: with(Add{}, constants[ip->arg]); break;
+            case OpCode::SUB_C: with(Sub{}, constants[ip->arg]); break;
+            case OpCode::MUL_C: with(Mul{}, constants[ip->arg]); break;
+            case OpCode::DIV_C: with(Div{}, constants[ip->arg]); break;
+            case OpCode::ADD_L: withSlot(Add{}, ip->arg); break;
+            case OpCode::SUB_L: withSlot(Sub{}, ip->arg); break;
+            case OpCode::MUL_L: withSlot(Mul{}, ip->arg); break;
+            case OpCode::DIV_L: withSlot(Div{}, ip->arg); break;
+            case OpCode::RET: break;
+            }
+        }
+
+        std::copy(entries[sp - 1], entries[sp - 1] + n, _out.begin() + begin);
+    }
+
+    for (T value : _out) {profile.result(value);}
+    return true;
+}
+
+bool evaluate_batch(const CompiledExpression& _expr, std::span<const std::span<const double>> _columns, std::span<double> _out)
+{
+    return batch(_expr, _expr.bytecode().constants.data(), _expr.functions().data(), _columns, _out);
+}
+
+template<typename T>
+bool evaluate_batch(const BasicExpression<T>& _expr, std::type_identity_t<std::span<const std::span<const T>>> _columns,
+                    std::type_identity_t<std::span<T>> _out)
+{
+    return batch(_expr.expr_, _expr.constants().data(), _expr.functions().data(), _columns, _out);
+}
+
+template bool evaluate_batch<float>(const BasicExpression<float>&, std::span<const std::span<const float>>, std::span<float>);
+template bool evaluate_batch<double>(const BasicExpression<double>&, std::span<const std::span<const double>>, std::span<double>);
+template bool evaluate_batch<long double>(const BasicExpression<long double>&, std::span<const std::span<const long double>>,
+                             std::span<long double>);
+
+bool evaluate_batch(const CompiledExpression& _expr, const Columns& _columns, std::span<double> _out)
+{
+    std::vector<std::span<const double>> columns(_expr.slots().size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        auto it = _columns.find(_expr.slots()[i]);
+        if (it != _columns.end()) {
+            columns[i] = it->second;
+        } else if (_expr.reads(i)) {
+            report(Error(ErrorCode::UNKNOWN_VARIABLE, _expr.slots()[i]));
+            std::fill(_out.begin(), _out.end(), ERRD);
+            return false;
+        }
+    }
+    return evaluate_batch(_expr, columns, _out);
+}
+
+}
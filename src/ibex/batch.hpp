@@ -0,0 +1,40 @@
+#pragma once
+
+#include <ibex/compile.hpp>
+
+namespace ibex
+{
+
+///==================
+/// Batch Evaluation
+///==================
+
+/// Columns of input values by variable name
+using Columns = std::unordered_map<std::string, std::span<const double>>;
+
+/// Number of rows that are evaluated per instruction
+static constexpr size_t BATCH_CHUNK_SIZE = 256;
+
+/// Checks that _columns holds a column of at least _rows values for every slot
+/// the expression reads. Otherwise reports WRONG_VALUE_COUNT to the diagnostics sink and returns false.
+bool check_columns(const CompiledExpression& _expr, std::span<const std::span<const double>> _columns, size_t _rows);
+
+/// Evaluates an expression once per row and writes the results to _out.
+/// _columns holds one column per slot of the expression, each with at least
+/// _out.size() values. Columns of slots that the expression only assigns may be empty.
+/// Instructions are executed for chunks of BATCH_CHUNK_SIZE rows at a time, using
+/// AVX or SSE2 kernels where available. Assignments are local to a row and
+/// are not written back to the columns.
+/// Returns false and fills _out with NaN if the columns do not match the expression.
+bool evaluate_batch(const CompiledExpression& _expr, std::span<const std::span<const double>> _columns, std::span<double> _out);
+
+/// Same as above with columns looked up by variable name.
+bool evaluate_batch(const CompiledExpression& _expr, const Columns& _columns, std::span<double> _out);
+
+/// Same as above in float or long double. Float evaluates twice as many rows per
+/// vector instruction as double.
+template<typename T>
+bool evaluate_batch(const BasicExpression<T>& _expr, std::type_identity_t<std::span<const std::span<const T>>> _columns,
+                    std::type_identity_t<std::span<T>> _out);
+
+}
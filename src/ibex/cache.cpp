@@ -0,0 +1,119 @@
+#include <ibex/cache.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+// Estimated memory of a cache entry, including the key
+static size_t footprint(std::string_view text, const CompiledExpression& expr)
+{
+    size_t bytes = sizeof(CompiledExpression) + text.size();
+    bytes += expr.bytecode().code.size() * sizeof(Instruction);
+    bytes += expr.bytecode().constants.size() * sizeof(double);
+    bytes += expr.functions().size() * (sizeof(NativeImpl) + sizeof(DerivativeImpl));
+    for (const std::string& slot : expr.slots()) {bytes += sizeof(std::string) + slot.size();}
+    return bytes;
+}
+
+///==================
+/// Expression Cache
+///==================
+
+ExpressionCache::ExpressionCache(size_t _max_entries, size_t _max_bytes, size_t _shards) :
+    ExpressionCache(default_scope().functions(), _max_entries, _max_bytes, _shards) {}
+
+ExpressionCache::ExpressionCache(const Functions& _funcs, size_t _max_entries, size_t _max_bytes, size_t _shards) :
+    funcs_(_funcs), maxEntries_(_max_entries), maxBytes_(_max_bytes)
+{
+    // Every shard gets an equal part of the capacity, so there are never more
+    // shards than entries. The first shards hold one more of what does not
+    // divide evenly, so together they hold exactly the capacity.
+    _shards = std::clamp<size_t>(_shards, 1, std::max<size_t>(_max_entries, 1));
+    for (size_t i = 0; i < _shards; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->maxEntries = _max_entries / _shards + (i < _max_entries % _shards);
+        shard->maxBytes = _max_bytes / _shards + (i < _max_bytes % _shards);
+        shards_.push_back(std::move(shard));
+    }
+}
+
+void ExpressionCache::evict(Shard& _shard)
+{
+    while (!_shard.lru.empty() && (_shard.lru.size() > _shard.maxEntries || _shard.bytes > _shard.maxBytes)) {
+        const Entry& entry = _shard.lru.back();
+        _shard.bytes -= entry.bytes;
+        _shard.index.erase(entry.text);
+        _shard.lru.pop_back();
+        ++evictions_;
+    }
+}
+
+std::shared_ptr<const CompiledExpression> ExpressionCache::get(std::string_view _text)
+{
+    Shard& shard = *shards_[std::hash<std::string_view>{}(_text) % shards_.size()];
+    {
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find(_text);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            ++hits_;
+            return it->second->expr;
+        }
+    }
+
+    // Compile without holding the lock, other threads may use the shard meanwhile
+    Entry entry{.text = std::string(_text)};
+    auto expr = std::make_shared<CompiledExpression>();
+    compile(entry.text, funcs_, *expr);
+    entry.bytes = footprint(entry.text, *expr);
+    entry.expr = std::move(expr);
+
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.index.find(_text);
+    if (it != shard.index.end()) {
+        // Another thread compiled the same text first, which counts as its miss
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        ++hits_;
+        return it->second->expr;
+    }
+    ++misses_;
+    shard.lru.push_front(std::move(entry));
+    shard.index.emplace(shard.lru.front().text, shard.lru.begin());
+    shard.bytes += shard.lru.front().bytes;
+    std::shared_ptr<const CompiledExpression> result = shard.lru.front().expr;
+    evict(shard);
+    return result;
+}
+
+double ExpressionCache::eval(std::string_view _text, Variables& _vars)
+{
+    std::shared_ptr<const CompiledExpression> expr = get(_text);
+    if (!expr->valid()) {return ERRD;}
+    return expr->evaluate(_vars);
+}
+
+CacheStats ExpressionCache::stats() const
+{
+    CacheStats stats{.hits = hits_, .misses = misses_, .evictions = evictions_};
+    for (const auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        stats.entries += shard->lru.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
+
+void ExpressionCache::clear()
+{
+    for (const auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        shard->index.clear();
+        shard->lru.clear();
+        shard->bytes = 0;
+    }
+}
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <ibex/compile.hpp>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace ibex
+{
+
+///==================
+/// Expression Cache
+///==================
+
+struct CacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0; // lookups that compiled and stored the expression
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0; // estimated memory held by the entries
+};
+
+/// A bounded cache of compiled expressions keyed by their text, safe to use from
+/// several threads. The entries are spread over shards by the hash of the text,
+/// each with its own lock and least recently used order, so lookups of different
+/// expressions rarely contend. A hit evaluates without tokenizing, converting or
+/// compiling. Invalid expressions are cached as well, so they fail fast.
+class ExpressionCache
+{
+public:
+    /// Caches expressions compiled with common_functions()
+    explicit ExpressionCache(size_t _max_entries = 1024, size_t _max_bytes = 16 << 20, size_t _shards = 16);
+
+    /// Caches expressions compiled with _funcs
+    ExpressionCache(const Functions& _funcs, size_t _max_entries = 1024, size_t _max_bytes = 16 << 20, size_t _shards = 16);
+
+    /// Returns the compiled expression for _text, compiling it on a miss. The
+    /// expression stays usable after it has been evicted.
+    std::shared_ptr<const CompiledExpression> get(std::string_view _text);
+
+    /// Evaluates _text with the values of _vars and writes assignments back.
+    double eval(std::string_view _text, Variables& _vars);
+
+    CacheStats stats() const;
+
+    /// Removes all entries. The counters are kept.
+    void clear();
+
+    size_t max_entries() const {return maxEntries_;}
+    size_t max_bytes() const {return maxBytes_;}
+
+private:
+    struct Entry
+    {
+        std::string text = {};
+        std::shared_ptr<const CompiledExpression> expr = nullptr;
+        size_t bytes = 0;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index; // views into Entry::text
+        size_t bytes = 0;
+        size_t maxEntries = 0; // part of the capacity of the cache held by this shard
+        size_t maxBytes = 0;
+    };
+
+    // Drops least recently used entries until the shard fits. Requires the lock of the shard.
+    void evict(Shard& _shard);
+
+    const Functions funcs_;
+    const size_t maxEntries_;
+    const size_t maxBytes_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> hits_ = 0;
+    std::atomic<size_t> misses_ = 0;
+    std::atomic<size_t> evictions_ = 0;
+};
+
+}
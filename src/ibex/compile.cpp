@@ -0,0 +1,749 @@
+#include <ibex/compile.hpp>
+#include <ibex/profile.hpp>
+#include <ibex/scratch.hpp>
+#include <charconv>
+#include <cstdlib>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+///==================
+/// Compilation
+///==================
+
+// Fuses a binary operator with a CONST or LOAD that produced its right operand
+static bool fuse(OpCode op, OpCode rhs, OpCode& fused)
+{
+    static constexpr OpCode withConst[] = {OpCode::ADD_C, OpCode::SUB_C, OpCode::MUL_C, OpCode::DIV_C};
+    static constexpr OpCode withSlot[] = {OpCode::ADD_L, OpCode::SUB_L, OpCode::MUL_L, OpCode::DIV_L};
+    if (op < OpCode::ADD || op > OpCode::DIV) {return false;}
+    size_t i = static_cast<size_t>(op) - static_cast<size_t>(OpCode::ADD);
+    if (rhs == OpCode::CONST) {fused = withConst[i]; return true;}
+    if (rhs == OpCode::LOAD) {fused = withSlot[i]; return true;}
+    return false;
+}
+
+// Temporary state of the compiler, borrowed from the scratch pool
+struct CompilerState
+{
+    std::vector<Instruction> code;
+
+    // For every entry of the simulated stack remember the LOAD that produced it (or -1).
+    // If the entry turns out to be the target of an assignment, that LOAD is dropped.
+    std::vector<int> stack;
+    std::vector<size_t> starts; // first instruction of every entry of the simulated stack
+    std::vector<bool> removed;
+    std::string name; // function name of a TokenView, for the lookup in Functions
+
+    // Rewriting of the code into its final form
+    std::vector<bool> targets; // instructions that are jumped to
+    std::vector<size_t> positions; // final position of every instruction
+    std::vector<std::pair<size_t, size_t>> jumps; // final position and original target
+    std::vector<size_t> open; // targets of the jumps passed, the code before them runs conditionally
+    std::vector<bool> definite; // slots assigned unconditionally so far
+
+    // Shared calls, see share_calls()
+    struct Call
+    {
+        size_t begin; // first token of the arguments
+        size_t end; // one past the call
+        size_t pick; // entry at the bottom of the stack
+    };
+    std::vector<size_t> begins; // first token of the subtree that ends at every token
+    std::vector<size_t> impure; // number of impure tokens before every token
+    std::vector<int> branches; // +1 where a conditional operand starts, -1 where it ends
+    std::vector<std::string_view> assigned;
+    struct Group
+    {
+        size_t begin, end; // of the first call
+        size_t count = 0;
+        bool unconditional = false;
+        size_t pick = 0;
+    };
+    std::vector<Group> groups; // calls with the same tokens
+    std::vector<Call> calls; // the shared ones sorted by begin
+    std::vector<Call> hoisted; // the first call of every group that is shared, by pick
+
+    void clear() {
+        code.clear();
+        stack.clear();
+        starts.clear();
+        removed.clear();
+        jumps.clear();
+        open.clear();
+        calls.clear();
+        hoisted.clear();
+    }
+};
+
+static double literal(const Token& token) {return std::strtod(token.lexeme.c_str(), nullptr);}
+static double literal(const TokenView& token) {return token.value;}
+
+static bool exactly_two(std::string_view _lexeme)
+{
+    long double value;
+    return std::from_chars(_lexeme.data(), _lexeme.data() + _lexeme.size(), value).ec == std::errc() && value == 2.0L;
+}
+
+static const std::string& name(const Token& token, std::string&) {return token.lexeme;}
+static const std::string& name(const TokenView& token, std::string& buffer) {return buffer.assign(token.lexeme);}
+
+// Finds calls of pure functions that occur more than once with the same arguments,
+// e.g. f(x) in f(x)*f(x) + 1/f(x). Each is compiled once in front of the code, stays
+// at the bottom of the stack and is picked from there where it occurs. A call only
+// qualifies if it runs unconditionally at least once and its arguments read no
+// variable that is assigned, so computing it first changes neither the result nor
+// which functions run. Leaves the work to compile_tokens() if the postfix is malformed.
+template<typename T, typename Lookup>
+static void share_calls(const std::vector<T>& postfix, const Lookup& lookup, CompilerState& state)
+{
+    static constexpr size_t MAX_INDEX = std::numeric_limits<uint16_t>::max();
+    static constexpr size_t NONE = std::numeric_limits<size_t>::max();
+    std::vector<size_t>& begins = state.begins;
+    std::vector<size_t>& impure = state.impure;
+    std::vector<int>& branches = state.branches;
+    std::vector<std::string_view>& assigned = state.assigned;
+    std::vector<CompilerState::Group>& groups = state.groups;
+    std::vector<CompilerState::Call>& calls = state.calls;
+    std::vector<size_t>& operands = state.starts; // reused, compile_tokens() clears it
+    const size_t n = postfix.size();
+    begins.resize(n);
+    branches.assign(n + 1, 0);
+    assigned.clear();
+    groups.clear();
+    operands.clear();
+
+    // Subtrees, assigned variables and operands that may not run
+    auto function = [&](const T& token) {return lookup(name(token, state.name));};
+    bool anyPure = false;
+    for (size_t i = 0; i < n; ++i) {
+        const T& token = postfix[i];
+        size_t count = 0;
+        switch (token.type) {
+        case Token::Type::INT: case Token::Type::FLOAT: break;
+        case Token::Type::IDENTIFIER:
+            if (const auto* func = function(token)) {
+                count = token.metadata;
+                anyPure = anyPure || func->pure;
+            }
+            break;
+        case Token::Type::UNARY_PLUS: case Token::Type::UNARY_MINUS: case Token::Type::NOT: count = 1; break;
+        case Token::Type::QUESTION: count = 3; break;
+        default: count = 2; break;
+        }
+        if (operands.size() < count || (token.type == Token::Type::QUESTION && token.metadata != 3)) {return;}
+        const size_t* first = operands.data() + operands.size() - count;
+        begins[i] = count > 0 ? first[0] : i;
+        if (token.type == Token::Type::ASSIGN) {assigned.push_back(std::string_view(postfix[first[0]].lexeme));}
+        // Both branches of a conditional, the right operand of && and ||
+        if (token.type == Token::Type::QUESTION || token.type == Token::Type::LAND || token.type == Token::Type::LOR) {
+            ++branches[first[1]];
+            --branches[i];
+        }
+        operands.resize(operands.size() - count);
+        operands.push_back(begins[i]);
+    }
+    if (!anyPure || operands.size() != 1) {return;}
+
+    // A subtree is pure if it holds no assignment, no call of an impure function
+    // and no read of an assigned variable
+    impure.assign(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        const T& token = postfix[i];
+        bool bad = token.type == Token::Type::ASSIGN;
+        if (token.type == Token::Type::IDENTIFIER) {
+            const auto* func = function(token);
+            bad = func ? !func->pure : std::find(assigned.begin(), assigned.end(),
+                                                 std::string_view(token.lexeme)) != assigned.end();
+        }
+        impure[i + 1] = impure[i] + bad;
+    }
+
+    // Group the pure calls by their tokens, which identify a subtree in postfix
+    auto same = [&](const CompilerState::Group& group, size_t begin, size_t end) {
+        return group.end - group.begin == end - begin &&
+               std::equal(postfix.begin() + begin, postfix.begin() + end, postfix.begin() + group.begin,
+                          [](const T& x, const T& y) {
+                              return x.type == y.type && x.metadata == y.metadata &&
+                                     std::string_view(x.lexeme) == std::string_view(y.lexeme);
+                          });
+    };
+    int conditional = 0;
+    for (size_t i = 0; i < n; ++i) {
+        conditional += branches[i];
+        const T& token = postfix[i];
+        if (token.type != Token::Type::IDENTIFIER || impure[i + 1] != impure[begins[i]] || !function(token)) {continue;}
+        size_t g = 0;
+        while (g < groups.size() && !same(groups[g], begins[i], i + 1)) {++g;}
+        if (g == groups.size()) {groups.push_back({.begin = begins[i], .end = i + 1});}
+        ++groups[g].count;
+        groups[g].unconditional = groups[g].unconditional || conditional == 0;
+        calls.push_back({.begin = begins[i], .end = i + 1, .pick = g});
+    }
+
+    // Groups are ordered by their first call, so calls in the arguments of another are computed before it
+    size_t picks = 0;
+    for (CompilerState::Group& group : groups) {
+        group.pick = group.count > 1 && group.unconditional && picks <= MAX_INDEX ? picks++ : NONE;
+        if (group.pick != NONE) {state.hoisted.push_back({.begin = group.begin, .end = group.end, .pick = group.pick});}
+    }
+    for (CompilerState::Call& call : calls) {call.pick = groups[call.pick].pick;}
+    std::erase_if(calls, [](const CompilerState::Call& call) {return call.pick == NONE;});
+    // Outer calls first where calls start at the same token
+    std::sort(calls.begin(), calls.end(), [](const CompilerState::Call& a, const CompilerState::Call& b) {
+        return a.begin != b.begin ? a.begin < b.begin : a.end > b.end;
+    });
+}
+
+// Compiles postfix tokens, _lookup returns the function of a name or nullptr. Only
+// functions of double are kept, BasicExpression resolves those of other types by name.
+// If literals is given, it receives the text of every constant and only literals of
+// the same text share a constant, so BasicExpression can parse them again as its type.
+template<typename T, typename Lookup>
+bool compile_tokens(const std::vector<T>& postfix, const Lookup& lookup, CompiledExpression& res,
+                    std::string_view source, std::vector<std::string_view>* literals)
+{
+    static constexpr size_t MAX_INDEX = std::numeric_limits<uint16_t>::max();
+    static constexpr size_t MAX_ARGS = std::numeric_limits<uint8_t>::max();
+
+    ProfileScope profile(Stage::COMPILE);
+    res.clear();
+    Scratch<CompilerState> state;
+    state->clear();
+    auto& [code, stack, starts, removed, nameBuffer, targets, positions, jumps, open, definite,
+           begins, impure, branches, assigned, groups, calls, hoisted] = *state;
+    std::vector<double>& constants = res.bytecode_.constants;
+
+    auto fail = [&](ErrorCode code, std::string_view token = {}) {
+        profile.fail();
+        res.clear();
+        res.error_ = report(Error(code, token, source));
+        return false;
+    };
+
+    auto emit = [&](const Instruction& ins) {
+        code.push_back(ins);
+        removed.push_back(false);
+    };
+
+    // Inserts a jump in front of the code of an operand. While compiling, jump
+    // targets are relative, so they stay valid when code is inserted around them.
+    auto insert = [&](size_t _pos, OpCode _op, size_t _offset) {
+        if (_offset > MAX_INDEX) {return false;}
+        code.insert(code.begin() + _pos, {.op = _op, .arg = static_cast<uint16_t>(_offset)});
+        removed.insert(removed.begin() + _pos, false);
+        return true;
+    };
+
+    auto step = [&](const T& token) {
+        OpCode op;
+        switch (token.type)
+        {
+        case Token::Type::INT:
+        case Token::Type::FLOAT:
+        {
+            double value = literal(token);
+            auto it = std::find(constants.begin(), constants.end(), value);
+            if (literals) {
+                while (it != constants.end() && (*literals)[it - constants.begin()] != token.lexeme) {
+                    it = std::find(it + 1, constants.end(), value);
+                }
+            }
+            if (it == constants.end()) {
+                if (constants.size() > MAX_INDEX) {return fail(ErrorCode::LIMIT_EXCEEDED, token.lexeme);}
+                it = constants.insert(constants.end(), value);
+                if (literals) {literals->push_back(token.lexeme);}
+            }
+            starts.push_back(code.size());
+            emit({.op = OpCode::CONST, .arg = static_cast<uint16_t>(it - constants.begin())});
+            stack.push_back(-1);
+            break;
+        }
+
+        case Token::Type::IDENTIFIER:
+        {
+            // Check if it's a function
+            const std::string& funcName = name(token, nameBuffer);
+            if (const auto* func = lookup(funcName)) {
+                if (stack.size() < token.metadata || token.metadata > MAX_ARGS ||
+                    (func->arity >= 0 && token.metadata != static_cast<size_t>(func->arity))) {
+                    return fail(ErrorCode::WRONG_ARGUMENT_COUNT, token.lexeme);
+                }
+                std::vector<std::string>& names = res.functionNames_;
+                size_t id = std::find(names.begin(), names.end(), funcName) - names.begin();
+                if (id == names.size()) {
+                    if (id > MAX_INDEX) {return fail(ErrorCode::LIMIT_EXCEEDED, token.lexeme);}
+                    names.push_back(funcName);
+                    if constexpr (std::is_same_v<std::decay_t<decltype(*func)>, Function>) {
+                        res.functions_.push_back(profiled(funcName, func->impl));
+                        res.derivatives_.push_back(func->derivative);
+                    } else {
+                        res.functions_.emplace_back();
+                        res.derivatives_.emplace_back();
+                    }
+                }
+                const size_t start = token.metadata > 0 ? starts[starts.size() - token.metadata] : code.size();
+                emit({.op = OpCode::CALL, .nargs = static_cast<uint8_t>(token.metadata), .arg = static_cast<uint16_t>(id)});
+                stack.resize(stack.size() - token.metadata);
+                stack.push_back(-1);
+                starts.resize(starts.size() - token.metadata);
+                starts.push_back(start);
+                break;
+            }
+            if (token.metadata > 0) {return fail(ErrorCode::UNKNOWN_FUNCTION, token.lexeme);}
+
+            // Treat it as a variable
+            size_t id = std::find(res.slots_.begin(), res.slots_.end(), token.lexeme) - res.slots_.begin();
+            if (id == res.slots_.size()) {
+                if (id > MAX_INDEX) {return fail(ErrorCode::LIMIT_EXCEEDED, token.lexeme);}
+                res.slots_.emplace_back(token.lexeme);
+            }
+            stack.push_back(code.size());
+            starts.push_back(code.size());
+            emit({.op = OpCode::LOAD, .arg = static_cast<uint16_t>(id)});
+            break;
+        }
+
+        case Token::Type::UNARY_PLUS:
+        case Token::Type::UNARY_MINUS:
+        case Token::Type::NOT:
+            if (stack.empty()) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            if (token.type == Token::Type::UNARY_MINUS) {emit({.op = OpCode::NEG});}
+            if (token.type == Token::Type::NOT) {emit({.op = OpCode::NOT});}
+            stack.back() = -1;
+            break;
+
+        case Token::Type::ASSIGN:
+        {
+            if (stack.size() < 2) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            stack.pop_back();
+            starts.pop_back();
+            int load = stack.back();
+            if (load < 0) {return fail(ErrorCode::NOT_ASSIGNABLE, token.lexeme);}
+            removed[load] = true;
+            emit({.op = OpCode::STORE, .arg = code[load].arg});
+            stack.back() = -1;
+            break;
+        }
+
+        case Token::Type::LAND:
+        case Token::Type::LOR:
+        {
+            if (stack.size() < 2) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            // a && b runs as: a, AND_JUMP end, b, BOOL, end. The right operand is
+            // skipped if the left one decides the result.
+            const size_t rhs = starts.back();
+            op = token.type == Token::Type::LAND ? OpCode::AND_JUMP : OpCode::OR_JUMP;
+            if (!insert(rhs, op, code.size() - rhs + 1)) {return fail(ErrorCode::LIMIT_EXCEEDED, token.lexeme);}
+            emit({.op = OpCode::BOOL});
+            stack.pop_back();
+            starts.pop_back();
+            stack.back() = -1;
+            break;
+        }
+
+        case Token::Type::QUESTION:
+        {
+            if (token.metadata != 3) {return fail(ErrorCode::MISSING_COLON, token.lexeme);}
+            if (stack.size() < 3) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            // c ? a : b runs as: c, JUMP_IF_NOT else, a, JUMP end, else: b, end
+            const size_t otherwise = starts.back();
+            const size_t then = starts[starts.size() - 2];
+            if (!insert(otherwise, OpCode::JUMP, code.size() - otherwise) ||
+                !insert(then, OpCode::JUMP_IF_NOT, otherwise - then + 1)) {
+                return fail(ErrorCode::LIMIT_EXCEEDED, token.lexeme);
+            }
+            stack.resize(stack.size() - 2);
+            starts.resize(starts.size() - 2);
+            stack.back() = -1;
+            break;
+        }
+
+        default:
+            if (!binary_opcode(token.type, op)) {return fail(ErrorCode::UNEXPECTED_TOKEN, token.lexeme);}
+            if (stack.size() < 2) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            emit({.op = op});
+            stack.pop_back();
+            starts.pop_back();
+            stack.back() = -1;
+            break;
+        }
+        return true;
+    };
+
+    // Compiles the tokens of a subtree, the calls shared before pick are picked from the stack
+    auto subtree = [&](size_t _begin, size_t _end, size_t _pick) {
+        auto call = calls.begin();
+        for (size_t i = _begin; i < _end;) {
+            while (call != calls.end() &&
+                   (call->begin < i || (call->begin == i && (call->pick >= _pick || call->end > _end)))) {++call;}
+            if (call != calls.end() && call->begin == i) {
+                starts.push_back(code.size());
+                emit({.op = OpCode::PICK, .arg = static_cast<uint16_t>(call->pick)});
+                stack.push_back(-1);
+                i = call->end;
+            } else if (!step(postfix[i++])) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    share_calls(postfix, lookup, *state);
+    starts.clear();
+    for (const CompilerState::Call& call : hoisted) {
+        if (!subtree(call.begin, call.end, call.pick)) {return false;}
+    }
+    if (!subtree(0, postfix.size(), hoisted.size())) {return false;}
+
+    if (stack.size() != hoisted.size() + 1) {return fail(ErrorCode::INVALID_EXPRESSION);}
+
+    // Drop the loads of assignment targets, fuse operators with their right operand,
+    // make jump targets absolute and record which slots are inputs. An instruction
+    // that is jumped to is never fused with the one before it, which belongs to
+    // another branch. A slot is an input if it may be read before being assigned.
+    targets.assign(code.size() + 1, false);
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (is_jump(code[i].op)) {targets[i + 1 + code[i].arg] = true;}
+    }
+    positions.resize(code.size() + 1);
+    definite.assign(res.slots_.size(), false);
+    res.reads_.assign(res.slots_.size(), false);
+    res.assigns_.assign(res.slots_.size(), false);
+    std::vector<Instruction>& out = res.bytecode_.code;
+    for (size_t i = 0; i < code.size(); ++i) {
+        std::erase_if(open, [i](size_t target) {return target <= i;});
+        positions[i] = out.size();
+        if (removed[i]) {
+            if (targets[i]) {targets[i + 1] = true;}
+            continue;
+        }
+        Instruction ins = code[i];
+        OpCode fused;
+        if (!targets[i] && !out.empty() && fuse(ins.op, out.back().op, fused)) {
+            ins = {.op = fused, .arg = out.back().arg};
+            out.pop_back();
+        }
+        // x^2 is as exact as x*x, so it never needs pow. A literal that only rounds
+        // to 2 as a double may not be 2 in a wider type.
+        if (!targets[i] && ins.op == OpCode::POW && out.back().op == OpCode::CONST && constants[out.back().arg] == 2.0
+            && (!literals || exactly_two((*literals)[out.back().arg]))) {
+            ins = {.op = OpCode::SQR};
+            out.pop_back();
+        }
+        positions[i] = out.size();
+        if (is_jump(ins.op)) {
+            jumps.emplace_back(out.size(), i + 1 + ins.arg);
+            open.push_back(i + 1 + ins.arg);
+        }
+        if (ins.op == OpCode::LOAD || (ins.op >= OpCode::ADD_L && ins.op <= OpCode::DIV_L)) {
+            if (!definite[ins.arg]) {res.reads_[ins.arg] = true;}
+        }
+        if (ins.op == OpCode::STORE) {
+            res.assigns_[ins.arg] = true;
+            if (open.empty()) {definite[ins.arg] = true;}
+        }
+        out.push_back(ins);
+    }
+    positions[code.size()] = out.size();
+    out.push_back({.op = OpCode::RET});
+    for (auto [at, target] : jumps) {
+        if (positions[target] > MAX_INDEX) {return fail(ErrorCode::LIMIT_EXCEEDED);}
+        out[at].arg = positions[target];
+    }
+
+    if (!verify(out, constants.size(), res.slots_.size(), res.functions_.size(), res.bytecode_.stack_size)) {
+        return fail(ErrorCode::INVALID_EXPRESSION);
+    }
+
+    return true;
+}
+
+// Looks up functions in a map or in a scope and its parents
+template<typename T>
+static auto lookup(const BasicFunctions<T>& _funcs)
+{
+    return [&_funcs](const std::string& _name) -> const BasicFunction<T>* {
+        auto it = _funcs.find(_name);
+        return it != _funcs.end() ? &it->second : nullptr;
+    };
+}
+
+static auto lookup(const Scope& _scope)
+{
+    return [&_scope](const std::string& _name) {return _scope.find_function(_name);};
+}
+
+template<typename Lookup>
+bool compile_text(std::string_view _text, const Lookup& _lookup, CompiledExpression& _expr)
+{
+    Scratch<std::vector<TokenView>> tokens;
+    Scratch<std::vector<TokenView>> postfix;
+    Error error;
+    if (!tokenize(_text, *tokens, &error) || !generate_postfix(*tokens, *postfix, &error, _text)) {
+        _expr.clear();
+        _expr.error_ = error;
+        return false;
+    }
+    return compile_tokens(*postfix, _lookup, _expr, _text, nullptr);
+}
+
+bool compile(const std::vector<Token>& _postfix, const Functions& _funcs, CompiledExpression& _expr)
+{
+    return compile_tokens(_postfix, lookup(_funcs), _expr, {}, nullptr);
+}
+
+bool compile(const std::vector<TokenView>& _postfix, const Functions& _funcs, CompiledExpression& _expr)
+{
+    return compile_tokens(_postfix, lookup(_funcs), _expr, {}, nullptr);
+}
+
+bool compile(std::string_view _text, const Functions& _funcs, CompiledExpression& _expr)
+{
+    return compile_text(_text, lookup(_funcs), _expr);
+}
+
+bool compile(const std::vector<Token>& _postfix, const Scope& _scope, CompiledExpression& _expr)
+{
+    return compile_tokens(_postfix, lookup(_scope), _expr, {}, nullptr);
+}
+
+bool compile(std::string_view _text, const Scope& _scope, CompiledExpression& _expr)
+{
+    return compile_text(_text, lookup(_scope), _expr);
+}
+
+CompiledExpression compile(const std::vector<Token>& _postfix, const Functions& _funcs)
+{
+    CompiledExpression res;
+    compile(_postfix, _funcs, res);
+    return res;
+}
+
+CompiledExpression compile(const char* _text, const Functions& _funcs)
+{
+    CompiledExpression res;
+    compile(_text, _funcs, res);
+    return res;
+}
+
+CompiledExpression compile(const char* _text)
+{
+    return compile(_text, default_scope().functions());
+}
+
+///==================
+/// Evaluation
+///==================
+
+void CompiledExpression::clear()
+{
+    bytecode_.code.clear();
+    bytecode_.constants.clear();
+    bytecode_.stack_size = 0;
+    slots_.clear();
+    reads_.clear();
+    assigns_.clear();
+    functions_.clear();
+    functionNames_.clear();
+    derivatives_.clear();
+    error_ = Error();
+}
+
+int CompiledExpression::slot(const std::string& _name) const
+{
+    auto it = std::find(slots_.begin(), slots_.end(), _name);
+    return it != slots_.end() ? static_cast<int>(it - slots_.begin()) : -1;
+}
+
+std::vector<double> CompiledExpression::bind(const Variables& _vars) const
+{
+    std::vector<double> values(slots_.size());
+    bind(_vars, values);
+    return values;
+}
+
+void CompiledExpression::bind(const Variables& _vars, std::span<double> _values) const
+{
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        auto it = _vars.find(slots_[i]);
+        _values[i] = it != _vars.end() ? it->second : ERRD;
+    }
+}
+
+void CompiledExpression::unbind(std::span<const double> _values, Variables& _vars) const
+{
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (assigns_[i]) {_vars[slots_[i]] = _values[i];}
+    }
+}
+
+double CompiledExpression::evaluate(std::span<double> _values) const
+{
+    ProfileScope profile(Stage::EVALUATE);
+    if (!valid()) {
+        profile.fail();
+        return ERRD;
+    }
+    if (_values.size() < slots_.size()) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        profile.fail();
+        return ERRD;
+    }
+
+    const double result = execute(bytecode_.code.data(), bytecode_.constants.data(), functions_.data(),
+                                  _values.data(), bytecode_.stack_size);
+    profile.result(result);
+    return result;
+}
+
+double CompiledExpression::evaluate(Variables& _vars) const
+{
+    return try_evaluate(_vars).value;
+}
+
+Result CompiledExpression::try_evaluate(std::span<double> _values) const
+{
+    if (!valid()) {return {.error = error_ ? error_ : Error(ErrorCode::NOT_COMPILED)};}
+    if (_values.size() < slots_.size()) {return {.error = report(Error(ErrorCode::WRONG_VALUE_COUNT))};}
+
+    take_function_error();
+    Result result{.value = evaluate(_values)};
+    result.error = take_function_error();
+    return result;
+}
+
+Result CompiledExpression::try_evaluate(Variables& _vars) const
+{
+    Scratch<std::vector<double>> values;
+    values->resize(slots_.size());
+    Error missing;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        auto it = _vars.find(slots_[i]);
+        if (it != _vars.end()) {(*values)[i] = it->second; continue;}
+        if (reads_[i]) {
+            const Error error = report(Error(ErrorCode::UNKNOWN_VARIABLE, slots_[i]));
+            if (!missing) {missing = error;}
+        }
+        (*values)[i] = ERRD;
+    }
+
+    Result result = try_evaluate(*values);
+    unbind(*values, _vars);
+    if (missing && result.ok()) {result.error = missing;}
+    return result;
+}
+
+double CompiledExpression::evaluate(Scope& _scope) const
+{
+    return try_evaluate(_scope).value;
+}
+
+Result CompiledExpression::try_evaluate(Scope& _scope) const
+{
+    Scratch<std::vector<double>> values;
+    values->resize(slots_.size());
+    Error missing;
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (const double* value = _scope.find_variable(slots_[i])) {(*values)[i] = *value; continue;}
+        if (reads_[i]) {
+            const Error error = report(Error(ErrorCode::UNKNOWN_VARIABLE, slots_[i]));
+            if (!missing) {missing = error;}
+        }
+        (*values)[i] = ERRD;
+    }
+
+    // Assignments go into the scope itself, the parents stay untouched
+    Result result = try_evaluate(*values);
+    unbind(*values, _scope.variables());
+    if (missing && result.ok()) {result.error = missing;}
+    return result;
+}
+
+///==================
+/// Scalar Types
+///==================
+
+template<typename T>
+bool compile(std::string_view _text, const BasicFunctions<T>& _funcs, BasicExpression<T>& _expr)
+{
+    CompiledExpression& expr = _expr.expr_;
+    _expr.constants_.clear();
+    _expr.functions_.clear();
+    Scratch<std::vector<TokenView>> tokens;
+    Scratch<std::vector<TokenView>> postfix;
+    Error error;
+    if (!tokenize(_text, *tokens, &error) || !generate_postfix(*tokens, *postfix, &error, _text)) {
+        expr.clear();
+        expr.error_ = error;
+        return false;
+    }
+    Scratch<std::vector<std::string_view>> literals;
+    literals->clear();
+    if (!compile_tokens(*postfix, lookup(_funcs), expr, _text, &*literals)) {return false;}
+
+    // Literals are parsed again as T, so long double keeps the digits that double drops
+    const std::vector<double>& constants = expr.bytecode_.constants;
+    _expr.constants_.assign(constants.begin(), constants.end());
+    for (size_t i = 0; i < literals->size(); ++i) {
+        const std::string_view lexeme = (*literals)[i];
+        T value;
+        if (std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value).ec == std::errc()) {
+            _expr.constants_[i] = value;
+        }
+    }
+    for (const std::string& name : expr.functionNames_) {_expr.functions_.push_back(_funcs.at(name).impl);}
+    return true;
+}
+
+template<typename T>
+T BasicExpression<T>::evaluate(std::span<T> _values) const
+{
+    ProfileScope profile(Stage::EVALUATE);
+    if (!valid()) {
+        profile.fail();
+        return std::numeric_limits<T>::quiet_NaN();
+    }
+    if (_values.size() < slots().size()) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        profile.fail();
+        return std::numeric_limits<T>::quiet_NaN();
+    }
+
+    const Bytecode& code = bytecode();
+    const T result = execute(code.code.data(), constants_.data(), functions_.data(), _values.data(), code.stack_size);
+    profile.result(result);
+    return result;
+}
+
+template<typename T>
+T BasicExpression<T>::evaluate(BasicVariables<T>& _vars) const
+{
+    const std::vector<std::string>& names = slots();
+    Scratch<std::vector<T>> values;
+    values->resize(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        auto it = _vars.find(names[i]);
+        if (it != _vars.end()) {(*values)[i] = it->second; continue;}
+        if (reads(i)) {report(Error(ErrorCode::UNKNOWN_VARIABLE, names[i]));}
+        (*values)[i] = std::numeric_limits<T>::quiet_NaN();
+    }
+
+    const T result = evaluate(*values);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (assigns(i)) {_vars[names[i]] = (*values)[i];}
+    }
+    return result;
+}
+
+template class BasicExpression<float>;
+template class BasicExpression<double>;
+template class BasicExpression<long double>;
+template bool compile(std::string_view, const BasicFunctions<float>&, BasicExpression<float>&);
+template bool compile(std::string_view, const BasicFunctions<double>&, BasicExpression<double>&);
+template bool compile(std::string_view, const BasicFunctions<long double>&, BasicExpression<long double>&);
+
+}
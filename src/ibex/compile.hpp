@@ -0,0 +1,187 @@
+#pragma once
+
+#include <ibex/ibex.hpp>
+#include <ibex/vm.hpp>
+#include <span>
+
+namespace ibex
+{
+
+///==================
+/// Compilation
+///==================
+
+/// An expression that has been tokenized, converted to postfix and compiled to
+/// bytecode once, so it can be evaluated many times with different variable values.
+/// Literals are stored as doubles, variables as slot indices and functions as
+/// call targets. A CompiledExpression is immutable and may be evaluated
+/// concurrently from several threads.
+template<typename T>
+class BasicExpression;
+
+class CompiledExpression
+{
+public:
+    CompiledExpression() = default;
+
+    /// False if compilation failed. Evaluating an invalid expression yields NaN.
+    bool valid() const {return !bytecode_.code.empty();}
+
+    /// Why compilation failed, with the position in the text if compiled from text
+    const Error& error() const {return error_;}
+
+    /// Names of the variables referenced by the expression, in slot order.
+    const std::vector<std::string>& slots() const {return slots_;}
+
+    /// Slot index of a variable or -1 if the expression does not reference it.
+    int slot(const std::string& _name) const;
+
+    /// True if the expression reads the slot before assigning it, i.e. the slot is an input.
+    bool reads(size_t _slot) const {return reads_[_slot];}
+
+    /// True if the expression assigns to the slot.
+    bool assigns(size_t _slot) const {return assigns_[_slot];}
+
+    /// Collects the current values of all slots from a variable map.
+    /// Variables missing from the map are set to NaN.
+    std::vector<double> bind(const Variables& _vars) const;
+
+    /// Same as above, writing into _values which must hold one entry per slot.
+    void bind(const Variables& _vars, std::span<double> _values) const;
+
+    /// Writes the slots that the expression assigns to back into a variable map.
+    void unbind(std::span<const double> _values, Variables& _vars) const;
+
+    /// Evaluates the expression. _values must hold one entry per slot and
+    /// receives the results of assignments. Does not allocate after the first
+    /// call on a thread and performs no name lookups.
+    double evaluate(std::span<double> _values) const;
+
+    /// Evaluates with the values of a variable map and writes assignments back.
+    /// Reports variables that are read but missing from the map and treats them as NaN.
+    double evaluate(Variables& _vars) const;
+
+    /// Same as evaluate(), with the error if the expression is invalid, values
+    /// are missing or a function reported one through function_error().
+    Result try_evaluate(std::span<double> _values) const;
+
+    /// Same as above, with an UNKNOWN_VARIABLE error for the first variable that is read but missing.
+    Result try_evaluate(Variables& _vars) const;
+
+    /// Evaluates with the variables of a scope and its parents and assigns into _scope.
+    double evaluate(Scope& _scope) const;
+
+    Result try_evaluate(Scope& _scope) const;
+
+    const Bytecode& bytecode() const {return bytecode_;}
+
+    const std::vector<NativeImpl>& functions() const {return functions_;}
+
+    /// Names of the functions, in call target order
+    const std::vector<std::string>& function_names() const {return functionNames_;}
+
+    /// Partial derivatives of the functions, empty where none were registered
+    const std::vector<DerivativeImpl>& derivatives() const {return derivatives_;}
+
+    /// Resets to an invalid expression but keeps the allocated memory.
+    void clear();
+
+private:
+    template<typename T, typename Lookup>
+    friend bool compile_tokens(const std::vector<T>& _postfix, const Lookup& _lookup, CompiledExpression& _expr,
+                               std::string_view _source, std::vector<std::string_view>* _literals);
+    template<typename Lookup>
+    friend bool compile_text(std::string_view _text, const Lookup& _lookup, CompiledExpression& _expr);
+    template<typename T>
+    friend bool compile(std::string_view _text, const BasicFunctions<T>& _funcs, BasicExpression<T>& _expr);
+    friend class ExpressionArchive;
+
+    Bytecode bytecode_;
+    std::vector<std::string> slots_;
+    std::vector<bool> reads_;
+    std::vector<bool> assigns_;
+    std::vector<NativeImpl> functions_;
+    std::vector<std::string> functionNames_;
+    std::vector<DerivativeImpl> derivatives_;
+    Error error_;
+};
+
+CompiledExpression compile(const std::vector<Token>& _postfix, const Functions& _funcs);
+
+/// Compiles into an existing expression, reusing its memory. Returns false if
+/// compilation failed, the reason is then in _expr.error().
+bool compile(const std::vector<Token>& _postfix, const Functions& _funcs, CompiledExpression& _expr);
+
+bool compile(const std::vector<TokenView>& _postfix, const Functions& _funcs, CompiledExpression& _expr);
+
+/// Tokenizes, converts and compiles text into an existing expression. Tokens are
+/// kept in reused buffers, so recompiling does not allocate once they are warm.
+bool compile(std::string_view _text, const Functions& _funcs, CompiledExpression& _expr);
+
+CompiledExpression compile(const char* _text, const Functions& _funcs);
+
+/// Same as above with the functions of a scope and its parents
+bool compile(const std::vector<Token>& _postfix, const Scope& _scope, CompiledExpression& _expr);
+
+bool compile(std::string_view _text, const Scope& _scope, CompiledExpression& _expr);
+
+/// Compiles with the functions of default_scope()
+CompiledExpression compile(const char* _text);
+
+///==================
+/// Scalar Types
+///==================
+
+/// A compiled expression that evaluates in float or long double, e.g. float for
+/// bulk evaluation with twice the SIMD lanes and half the memory traffic of
+/// double. The bytecode is that of CompiledExpression, literals are parsed as T
+/// and calls go to the functions of T. Instantiated for float, double and long double.
+template<typename T>
+class BasicExpression
+{
+public:
+    BasicExpression() = default;
+
+    bool valid() const {return expr_.valid();}
+
+    const Error& error() const {return expr_.error();}
+
+    const std::vector<std::string>& slots() const {return expr_.slots();}
+
+    int slot(const std::string& _name) const {return expr_.slot(_name);}
+
+    bool reads(size_t _slot) const {return expr_.reads(_slot);}
+
+    bool assigns(size_t _slot) const {return expr_.assigns(_slot);}
+
+    /// Same as CompiledExpression::evaluate()
+    T evaluate(std::span<T> _values) const;
+
+    T evaluate(BasicVariables<T>& _vars) const;
+
+    const Bytecode& bytecode() const {return expr_.bytecode();}
+
+    /// The literals as T, by the constant indices of the bytecode
+    const std::vector<T>& constants() const {return constants_;}
+
+    const std::vector<BasicNativeImpl<T>>& functions() const {return functions_;}
+
+private:
+    template<typename U>
+    friend bool compile(std::string_view _text, const BasicFunctions<U>& _funcs, BasicExpression<U>& _expr);
+    template<typename U>
+    friend bool evaluate_batch(const BasicExpression<U>& _expr,
+                               std::type_identity_t<std::span<const std::span<const U>>> _columns,
+                               std::type_identity_t<std::span<U>> _out);
+
+    CompiledExpression expr_; // without functions, they are resolved in those of T
+    std::vector<T> constants_;
+    std::vector<BasicNativeImpl<T>> functions_;
+};
+
+/// Compiles text with functions of T, e.g. common_functions<float>(). Returns
+/// false if compilation failed, the reason is then in _expr.error().
+template<typename T>
+bool compile(std::string_view _text, const BasicFunctions<T>& _funcs, BasicExpression<T>& _expr);
+
+}
@@ -0,0 +1,101 @@
+#include <ibex/error.hpp>
+#include <ibex/profile.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <utility>
+
+namespace ibex
+{
+
+const char* error_message(ErrorCode _code)
+{
+    switch (_code) {
+    case ErrorCode::NONE: return "No error";
+    case ErrorCode::MALFORMED_NUMBER: return "Exponent has no digits";
+    case ErrorCode::MISMATCHED_PARENTHESES: return "Mismatched parentheses";
+    case ErrorCode::UNEXPECTED_TOKEN: return "Unexpected token";
+    case ErrorCode::UNEXPECTED_COLON: return "Unexpected : without ?";
+    case ErrorCode::MISSING_COLON: return "Expected : in conditional";
+    case ErrorCode::INSUFFICIENT_OPERANDS: return "Insufficient operands";
+    case ErrorCode::NOT_ASSIGNABLE: return "Expression is not assignable";
+    case ErrorCode::UNKNOWN_FUNCTION: return "Unknown function";
+    case ErrorCode::WRONG_ARGUMENT_COUNT: return "Wrong number of arguments";
+    case ErrorCode::INVALID_EXPRESSION: return "Invalid expression";
+    case ErrorCode::LIMIT_EXCEEDED: return "Expression too large";
+    case ErrorCode::UNSUPPORTED: return "Not supported";
+    case ErrorCode::NOT_COMPILED: return "Expression is not compiled";
+    case ErrorCode::WRONG_VALUE_COUNT: return "Wrong number of values";
+    case ErrorCode::UNKNOWN_VARIABLE: return "Unknown variable";
+    case ErrorCode::INVALID_ARGUMENT: return "Invalid argument";
+    case ErrorCode::DEPENDENCY: return "Invalid dependency";
+    case ErrorCode::IO: return "Cannot read file";
+    }
+    return "";
+}
+
+Error::Error(ErrorCode _code, std::string_view _token, std::string_view _source) : code(_code)
+{
+    length_ = std::min(_token.size(), TOKEN_SIZE);
+    std::copy_n(_token.data(), length_, chars_.data());
+    // Unrelated pointers are compared with std::less, which is a total order
+    std::less<const char*> less;
+    if (!_source.empty() && !less(_token.data(), _source.data()) && less(_token.data(), _source.data() + _source.size())) {
+        position = _token.data() - _source.data();
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const Error& _error)
+{
+    os << error_message(_error.code);
+    if (!_error.token().empty()) {os << ": " << _error.token();}
+    if (_error.position != Error::NPOS) {os << " at " << _error.position;}
+    return os;
+}
+
+///==================
+/// Diagnostics
+///==================
+
+static std::atomic<DiagnosticsSink> diagnosticsSink = nullptr;
+
+void set_diagnostics_sink(DiagnosticsSink _sink)
+{
+    diagnosticsSink = _sink;
+}
+
+void print_error(const Error& _error)
+{
+    std::cerr << _error << std::endl;
+}
+
+Error report(Error _error)
+{
+    count_error(_error.code);
+    if (DiagnosticsSink sink = diagnosticsSink.load(std::memory_order_relaxed)) {sink(_error);}
+    return _error;
+}
+
+static thread_local Error functionError;
+static thread_local size_t functionErrors = 0;
+
+double function_error(ErrorCode _code, std::string_view _function)
+{
+    const Error error = report(Error(_code, _function));
+    if (!functionError) {functionError = error;}
+    ++functionErrors;
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+Error take_function_error()
+{
+    return std::exchange(functionError, Error());
+}
+
+size_t function_error_count()
+{
+    return functionErrors;
+}
+
+}
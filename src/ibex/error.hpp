@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string_view>
+
+namespace ibex
+{
+
+///==================
+/// Errors
+///==================
+
+enum class ErrorCode : unsigned char
+{
+    NONE,
+    MALFORMED_NUMBER, // an exponent without digits
+    MISMATCHED_PARENTHESES,
+    UNEXPECTED_TOKEN,
+    UNEXPECTED_COLON, // a : without ?
+    MISSING_COLON, // a ? without :
+    INSUFFICIENT_OPERANDS,
+    NOT_ASSIGNABLE,
+    UNKNOWN_FUNCTION,
+    WRONG_ARGUMENT_COUNT,
+    INVALID_EXPRESSION, // an empty expression or operands without operator
+    LIMIT_EXCEEDED, // too many constants, variables or functions, or too much code
+    UNSUPPORTED, // valid, but not where it is used, e.g. conditionals in expression sets
+    NOT_COMPILED, // evaluating an expression that is not valid
+    WRONG_VALUE_COUNT, // fewer values, columns or rows than needed
+    UNKNOWN_VARIABLE,
+    INVALID_ARGUMENT, // reported by a function
+    DEPENDENCY, // a variable assigned twice or depending on itself
+    IO, // a file that cannot be read or has the wrong size
+};
+
+inline constexpr size_t ERROR_CODE_COUNT = static_cast<size_t>(ErrorCode::IO) + 1;
+
+const char* error_message(ErrorCode _code);
+
+/// What went wrong and where. An Error is a plain value, set without I/O or
+/// heap allocation. It keeps a copy of the offending token, truncated to
+/// TOKEN_SIZE bytes, and its byte offset in the source text if known.
+struct Error
+{
+    static constexpr size_t NPOS = std::numeric_limits<size_t>::max();
+    static constexpr size_t TOKEN_SIZE = 32;
+
+    ErrorCode code = ErrorCode::NONE;
+    size_t position = NPOS;
+
+    Error() = default;
+
+    /// _source is the text the token refers to, if any, for its position
+    explicit Error(ErrorCode _code, std::string_view _token = {}, std::string_view _source = {});
+
+    std::string_view token() const {return {chars_.data(), length_};}
+
+    explicit operator bool() const {return code != ErrorCode::NONE;}
+
+private:
+    std::array<char, TOKEN_SIZE> chars_{};
+    uint8_t length_ = 0;
+};
+
+/// e.g. "Unknown function: foo at 4"
+std::ostream& operator<<(std::ostream& os, const Error& _error);
+
+/// A value with the error that came up while computing it, if any. value is NaN
+/// if nothing could be computed, but NaN may also be a regular result, e.g. of sqrt(-1).
+struct Result
+{
+    double value = std::numeric_limits<double>::quiet_NaN();
+    Error error = {};
+
+    bool ok() const {return !error;}
+};
+
+///==================
+/// Diagnostics
+///==================
+
+/// Receives every error when it is reported. May be called from several threads at once.
+using DiagnosticsSink = void (*)(const Error& _error);
+
+/// Installs a sink, or removes it with nullptr. Without a sink, which is the
+/// default, errors are only returned and nothing is printed.
+void set_diagnostics_sink(DiagnosticsSink _sink);
+
+/// A sink that prints errors to std::cerr
+void print_error(const Error& _error);
+
+/// Passes an error to the sink, if any, and returns it
+Error report(Error _error);
+
+/// Reports an error from within a function, e.g. for arguments it cannot handle,
+/// and returns NaN. The first such error of an evaluation is the error of
+/// CompiledExpression::try_evaluate().
+double function_error(ErrorCode _code, std::string_view _function);
+
+/// Returns and clears the first error reported by function_error() on this thread
+Error take_function_error();
+
+/// Number of errors reported by function_error() on this thread so far, to find
+/// out whether a call reported one without clearing the error of the evaluation
+size_t function_error_count();
+
+}
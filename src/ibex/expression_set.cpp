@@ -0,0 +1,309 @@
+#include <ibex/expression_set.hpp>
+#include <ibex/scratch.hpp>
+#include <ibex/profile.hpp>
+#include <cstdlib>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+// Checks a postfix program before anything is added to the graph, so a
+// malformed expression leaves the set untouched. Marks the tokens that are
+// targets of assignments. Nodes are evaluated eagerly, so conditionals and
+// && or || whose right operand has side effects are rejected.
+static bool validate(const std::vector<Token>& postfix, const Functions& funcs, std::vector<bool>& targets, Error* _error)
+{
+    auto fail = [&](ErrorCode code, std::string_view token = {}) {
+        const Error error = report(Error(code, token));
+        if (_error) {*_error = error;}
+        return false;
+    };
+
+    // Token index that produced each stack entry if it is a variable, -1 otherwise
+    std::vector<int> stack;
+    // Whether each stack entry assigns or calls an impure function
+    std::vector<bool> effects;
+    targets.assign(postfix.size(), false);
+    OpCode op;
+
+    // Replaces the top _n entries by one, which has the effects of all of them
+    auto reduce = [&](size_t _n, bool _effect) {
+        for (size_t k = 0; k < _n; ++k) {
+            _effect = _effect || effects.back();
+            effects.pop_back();
+        }
+        effects.push_back(_effect);
+    };
+
+    for (size_t i = 0; i < postfix.size(); ++i)
+    {
+        const Token& token = postfix[i];
+        switch (token.type)
+        {
+        case Token::Type::INT:
+        case Token::Type::FLOAT:
+            stack.push_back(-1);
+            effects.push_back(false);
+            break;
+        case Token::Type::IDENTIFIER:
+            if (funcs.contains(token.lexeme)) {
+                const int arity = funcs.at(token.lexeme).arity;
+                if (stack.size() < token.metadata || (arity >= 0 && token.metadata != static_cast<size_t>(arity))) {
+                    return fail(ErrorCode::WRONG_ARGUMENT_COUNT, token.lexeme);
+                }
+                stack.resize(stack.size() - token.metadata);
+                stack.push_back(-1);
+                reduce(token.metadata, !funcs.at(token.lexeme).pure);
+            } else if (token.metadata > 0) {
+                return fail(ErrorCode::UNKNOWN_FUNCTION, token.lexeme);
+            } else {
+                stack.push_back(i);
+                effects.push_back(false);
+            }
+            break;
+        case Token::Type::UNARY_PLUS:
+        case Token::Type::UNARY_MINUS:
+        case Token::Type::NOT:
+            if (stack.empty()) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            stack.back() = -1;
+            break;
+        case Token::Type::ASSIGN:
+            if (stack.size() < 2) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            stack.pop_back();
+            if (stack.back() < 0) {return fail(ErrorCode::NOT_ASSIGNABLE, token.lexeme);}
+            targets[stack.back()] = true;
+            stack.back() = -1;
+            reduce(2, true);
+            break;
+        case Token::Type::QUESTION:
+            // Nodes of the graph are evaluated eagerly, so there is nothing to skip
+            return fail(ErrorCode::UNSUPPORTED, token.lexeme);
+        default:
+            if (!binary_opcode(token.type, op)) {return fail(ErrorCode::UNEXPECTED_TOKEN, token.lexeme);}
+            if (stack.size() < 2) {return fail(ErrorCode::INSUFFICIENT_OPERANDS, token.lexeme);}
+            // The right operand would run even where the left one decides the result
+            if ((op == OpCode::LAND || op == OpCode::LOR) && effects.back()) {
+                return fail(ErrorCode::UNSUPPORTED, token.lexeme);
+            }
+            stack.pop_back();
+            stack.back() = -1;
+            reduce(2, false);
+            break;
+        }
+    }
+
+    if (stack.size() != 1) {return fail(ErrorCode::INVALID_EXPRESSION);}
+    return true;
+}
+
+///==================
+/// Expression Sets
+///==================
+
+ExpressionSet::ExpressionSet() : ExpressionSet(default_scope().functions()) {}
+
+ExpressionSet::ExpressionSet(const Functions& _funcs) : funcs_(_funcs) {}
+
+uint32_t ExpressionSet::intern(const Node& _node, bool _shareable)
+{
+    if (!_shareable) {
+        nodes_.push_back(_node);
+        return nodes_.size() - 1;
+    }
+
+    // The key holds the raw bytes of the node. The arguments of a call are
+    // part of the key instead of their position in callArgs_.
+    std::string key(reinterpret_cast<const char*>(&_node.op), sizeof(_node.op));
+    auto append = [&](const auto& v) {key.append(reinterpret_cast<const char*>(&v), sizeof(v));};
+    append(_node.arg);
+    append(_node.value);
+    if (_node.op == OpCode::CALL) {
+        for (uint32_t i = 0; i < _node.b; ++i) {append(callArgs_[_node.a + i]);}
+    } else {
+        append(_node.a);
+        append(_node.b);
+    }
+
+    auto [it, inserted] = index_.try_emplace(std::move(key), nodes_.size());
+    if (inserted) {
+        nodes_.push_back(_node);
+    } else {
+        ++shared_;
+        if (_node.op == OpCode::CALL) {callArgs_.resize(_node.a);}
+    }
+    return it->second;
+}
+
+int ExpressionSet::add(const std::vector<Token>& _postfix, Error* _error)
+{
+    std::vector<bool> targets;
+    if (!validate(_postfix, funcs_, targets, _error)) {return -1;}
+
+    // Stack of node ids. Assignment targets are pushed as their slot instead.
+    std::vector<uint32_t> stack;
+    OpCode op;
+
+    for (size_t i = 0; i < _postfix.size(); ++i)
+    {
+        const Token& token = _postfix[i];
+        switch (token.type)
+        {
+        case Token::Type::INT:
+        case Token::Type::FLOAT: {
+            Node node{.op = OpCode::CONST, .value = std::strtod(token.lexeme.c_str(), nullptr)};
+            stack.push_back(intern(node, true));
+            break;
+        }
+
+        case Token::Type::IDENTIFIER:
+        {
+            auto fit = funcs_.find(token.lexeme);
+            if (fit != funcs_.end()) {
+                size_t id = std::find(functionNames_.begin(), functionNames_.end(), token.lexeme) - functionNames_.begin();
+                if (id == functionNames_.size()) {
+                    functionNames_.push_back(token.lexeme);
+                    functions_.push_back(profiled(fit->first, fit->second.impl));
+                }
+                Node node{.op = OpCode::CALL, .arg = static_cast<uint32_t>(id),
+                          .a = static_cast<uint32_t>(callArgs_.size()), .b = static_cast<uint32_t>(token.metadata)};
+                callArgs_.insert(callArgs_.end(), stack.end() - token.metadata, stack.end());
+                stack.resize(stack.size() - token.metadata);
+                stack.push_back(intern(node, fit->second.pure));
+                break;
+            }
+
+            size_t slot = std::find(slots_.begin(), slots_.end(), token.lexeme) - slots_.begin();
+            if (slot == slots_.size()) {
+                slots_.push_back(token.lexeme);
+                versions_.push_back(0);
+                assigns_.push_back(false);
+            }
+            if (targets[i]) {
+                stack.push_back(slot);
+            } else {
+                // The version keeps reads before and after an assignment apart
+                Node node{.op = OpCode::LOAD, .arg = static_cast<uint32_t>(slot), .b = versions_[slot]};
+                stack.push_back(intern(node, true));
+            }
+            break;
+        }
+
+        case Token::Type::UNARY_PLUS:
+            break;
+
+        case Token::Type::UNARY_MINUS:
+        case Token::Type::NOT: {
+            Node node{.op = token.type == Token::Type::NOT ? OpCode::NOT : OpCode::NEG, .a = stack.back()};
+            stack.back() = intern(node, true);
+            break;
+        }
+
+        case Token::Type::ASSIGN: {
+            uint32_t value = stack.back(); stack.pop_back();
+            uint32_t slot = stack.back();
+            ++versions_[slot];
+            assigns_[slot] = true;
+            stack.back() = intern({.op = OpCode::STORE, .arg = slot, .a = value}, false);
+            break;
+        }
+
+        default: {
+            binary_opcode(token.type, op);
+            uint32_t rhs = stack.back(); stack.pop_back();
+            stack.back() = intern({.op = op, .a = stack.back(), .b = rhs}, true);
+            break;
+        }
+        }
+    }
+
+    outputs_.push_back(stack.back());
+    return outputs_.size() - 1;
+}
+
+int ExpressionSet::add(const char* _text, Error* _error)
+{
+    Scratch<std::vector<TokenView>> tokens;
+    Scratch<std::vector<TokenView>> views;
+    if (!tokenize(_text, *tokens, _error) || !generate_postfix(*tokens, *views, _error, _text)) {return -1;}
+
+    std::vector<Token> postfix;
+    postfix.reserve(views->size());
+    for (const TokenView& view : *views) {postfix.push_back({view.type, std::string(view.lexeme), view.metadata});}
+    return add(postfix, _error);
+}
+
+int ExpressionSet::slot(const std::string& _name) const
+{
+    auto it = std::find(slots_.begin(), slots_.end(), _name);
+    return it != slots_.end() ? static_cast<int>(it - slots_.begin()) : -1;
+}
+
+std::vector<double> ExpressionSet::bind(const Variables& _vars) const
+{
+    std::vector<double> values(slots_.size(), ERRD);
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        auto it = _vars.find(slots_[i]);
+        if (it != _vars.end()) {values[i] = it->second;}
+    }
+    return values;
+}
+
+void ExpressionSet::unbind(std::span<const double> _values, Variables& _vars) const
+{
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (assigns_[i]) {_vars[slots_[i]] = _values[i];}
+    }
+}
+
+void ExpressionSet::evaluate(std::span<double> _values, std::span<double> _out) const
+{
+    if (_values.size() < slots_.size() || _out.size() < outputs_.size()) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        std::fill(_out.begin(), _out.end(), ERRD);
+        return;
+    }
+
+    // One register per node, computed in the order the nodes were added
+    Scratch<std::vector<double>> registers;
+    Scratch<FunctionArgs> args;
+    registers->resize(nodes_.size());
+    double* r = registers->data();
+
+    for (size_t i = 0; i < nodes_.size(); ++i)
+    {
+        const Node& node = nodes_[i];
+        switch (node.op)
+        {
+        case OpCode::CONST: r[i] = node.value; break;
+        case OpCode::LOAD: r[i] = _values[node.arg]; break;
+        case OpCode::STORE: r[i] = _values[node.arg] = r[node.a]; break;
+        case OpCode::CALL:
+            args->resize(node.b);
+            for (uint32_t k = 0; k < node.b; ++k) {(*args)[k] = r[callArgs_[node.a + k]];}
+            r[i] = functions_[node.arg](*args);
+            break;
+        case OpCode::ADD: r[i] = r[node.a] + r[node.b]; break;
+        case OpCode::SUB: r[i] = r[node.a] - r[node.b]; break;
+        case OpCode::MUL: r[i] = r[node.a] * r[node.b]; break;
+        case OpCode::DIV: r[i] = r[node.a] / r[node.b]; break;
+        case OpCode::POW: r[i] = std::pow(r[node.a], r[node.b]); break;
+        case OpCode::EQ: r[i] = r[node.a] == r[node.b]; break;
+        case OpCode::NEQ: r[i] = r[node.a] != r[node.b]; break;
+        case OpCode::LESS: r[i] = r[node.a] < r[node.b]; break;
+        case OpCode::LEQ: r[i] = r[node.a] <= r[node.b]; break;
+        case OpCode::GREATER: r[i] = r[node.a] > r[node.b]; break;
+        case OpCode::GEQ: r[i] = r[node.a] >= r[node.b]; break;
+        case OpCode::LAND: r[i] = (r[node.a] != 0.0 && r[node.b] != 0.0); break;
+        case OpCode::LOR: r[i] = (r[node.a] != 0.0 || r[node.b] != 0.0); break;
+        case OpCode::NEG: r[i] = -r[node.a]; break;
+        case OpCode::NOT: r[i] = !r[node.a]; break;
+        default: r[i] = ERRD; break;
+        }
+    }
+
+    for (size_t i = 0; i < outputs_.size(); ++i) {_out[i] = r[outputs_[i]];}
+}
+
+}
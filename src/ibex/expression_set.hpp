@@ -0,0 +1,86 @@
+#pragma once
+
+#include <ibex/vm.hpp>
+#include <span>
+
+namespace ibex
+{
+
+///==================
+/// Expression Sets
+///==================
+
+/// A set of expressions over shared variables that is evaluated in one pass.
+/// All expressions are merged into one directed acyclic graph in which every
+/// distinct subexpression occurs once (hash-consing), so a subterm repeated
+/// across expressions, e.g. sqrt(x*x+y*y), is computed once per evaluation.
+/// Calls to impure functions and assignments are never shared. Reads of a
+/// variable after an assignment to it are distinct from reads before it, so
+/// evaluating the set gives the same results as evaluating the expressions
+/// one after another. Every node is evaluated, so conditionals and && or ||
+/// whose right operand assigns or calls an impure function are rejected as
+/// UNSUPPORTED.
+class ExpressionSet
+{
+public:
+    ExpressionSet();
+
+    explicit ExpressionSet(const Functions& _funcs);
+
+    /// Adds an expression and returns its output index, or -1 and sets _error if it is invalid.
+    int add(const std::vector<Token>& _postfix, Error* _error = nullptr);
+
+    int add(const char* _text, Error* _error = nullptr);
+
+    /// Number of expressions and thus outputs
+    size_t size() const {return outputs_.size();}
+
+    /// Names of the variables referenced by the expressions, in slot order.
+    const std::vector<std::string>& slots() const {return slots_;}
+
+    /// Slot index of a variable or -1 if no expression references it.
+    int slot(const std::string& _name) const;
+
+    /// Collects the current values of all slots from a variable map.
+    /// Variables missing from the map are set to NaN.
+    std::vector<double> bind(const Variables& _vars) const;
+
+    /// Writes the slots that the expressions assign to back into a variable map.
+    void unbind(std::span<const double> _values, Variables& _vars) const;
+
+    /// Evaluates all expressions. _values holds one entry per slot and receives
+    /// the results of assignments, _out receives one result per expression.
+    void evaluate(std::span<double> _values, std::span<double> _out) const;
+
+    /// Number of distinct nodes in the graph
+    size_t nodes() const {return nodes_.size();}
+
+    /// Number of nodes that were found in the graph instead of being added again
+    size_t shared() const {return shared_;}
+
+private:
+    struct Node
+    {
+        OpCode op = OpCode::CONST;
+        uint32_t arg = 0; // slot or function index
+        uint32_t a = 0; // first operand, or first entry in callArgs_ for CALL
+        uint32_t b = 0; // second operand, or number of arguments for CALL
+        double value = 0.0; // of a CONST
+    };
+
+    uint32_t intern(const Node& _node, bool _shareable);
+
+    const Functions funcs_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> callArgs_;
+    std::vector<uint32_t> outputs_;
+    std::vector<std::string> slots_;
+    std::vector<uint32_t> versions_; // number of assignments to each slot so far
+    std::vector<bool> assigns_;
+    std::vector<NativeImpl> functions_;
+    std::vector<std::string> functionNames_;
+    std::unordered_map<std::string, uint32_t> index_; // hash-consing table
+    size_t shared_ = 0;
+};
+
+}
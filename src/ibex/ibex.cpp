@@ -1,5 +1,13 @@
 #include <ibex/ibex.hpp>
-#include <variant>
+#include <ibex/compile.hpp>
+#include <ibex/profile.hpp>
+#include <ibex/scratch.hpp>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <limits>
+#include <numbers>
 
 namespace ibex
 {
@@ -8,8 +16,6 @@ namespace ibex
 /// Tokens
 ///==================
 
-static const Token UNKNOWN_TOKEN = Token{.type = Token::Type::UNKNOWN, .lexeme = ""};
-
 std::ostream& operator<<(std::ostream& os, const Token& token)
 {
     os << "Token("
@@ -19,136 +25,171 @@ std::ostream& operator<<(std::ostream& os, const Token& token)
     return os;
 }
 
-static bool is_binary_operator(const Token& token) {
-    return token.type == Token::Type::ASSIGN ||
-           token.type == Token::Type::PLUS ||
-           token.type == Token::Type::MINUS ||
-           token.type == Token::Type::TIMES ||
-           token.type == Token::Type::DIV ||
-           token.type == Token::Type::LAND ||
-           token.type == Token::Type::LOR ||
-           token.type == Token::Type::EQ ||
-           token.type == Token::Type::NEQ ||
-           token.type == Token::Type::LEQ ||
-           token.type == Token::Type::LESS ||
-           token.type == Token::Type::GEQ ||
-           token.type == Token::Type::GREATER ||
-           token.type == Token::Type::POW;
+std::ostream& operator<<(std::ostream& os, const TokenView& token)
+{
+    os << "TokenView("
+       << static_cast<int>(token.type)
+       << ", \"" << token.lexeme << "\", "
+       << token.value << ", "
+       << token.metadata  <<")";
+    return os;
 }
 
-static bool is_unary_operator(const Token& token) {
-    return token.type == Token::Type::NOT ||
-           token.type == Token::Type::UNARY_PLUS ||
-           token.type == Token::Type::UNARY_MINUS;
+// Character classes, looked up in a table instead of the locale dependent <cctype>
+enum CharClass : unsigned char {SPACE = 1, DIGIT = 2, ALPHA = 4};
+
+static constexpr std::array<unsigned char, 256> CHAR_CLASSES = []() {
+    std::array<unsigned char, 256> table{};
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) {table[static_cast<unsigned char>(c)] = SPACE;}
+    for (int c = '0'; c <= '9'; ++c) {table[c] = DIGIT;}
+    for (int c = 'a'; c <= 'z'; ++c) {table[c] = table[c - 'a' + 'A'] = ALPHA;}
+    table['_'] = ALPHA;
+    return table;
+}();
+
+static inline bool is_class(char c, unsigned char classes) {
+    return CHAR_CLASSES[static_cast<unsigned char>(c)] & classes;
 }
 
-std::vector<Token> tokenize(const char* text)
+bool tokenize(std::string_view _text, std::vector<TokenView>& _tokens, Error* _error)
 {
-    std::vector<Token> tokens;
-    const char* p = text;
-    bool unary = false;
+    ProfileScope profile(Stage::TOKENIZE);
+    _tokens.clear();
+    const char* p = _text.data();
+    const char* end = p + _text.size();
+    auto peek = [&](const char* q) {return q < end ? *q : '\0';};
 
-    while (*p)
+    while (p < end)
     {
         // Skip Whitespace between Tokens
-        if (std::isspace(*p))
+        if (is_class(*p, SPACE))
         {
             ++p;
             continue;
         }
 
         // Numbers (Integers or Decimals)
-        if (std::isdigit(*p))
+        if (is_class(*p, DIGIT))
         {
             const char* start = p;
-            while (std::isdigit(*p)) {++p;}
+            while (is_class(peek(p), DIGIT)) {++p;}
 
             // Dot (.) indicates Decimal
             Token::Type type = Token::Type::INT;
-            if (*p == '.') {
+            if (peek(p) == '.') {
                 ++p;
-                while (std::isdigit(*p)) {++p;}
+                while (is_class(peek(p), DIGIT)) {++p;}
                 type = Token::Type::FLOAT;
             }
 
             // 'e' indicates scientific notation
-            if (*p == 'e') {
+            if (peek(p) == 'e') {
                 type = Token::Type::FLOAT;
                 ++p;
-                if (*p == '-') {++p;}
-                if (!std::isdigit(*p)) {
-                    std::cerr << "Exponent has no digits!" << std::endl;
-                    return {};
+                if (peek(p) == '-') {++p;}
+                if (!is_class(peek(p), DIGIT)) {
+                    const Error error = report(Error(ErrorCode::MALFORMED_NUMBER, std::string_view(start, p - start), _text));
+                    if (_error) {*_error = error;}
+                    profile.fail();
+                    _tokens.clear();
+                    return false;
                 }
-                while (std::isdigit(*p)) {++p;}
+                while (is_class(peek(p), DIGIT)) {++p;}
             }
 
-            tokens.push_back({type, std::string(start, p)});
-
+            // Integers are parsed as doubles as well, so large ones cannot overflow
+            TokenView token{type, std::string_view(start, p - start)};
+            if (std::from_chars(start, p, token.value).ec == std::errc::result_out_of_range) {
+                // Out of range literals become inf or 0 like with strtod
+                Scratch<std::string> buffer;
+                buffer->assign(start, p);
+                token.value = std::strtod(buffer->c_str(), nullptr);
+            }
+            _tokens.push_back(token);
             continue;
         }
 
         // Identifiers
-        if (std::isalpha(*p) || *p == '_')
+        if (is_class(*p, ALPHA))
         {
             const char* start = p;
-            while (std::isalnum(*p) || *p == '_') ++p;
-            tokens.push_back({Token::Type::IDENTIFIER, std::string(start, p)});
+            while (is_class(peek(p), ALPHA | DIGIT)) {++p;}
+            _tokens.push_back({Token::Type::IDENTIFIER, std::string_view(start, p - start)});
             continue;
         }
 
         // Tokens
+        const char* start = p;
+        Token::Type type = Token::Type::UNKNOWN;
         switch (*p)
         {
         // Single symbols
-        case ',': tokens.push_back({Token::Type::COMMA, ","}); break;
-        case '(': tokens.push_back({Token::Type::LPAREN, "("}); break;
-        case ')': tokens.push_back({Token::Type::RPAREN, ")"}); break;
-        case '*': tokens.push_back({Token::Type::TIMES, "*"}); break;
-        case '/': tokens.push_back({Token::Type::DIV, "/"}); break;
-        case '^': tokens.push_back({Token::Type::POW, "^"}); break;
+        case ',': type = Token::Type::COMMA; break;
+        case '(': type = Token::Type::LPAREN; break;
+        case ')': type = Token::Type::RPAREN; break;
+        case '*': type = Token::Type::TIMES; break;
+        case '/': type = Token::Type::DIV; break;
+        case '^': type = Token::Type::POW; break;
+        case '?': type = Token::Type::QUESTION; break;
+        case ':': type = Token::Type::COLON; break;
 
         // Can be unary or binary
         case '+':
-        case '-':
+        case '-': {
             // Check if we have a unary operator (after an operator)
-            if (!tokens.empty()) {
-                const auto& prev = tokens.back();
-                unary = prev.type == Token::Type::LPAREN ||
-                        prev.type == Token::Type::COMMA ||
+            bool unary = true; // first token is unary
+            if (!_tokens.empty()) {
+                Token::Type prev = _tokens.back().type;
+                unary = prev == Token::Type::LPAREN || prev == Token::Type::COMMA ||
                         is_unary_operator(prev) || is_binary_operator(prev);
-            } else {unary = true;} // first token is unary
-            if (*p == '+') {tokens.push_back({unary? Token::Type::UNARY_PLUS : Token::Type::PLUS, "+"}); break;}
-            if (*p == '-') {tokens.push_back({unary? Token::Type::UNARY_MINUS : Token::Type::MINUS, "-"}); break;}
-
+            }
+            if (*p == '+') {type = unary ? Token::Type::UNARY_PLUS : Token::Type::PLUS;}
+            else {type = unary ? Token::Type::UNARY_MINUS : Token::Type::MINUS;}
+            break;
+        }
 
         // Tokens consisting of more than one symbol
         case '!':
-            if (*(p+1)=='=') {++p; tokens.push_back({Token::Type::NEQ, "!="});}
-            else {tokens.push_back({Token::Type::NOT, "!"});}
+            if (peek(p+1) == '=') {++p; type = Token::Type::NEQ;}
+            else {type = Token::Type::NOT;}
             break;
         case '<':
-            if (*(p+1)=='=') {++p; tokens.push_back({Token::Type::LEQ, "<="});}
-            else {tokens.push_back({Token::Type::LESS, "<"});}
+            if (peek(p+1) == '=') {++p; type = Token::Type::LEQ;}
+            else {type = Token::Type::LESS;}
             break;
         case '>':
-            if (*(p+1)=='=') {++p; tokens.push_back({Token::Type::GEQ, ">="});}
-            else {tokens.push_back({Token::Type::GREATER, ">"});}
+            if (peek(p+1) == '=') {++p; type = Token::Type::GEQ;}
+            else {type = Token::Type::GREATER;}
             break;
         case '=':
-            if (*(p+1)=='=') {++p; tokens.push_back({Token::Type::EQ, "=="}); break;}
-            else {tokens.push_back({Token::Type::ASSIGN, "="}); break;}
+            if (peek(p+1) == '=') {++p; type = Token::Type::EQ;}
+            else {type = Token::Type::ASSIGN;}
+            break;
         case '|':
-            if (*(p+1)=='|') {++p; tokens.push_back({Token::Type::LOR, "||"}); break;}
+            if (peek(p+1) == '|') {++p; type = Token::Type::LOR;}
+            break;
         case '&':
-            if (*(p+1)=='&') {++p; tokens.push_back({Token::Type::LAND, "&&"}); break;}
-        default: tokens.push_back({Token::Type::UNKNOWN, std::string(1, *p)}); break;
+            if (peek(p+1) == '&') {++p; type = Token::Type::LAND;}
+            break;
+        default: break;
         }
 
         // Advance Character
         ++p;
+        _tokens.push_back({type, std::string_view(start, p - start)});
     }
 
+    return true;
+}
+
+std::vector<Token> tokenize(const char* text)
+{
+    Scratch<std::vector<TokenView>> views;
+    if (!tokenize(text, *views)) {return {};}
+
+    std::vector<Token> tokens;
+    tokens.reserve(views->size());
+    for (const TokenView& view : *views) {tokens.push_back({view.type, std::string(view.lexeme)});}
     return tokens;
 }
 
@@ -158,124 +199,140 @@ std::vector<Token> tokenize(const char* text)
 
 static double ERRD = std::numeric_limits<double>::quiet_NaN();
 
-Variables common_variables()
+template<typename T>
+BasicVariables<T> common_variables()
 {
-    Variables vars;
-    vars["pi"] = M_PI;
-    vars["e"] = M_E;
+    BasicVariables<T> vars;
+    vars["pi"] = std::numbers::pi_v<T>;
+    vars["e"] = std::numbers::e_v<T>;
     return vars;
 }
 
-Functions common_functions()
+// A pure function of one argument and its derivative
+template<typename T, typename F, typename D>
+static BasicFunction<T> unary(F&& f, D&& d)
 {
-    Functions funcs;
-
-    funcs["abs"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "abs expects 1 argument" << std::endl; return ERRD;}
-        return std::abs(args[0]);
-    };
-
-    funcs["sin"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "sin expects 1 argument" << std::endl; return ERRD;}
-        return std::sin(args[0]);
-    };
-
-    funcs["cos"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "cos expects 1 argument" << std::endl; return ERRD;}
-        return std::cos(args[0]);
-    };
-
-    funcs["tan"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "tan expects 1 argument" << std::endl; return ERRD;}
-        return std::tan(args[0]);
-    };
+    return differentiable<T>(pure<T>(std::forward<F>(f)), [d](BasicFunctionArgsView<T> args, std::span<T> partials) {
+        partials[0] = d(args[0]);
+    });
+}
 
-    funcs["exp"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "exp expects 1 argument" << std::endl; return ERRD;}
-        return std::exp(args[0]);
+// Derivatives of max and min: the first argument that is the result gets all of it
+template<typename T>
+static BasicDerivativeImpl<T> select_first(const BasicNativeImpl<T>& f)
+{
+    return [f](BasicFunctionArgsView<T> args, std::span<T> partials) {
+        std::fill(partials.begin(), partials.end(), T(0));
+        auto it = std::find(args.begin(), args.end(), f(args));
+        if (it != args.end()) {partials[it - args.begin()] = 1;}
     };
+}
 
-    funcs["log"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "log expects 1 argument" << std::endl; return ERRD;}
-        return std::log(args[0]);
-    };
+template<typename T>
+BasicFunctions<T> common_functions()
+{
+    BasicFunctions<T> funcs;
+
+    // Fixed arities are checked when an expression is compiled
+    funcs["abs"] = unary<T>([](T x) {return std::abs(x);}, [](T x) {return T((x > 0) - (x < 0));});
+    funcs["sin"] = unary<T>([](T x) {return std::sin(x);}, [](T x) {return std::cos(x);});
+    funcs["cos"] = unary<T>([](T x) {return std::cos(x);}, [](T x) {return -std::sin(x);});
+    funcs["tan"] = unary<T>([](T x) {return std::tan(x);}, [](T x) {return 1 / (std::cos(x) * std::cos(x));});
+    funcs["exp"] = unary<T>([](T x) {return std::exp(x);}, [](T x) {return std::exp(x);});
+    funcs["log"] = unary<T>([](T x) {return std::log(x);}, [](T x) {return 1 / x;});
     funcs["ln"] = funcs["log"];
-
-    funcs["log2"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "log2 expects 1 argument" << std::endl; return ERRD;}
-        return std::log2(args[0]);
-    };
-
-    funcs["sqrt"] = [](const FunctionArgs& args) {
-        if (args.size() != 1) {std::cerr << "sqrt expects 1 argument" << std::endl; return ERRD;}
-        return std::sqrt(args[0]);
-    };
-
-    funcs["max"] = [](const FunctionArgs& args) {
-        if (args.size() == 0) {std::cerr << "max expects at least 1 argument" << std::endl; return ERRD;}
-        double max = -std::numeric_limits<double>::infinity();
+    funcs["log2"] = unary<T>([](T x) {return std::log2(x);}, [](T x) {return 1 / (x * std::numbers::ln2_v<T>);});
+    funcs["sqrt"] = unary<T>([](T x) {return std::sqrt(x);}, [](T x) {return T(0.5) / std::sqrt(x);});
+    funcs["pow"] = differentiable<T>(pure<T>([](T x, T y) {return std::pow(x, y);}),
+        [](BasicFunctionArgsView<T> args, std::span<T> partials) {
+            const T x = args[0], y = args[1];
+            partials[0] = (y == 0) ? T(0) : y * std::pow(x, y - 1);
+            partials[1] = (x > 0) ? std::pow(x, y) * std::log(x) : T(0);
+        });
+
+    funcs["max"] = pure<T>([](BasicFunctionArgsView<T> args) {
+        if (args.size() == 0) {return static_cast<T>(function_error(ErrorCode::WRONG_ARGUMENT_COUNT, "max"));}
+        T max = -std::numeric_limits<T>::infinity();
         for (const auto& arg : args) {if (arg > max) {max = arg;}}
         return max;
-    };
+    });
+    funcs["max"].derivative = select_first(funcs["max"].impl);
 
-    funcs["min"] = [](const FunctionArgs& args) {
-        if (args.size() == 0) {std::cerr << "min expects at least 1 argument" << std::endl; return ERRD;}
-        double min = std::numeric_limits<double>::infinity();
+    funcs["min"] = pure<T>([](BasicFunctionArgsView<T> args) {
+        if (args.size() == 0) {return static_cast<T>(function_error(ErrorCode::WRONG_ARGUMENT_COUNT, "min"));}
+        T min = std::numeric_limits<T>::infinity();
         for (const auto& arg : args) {if (arg < min) {min = arg;}}
         return min;
-    };
-
-    funcs["pow"] = [](const FunctionArgs& args) {
-        if (args.size() != 2) {std::cerr << "pow expects 2 arguments" << std::endl; return ERRD;}
-        return std::pow(args[0], args[1]);
-    };
+    });
+    funcs["min"].derivative = select_first(funcs["min"].impl);
 
     return funcs;
 }
 
+template BasicVariables<float> common_variables();
+template BasicVariables<double> common_variables();
+template BasicVariables<long double> common_variables();
+template BasicFunctions<float> common_functions();
+template BasicFunctions<double> common_functions();
+template BasicFunctions<long double> common_functions();
+
 ///==================
-/// Postfix
+/// Scopes
 ///==================
 
-struct OpInfo {
-    int precedence = -1;
-    bool right_associative = false;
-};
-
-static std::unordered_map<Token::Type, OpInfo> opTable = {
-    {Token::Type::UNARY_PLUS, {7, true}}, {Token::Type::UNARY_MINUS, {7, true}},
-    {Token::Type::PLUS, {4, false}}, {Token::Type::MINUS, {4, false}},
-    {Token::Type::TIMES, {5, false}}, {Token::Type::DIV, {5, false}},
-    {Token::Type::POW, {8, true}},
-    {Token::Type::LAND, {2, false}}, {Token::Type::LOR, {1, false}},
-    {Token::Type::NOT, {7, true}},
-    {Token::Type::EQ, {3, false}}, {Token::Type::NEQ, {3, false}}, {Token::Type::LESS, {3, false}},
-    {Token::Type::GREATER, {3, false}}, {Token::Type::LEQ, {3, false}}, {Token::Type::GEQ, {3, false}},
-    {Token::Type::ASSIGN, {0, true}}
-};
-
-static int precedence(Token::Type type) {
-    auto it = opTable.find(type);
-    return it != opTable.end() ? it->second.precedence : -1;
-};
-
-static bool is_right_associative(Token::Type type) {
-    auto it = opTable.find(type);
-    return it != opTable.end() && it->second.right_associative;
-};
+const double* Scope::find_variable(const std::string& _name) const
+{
+    for (const Scope* scope = this; scope; scope = scope->parent_) {
+        auto it = scope->vars_.find(_name);
+        if (it != scope->vars_.end()) {return &it->second;}
+    }
+    return nullptr;
+}
 
-std::vector<Token> generate_postfix(const std::vector<Token>& tokens)
+const Function* Scope::find_function(const std::string& _name) const
 {
-    // rpn stores a std::vector<Token> tokens or whatever else is required by an evaluator
-    std::vector<Token> output;
-    std::vector<Token> opStack;
-    std::vector<uint> nargStack;
+    for (const Scope* scope = this; scope; scope = scope->parent_) {
+        auto it = scope->funcs_.find(_name);
+        if (it != scope->funcs_.end()) {return &it->second;}
+    }
+    return nullptr;
+}
+
+const Scope& default_scope()
+{
+    // Initialized once even if several threads get here first
+    static const Scope scope(common_variables(), common_functions());
+    return scope;
+}
+
+///==================
+/// Postfix
+///==================
+
+// Shunting-yard for both kinds of tokens. The buffers are passed in so the
+// caller decides whether they are reused.
+template<typename T>
+static bool generate_postfix(const std::vector<T>& tokens, std::vector<T>& output,
+                             std::vector<T>& opStack, std::vector<uint>& nargStack,
+                             Error* _error, std::string_view _source)
+{
+    ProfileScope profile(Stage::POSTFIX);
+    auto fail = [&](ErrorCode code, std::string_view token) {
+        const Error error = report(Error(code, token, _source));
+        if (_error) {*_error = error;}
+        profile.fail();
+        output.clear();
+        return false;
+    };
+    output.clear();
+    opStack.clear();
+    nargStack.clear();
 
     for (size_t i = 0; i < tokens.size(); ++i)
     {
-#define NEXTTOKEN ((i+1 < tokens.size())? tokens[i+1] : UNKNOWN_TOKEN)
+#define NEXTTYPE ((i+1 < tokens.size())? tokens[i+1].type : Token::Type::UNKNOWN)
 
-        const Token& token = tokens[i];
+        const T& token = tokens[i];
         switch (token.type)
         {
         case Token::Type::INT:
@@ -284,7 +341,7 @@ std::vector<Token> generate_postfix(const std::vector<Token>& tokens)
             break;
 
         case Token::Type::IDENTIFIER:
-            if (NEXTTOKEN.type == Token::Type::LPAREN) {
+            if (NEXTTYPE == Token::Type::LPAREN) {
                 opStack.push_back(token); // Function Name
             } else {
                 output.push_back(token); // Variable
@@ -308,7 +365,7 @@ std::vector<Token> generate_postfix(const std::vector<Token>& tokens)
                 opStack[opStack.size() - 2].type == Token::Type::IDENTIFIER) {
 
                 // Start counting args
-                if (NEXTTOKEN.type == Token::Type::RPAREN) {nargStack.push_back(0);} // function has no args
+                if (NEXTTYPE == Token::Type::RPAREN) {nargStack.push_back(0);} // function has no args
                 else {nargStack.push_back(1);}
 
             }
@@ -320,27 +377,42 @@ std::vector<Token> generate_postfix(const std::vector<Token>& tokens)
                 output.push_back(opStack.back());
                 opStack.pop_back();
             }
-            if (opStack.empty()) {
-                std::cerr << "Mismatched parentheses" << std::endl;
-                return {};
-            }
+            if (opStack.empty()) {return fail(ErrorCode::MISMATCHED_PARENTHESES, token.lexeme);}
             opStack.pop_back(); // Pop the LPAREN
 
             // If function name is next on stack, pop it to output
             if (!opStack.empty() && opStack.back().type == Token::Type::IDENTIFIER) {
-                Token func = opStack.back();
+                T func = opStack.back();
                 opStack.pop_back();
                 func.metadata = nargStack.back(); // Attach number of args to token
+                // if(c, a, b) is the same conditional as c ? a : b
+                if (func.lexeme == "if" && func.metadata == 3) {func.type = Token::Type::QUESTION;}
                 output.push_back(func);
                 nargStack.pop_back();
             }
             break;
 
+        case Token::Type::COLON:
+            // Pop the then-branch until its ?, which then stands for the whole conditional
+            while (!opStack.empty() && opStack.back().type != Token::Type::LPAREN &&
+                   !(opStack.back().type == Token::Type::QUESTION && opStack.back().metadata == 0)) {
+                output.push_back(opStack.back());
+                opStack.pop_back();
+            }
+            if (opStack.empty() || opStack.back().type != Token::Type::QUESTION) {
+                return fail(ErrorCode::UNEXPECTED_COLON, token.lexeme);
+            }
+            opStack.back().metadata = 3;
+            break;
+
         default:
-            if (opTable.find(token.type) != opTable.end()) {
-                while (!opStack.empty()) {
-                    const Token& top = opStack.back();
-                    if (opTable.find(top.type) == opTable.end()) break;
+            if (precedence(token.type) >= 0) {
+                // Prefix operators have no left operand, so nothing is popped for them
+                while (!opStack.empty() && !is_unary_operator(token.type)) {
+                    const T& top = opStack.back();
+                    if (precedence(top.type) < 0) break;
+                    // A ? without its : yet encloses the then-branch like a parenthesis
+                    if (top.type == Token::Type::QUESTION && top.metadata == 0) break;
 
                     int prec1 = precedence(token.type);
                     int prec2 = precedence(top.type);
@@ -355,8 +427,7 @@ std::vector<Token> generate_postfix(const std::vector<Token>& tokens)
                 }
                 opStack.push_back(token);
             } else {
-                std::cerr << "Unexpected token: " << token.lexeme << std::endl;
-                return {};
+                return fail(ErrorCode::UNEXPECTED_TOKEN, token.lexeme);
             }
             break;
         }
@@ -365,193 +436,104 @@ std::vector<Token> generate_postfix(const std::vector<Token>& tokens)
     // Pop remaining operators
     while (!opStack.empty()) {
         if (opStack.back().type == Token::Type::LPAREN || opStack.back().type == Token::Type::RPAREN) {
-            std::cerr << "Mismatched parentheses in expression." << std::endl;
-            return {};
+            return fail(ErrorCode::MISMATCHED_PARENTHESES, opStack.back().lexeme);
         }
         output.push_back(opStack.back());
         opStack.pop_back();
     }
 
+#undef NEXTTYPE
+    return true;
+}
+
+std::vector<Token> generate_postfix(const std::vector<Token>& tokens)
+{
+    // rpn stores a std::vector<Token> tokens or whatever else is required by an evaluator
+    std::vector<Token> output;
+    std::vector<Token> opStack;
+    std::vector<uint> nargStack;
+    generate_postfix(tokens, output, opStack, nargStack, nullptr, {});
     return output;
 }
 
+bool generate_postfix(const std::vector<TokenView>& _tokens, std::vector<TokenView>& _postfix,
+                      Error* _error, std::string_view _source)
+{
+    Scratch<std::vector<TokenView>> opStack;
+    Scratch<std::vector<uint>> nargStack;
+    return generate_postfix(_tokens, _postfix, *opStack, *nargStack, _error, _source);
+}
+
 ///==================
 /// Evaluation
 ///==================
 
-template<typename ... Ts>
-struct Overload : Ts ... {using Ts::operator() ...;};
-template<class... Ts> Overload(Ts...) -> Overload<Ts...>;
-
 double eval_postfix(const std::vector<Token>& postfix, Variables &vars, Functions &funcs)
 {
-    using Atom = std::variant<double,int,std::string>;
-    std::vector<Atom> stack;
-    auto atom_to_d = [&](const Atom& _atom) -> double {
-        const auto visitor = Overload{
-            [](const double d){return d;},
-            [](const int i){return static_cast<double>(i);},
-            [&](const std::string& s){
-                if (!vars.contains(s)) {
-                    std::cerr << "Unknown variable: " << s << std::endl;
-                    return ERRD;
-                }
-                return vars.at(s);
-            }
-        };
-        return std::visit(visitor, _atom);
-    };
-
-    size_t n_tokens = postfix.size();
-    for (unsigned int token_i = 0; token_i < n_tokens; ++token_i)
-    {
-        const Token& token = postfix[token_i];
-
-        switch (token.type)
-        {
-        case Token::Type::INT: {
-            stack.push_back(std::stoi(token.lexeme));
-            break;
-        }
-        case Token::Type::FLOAT: {
-            stack.push_back(std::stod(token.lexeme));
-            break;
-        }
-
-        case Token::Type::IDENTIFIER:
-        {
-            // Check if it's a function
-            auto fit = funcs.find(token.lexeme);
-            if (fit != funcs.end()) {
-                // The number of arguments is stored in the token metadata
-                std::vector<double> args;
-                for (uint narg = 0; narg < token.metadata; ++narg) {
-                    args.push_back(atom_to_d(stack.back()));
-                    stack.pop_back();
-                }
-                // Reverse args since it's in postfix notation
-                std::reverse(args.begin(), args.end());
-                double result = fit->second(args);
-                stack.push_back(result);
-                break;
-            }
-
-            // Treat it as a variable
-            stack.push_back(token.lexeme);
-            break;
-        }
-
-        case Token::Type::PLUS:
-        case Token::Type::MINUS:
-        case Token::Type::TIMES:
-        case Token::Type::DIV:
-        case Token::Type::POW:
-        case Token::Type::EQ:
-        case Token::Type::NEQ:
-        case Token::Type::LESS:
-        case Token::Type::LEQ:
-        case Token::Type::GREATER:
-        case Token::Type::GEQ:
-        case Token::Type::LAND:
-        case Token::Type::LOR:
-        {
-            if (stack.size() < 2) {
-                std::cerr << "Insufficient operands for binary operator " << token.lexeme << std::endl;
-                return ERRD;
-            }
-
-            double rhs = atom_to_d(stack.back()); stack.pop_back();
-            double lhs = atom_to_d(stack.back()); stack.pop_back();
-            double result;
-
-            switch (token.type) {
-            case Token::Type::PLUS: result = lhs + rhs; break;
-            case Token::Type::MINUS: result = lhs - rhs; break;
-            case Token::Type::TIMES: result = lhs * rhs; break;
-            case Token::Type::DIV: result = lhs / rhs; break;
-            case Token::Type::POW: result = std::pow(lhs, rhs); break;
-            case Token::Type::EQ: result = lhs == rhs; break;
-            case Token::Type::NEQ: result = lhs != rhs; break;
-            case Token::Type::LESS: result = lhs < rhs; break;
-            case Token::Type::LEQ: result = lhs <= rhs; break;
-            case Token::Type::GREATER: result = lhs > rhs; break;
-            case Token::Type::GEQ: result = lhs >= rhs; break;
-            case Token::Type::LAND: result = (lhs != 0.0 && rhs != 0.0); break;
-            case Token::Type::LOR:  result = (lhs != 0.0 || rhs != 0.0); break;
-            default:
-                std::cerr << "Unhandled binary operator " << token.lexeme << std::endl;
-                return ERRD;
-            }
-
-            stack.push_back(result);
-            break;
-        }
+    // Compile into reused buffers, so evaluating through the map based API
+    // does not pay for fresh allocations on every call
+    Scratch<CompiledExpression> expr;
+    if (!compile(postfix, funcs, *expr)) {return ERRD;}
+    return expr->evaluate(vars);
+}
 
-        case Token::Type::UNARY_PLUS:
-        case Token::Type::UNARY_MINUS:
-        case Token::Type::NOT: {
-            if (stack.empty()) {
-                std::cerr << "Insufficient operands for unary operator " << token.lexeme << std::endl;
-                return ERRD;
-            }
-            double val = atom_to_d(stack.back());
-            stack.pop_back();
-            double result;
-
-            switch (token.type) {
-            case Token::Type::UNARY_PLUS: result = val; break;
-            case Token::Type::UNARY_MINUS: result = -val; break;
-            case Token::Type::NOT: result = !val; break;
-            default: std::cerr << "Unhandled unary operator " << token.lexeme << std::endl; return 0.0;
-            }
+double eval_postfix(const std::vector<Token>& _postfix, Scope& _scope)
+{
+    Scratch<CompiledExpression> expr;
+    if (!compile(_postfix, _scope, *expr)) {return ERRD;}
+    return expr->evaluate(_scope);
+}
 
-            stack.push_back(result);
-            break;
-        }
+double eval_postfix(const std::vector<Token>& _postfix)
+{
+    Scope scope(&default_scope());
+    return eval_postfix(_postfix, scope);
+}
 
-        case Token::Type::ASSIGN: {
-            double rhs = atom_to_d(stack.back()); stack.pop_back();
-            if (!std::holds_alternative<std::string>(stack.back())) {
-                std::cerr << "Expression is not assignable" << std::endl;
-                return ERRD;
-            }
-            std::string lhs = std::get<std::string>(stack.back()); stack.pop_back();
-            vars[lhs] = rhs;
-            stack.push_back(rhs);
-            break;
-        }
+double eval(const char* _text, Variables& _vars, Functions& _funcs)
+{
+    Scratch<CompiledExpression> expr;
+    if (!compile(_text, _funcs, *expr)) {return ERRD;}
+    return expr->evaluate(_vars);
+}
 
-        default:
-            std::cerr << "Unexpected token in postfix notation: " << token.lexeme << std::endl;
-            return ERRD;
-        }
-    }
+template<typename T>
+T eval(const char* _text, BasicVariables<T>& _vars, const BasicFunctions<T>& _funcs)
+{
+    Scratch<BasicExpression<T>> expr;
+    if (!compile(_text, _funcs, *expr)) {return std::numeric_limits<T>::quiet_NaN();}
+    return expr->evaluate(_vars);
+}
 
-    if (stack.size() != 1) {
-        std::cerr << "Invalid postfix expression: stack size != 1" << std::endl;
-        return ERRD;
-    }
+template float eval(const char*, BasicVariables<float>&, const BasicFunctions<float>&);
+template double eval(const char*, BasicVariables<double>&, const BasicFunctions<double>&);
+template long double eval(const char*, BasicVariables<long double>&, const BasicFunctions<long double>&);
 
-    return atom_to_d(stack.back());
+double eval(const char* _text, Scope& _scope)
+{
+    Scratch<CompiledExpression> expr;
+    if (!compile(_text, _scope, *expr)) {return ERRD;}
+    return expr->evaluate(_scope);
 }
 
-double eval_postfix(const std::vector<Token>& _postfix)
+double eval(const char* _text)
 {
-    Variables vars = common_variables();
-    Functions funcs = common_functions();
-    return eval_postfix(_postfix, vars, funcs);
+    Scope scope(&default_scope());
+    return eval(_text, scope);
 }
 
-double eval(const char* _text, Variables& _vars, Functions& _funcs)
+Result try_eval(std::string_view _text, Variables& _vars, Functions& _funcs)
 {
-    return eval_postfix(generate_postfix(tokenize(_text)), _vars, _funcs);
+    Scratch<CompiledExpression> expr;
+    if (!compile(_text, _funcs, *expr)) {return {.error = expr->error()};}
+    return expr->try_evaluate(_vars);
 }
 
-double eval(const char* _text)
+Result try_eval(std::string_view _text, Scope& _scope)
 {
-    Variables vars = common_variables();
-    Functions funcs = common_functions();
-    return eval(_text, vars, funcs);
+    Scratch<CompiledExpression> expr;
+    if (!compile(_text, _scope, *expr)) {return {.error = expr->error()};}
+    return expr->try_evaluate(_scope);
 }
 
 }
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <ibex/error.hpp>
+#include <ibex/scratch.hpp>
 #include <iostream>
 #include <vector>
 #include <unordered_map>
 #include <string>
+#include <string_view>
 #include <functional>
+#include <cmath>
+#include <type_traits>
+#include <span>
+#include <utility>
 
 namespace ibex
 {
@@ -24,7 +31,8 @@ struct Token
         PLUS, MINUS, TIMES, DIV, POW,
         UNARY_PLUS, UNARY_MINUS,
         LOR, LAND, NOT,
-        EQ, NEQ, LEQ, GEQ, LESS, GREATER
+        EQ, NEQ, LEQ, GEQ, LESS, GREATER,
+        QUESTION, COLON // c ? a : b, in postfix a QUESTION with metadata 3 stands for the whole conditional
     };
 
     Token::Type type = Type::UNKNOWN;
@@ -36,37 +44,305 @@ struct Token
     }
 };
 
+/// A token that refers to its text in the source instead of owning a copy.
+/// Literals carry their value, parsed once by the tokenizer.
+struct TokenView
+{
+    Token::Type type = Token::Type::UNKNOWN;
+    std::string_view lexeme;
+    double value = 0.0; // of INT and FLOAT tokens
+    u_int64_t metadata = 0;
+
+    bool operator==(const TokenView& t) const = default;
+};
+
 std::ostream& operator<<(std::ostream& os, const Token& token);
 
+std::ostream& operator<<(std::ostream& os, const TokenView& token);
+
 std::vector<Token> tokenize(const char* text);
 
+/// Tokenizes into a reused buffer, so no memory is allocated once the buffer
+/// has grown large enough. Lexemes point into _text, which has to outlive the tokens.
+/// Returns false, leaves _tokens empty and sets _error if a number is malformed.
+bool tokenize(std::string_view _text, std::vector<TokenView>& _tokens, Error* _error = nullptr);
+
 ///==================
 /// Functions
 ///==================
-using Variables = std::unordered_map<std::string, double>;
-using FunctionArgs = std::vector<double>;
-using FunctionImpl = std::function<double(const FunctionArgs&)>;
-using Functions = std::unordered_map<std::string, FunctionImpl>;
 
-Variables common_variables();
-Functions common_functions();
+/// Variables and functions are templates on the scalar type T, which is float,
+/// double or long double. The names without Basic are those of double, which the
+/// rest of the library uses.
+template<typename T> using BasicVariables = std::unordered_map<std::string, T>;
+template<typename T> using BasicFunctionArgs = std::vector<T>;
+template<typename T> using BasicFunctionImpl = std::function<T(const BasicFunctionArgs<T>&)>;
+
+/// Arguments of a call, a view of the evaluation stack
+template<typename T> using BasicFunctionArgsView = std::span<const T>;
+
+/// Calling convention of the evaluators. Calls pass their arguments in place.
+template<typename T> using BasicNativeImpl = std::function<T(BasicFunctionArgsView<T>)>;
+
+/// Partial derivatives of a function for automatic differentiation. Receives the
+/// arguments of a call and writes the derivative with respect to each of them.
+template<typename T> using BasicDerivativeImpl = std::function<void(BasicFunctionArgsView<T>, std::span<T>)>;
+
+using Variables = BasicVariables<double>;
+using FunctionArgs = BasicFunctionArgs<double>;
+using FunctionImpl = BasicFunctionImpl<double>;
+using FunctionArgsView = BasicFunctionArgsView<double>;
+using NativeImpl = BasicNativeImpl<double>;
+using DerivativeImpl = BasicDerivativeImpl<double>;
+
+template<typename F, typename T = double>
+concept NativeCallable = std::is_invocable_r_v<T, F, BasicFunctionArgsView<T>>;
+
+template<typename F, typename T = double>
+concept VectorCallable = !NativeCallable<F, T> && std::is_invocable_r_v<T, F, const BasicFunctionArgs<T>&>;
+
+/// Callables with a deducible signature, i.e. function pointers and lambdas that are not generic
+template<typename F, typename T = double>
+concept FixedCallable = !NativeCallable<F, T> && !VectorCallable<F, T> &&
+                        requires {std::function{std::declval<std::decay_t<F>>()};};
+
+/// A registered function. Callables convert implicitly and are registered as
+/// impure, i.e. they may have side effects or return different results for the
+/// same arguments. Pure functions may be folded, shared and cached.
+/// Accepted callables are
+///  - fixed arity ones like double(*)(double) or [](double x, double y) {...},
+///    whose number of arguments is checked when an expression is compiled,
+///  - variadic ones taking a FunctionArgsView, which are called without copying,
+///  - variadic ones taking a const FunctionArgs&, which get the arguments copied
+///    into a reused vector.
+/// Use fixed<N>() for generic lambdas, whose arity cannot be deduced.
+template<typename T>
+struct BasicFunction
+{
+    BasicNativeImpl<T> impl;
+    int arity = -1; // number of arguments or -1 for any number
+    bool pure = false;
+    BasicDerivativeImpl<T> derivative; // approximated by central differences if empty
+
+    BasicFunction() = default;
+
+    BasicFunction(BasicNativeImpl<T> _impl, int _arity, bool _pure) : impl(std::move(_impl)), arity(_arity), pure(_pure) {}
+
+    template<typename F>
+    requires (!std::is_same_v<std::decay_t<F>, BasicFunction> &&
+              (NativeCallable<F, T> || VectorCallable<F, T> || FixedCallable<F, T>))
+    BasicFunction(F&& _impl, bool _pure = false) : impl(wrap(std::forward<F>(_impl))), arity(arity_of<F>()), pure(_pure) {}
+
+    inline T operator()(BasicFunctionArgsView<T> args) const {return impl(args);}
+
+    /// Calls a function that takes exactly N scalars with the first N arguments
+    template<size_t N, typename F>
+    static BasicNativeImpl<T> unpack(F&& _impl) {
+        return [f = std::forward<F>(_impl)](BasicFunctionArgsView<T> args) {
+            return [&]<size_t... I>(std::index_sequence<I...>) {
+                return static_cast<T>(f(args[I]...));
+            }(std::make_index_sequence<N>());
+        };
+    }
+
+private:
+    // Number of scalar parameters of a callable with a deducible signature, -1 otherwise
+    template<typename R, typename... A>
+    static constexpr int count(std::function<R(A...)>*) {
+        return (std::is_convertible_v<T, A> && ...) ? static_cast<int>(sizeof...(A)) : -1;
+    }
+
+    template<typename F>
+    static constexpr int arity_of() {
+        if constexpr (!FixedCallable<F, T>) {return -1;}
+        else {return count(static_cast<decltype(std::function{std::declval<std::decay_t<F>>()})*>(nullptr));}
+    }
+
+    template<typename F>
+    static BasicNativeImpl<T> wrap(F&& _impl) {
+        if constexpr (NativeCallable<F, T>) {
+            return BasicNativeImpl<T>(std::forward<F>(_impl));
+        } else if constexpr (VectorCallable<F, T>) {
+            return [f = BasicFunctionImpl<T>(std::forward<F>(_impl))](BasicFunctionArgsView<T> args) {
+                Scratch<BasicFunctionArgs<T>> buffer;
+                buffer->assign(args.begin(), args.end());
+                return f(*buffer);
+            };
+        } else {
+            static_assert(arity_of<F>() >= 0, "Functions take scalars, a FunctionArgsView or a const FunctionArgs&");
+            return unpack<arity_of<F>()>(std::forward<F>(_impl));
+        }
+    }
+};
+
+using Function = BasicFunction<double>;
+
+template<typename T> using BasicFunctions = std::unordered_map<std::string, BasicFunction<T>>;
+
+using Functions = BasicFunctions<double>;
+
+template<typename F>
+inline constexpr bool is_basic_function_v = false;
+
+template<typename T>
+inline constexpr bool is_basic_function_v<BasicFunction<T>> = true;
+
+/// Registers a callable that takes exactly N scalars, e.g. a generic lambda
+template<size_t N, typename T = double, typename F>
+BasicFunction<T> fixed(F&& _impl, bool _pure = false)
+{
+    return BasicFunction<T>(BasicFunction<T>::template unpack<N>(std::forward<F>(_impl)), N, _pure);
+}
+
+/// Registers a function that always returns the same result for the same arguments
+/// and has no side effects.
+template<typename T = double, typename F>
+requires (!is_basic_function_v<std::decay_t<F>>)
+BasicFunction<T> pure(F&& _impl) {return BasicFunction<T>(std::forward<F>(_impl), true);}
+
+template<typename T>
+BasicFunction<T> pure(BasicFunction<T> _func) {_func.pure = true; return _func;}
+
+/// Registers the partial derivatives of a function, see autodiff.hpp. Callables
+/// convert to the function, so T is given for types other than double.
+template<typename T = double>
+BasicFunction<T> differentiable(std::type_identity_t<BasicFunction<T>> _func,
+                                std::type_identity_t<BasicDerivativeImpl<T>> _derivative)
+{
+    _func.derivative = std::move(_derivative);
+    return _func;
+}
+
+/// pi and e
+template<typename T = double>
+BasicVariables<T> common_variables();
+
+/// The built-in functions abs, sin, cos, tan, exp, log, ln, log2, sqrt, pow, max and min.
+/// Instantiated for float, double and long double.
+template<typename T = double>
+BasicFunctions<T> common_functions();
+
+///==================
+/// Scopes
+///==================
+
+/// Variables and functions on top of a parent scope. Lookups fall through to the
+/// parents, so a scope holds only what it adds or overrides and shares its parents
+/// instead of copying them. Evaluations assign into the scope itself, never into
+/// a parent. Any number of threads may use a scope at once as long as nobody
+/// changes it or its parents, e.g. per-request scopes over default_scope().
+class Scope
+{
+public:
+    /// A scope without parent
+    Scope() = default;
+
+    /// A scope on top of _parent, which must outlive it
+    explicit Scope(const Scope* _parent) : parent_(_parent) {}
+
+    Scope(Variables _vars, Functions _funcs, const Scope* _parent = nullptr)
+        : parent_(_parent), vars_(std::move(_vars)), funcs_(std::move(_funcs)) {}
+
+    const Scope* parent() const {return parent_;}
+
+    /// Variables and functions of this scope, which hide those of the parents
+    Variables& variables() {return vars_;}
+    const Variables& variables() const {return vars_;}
+    Functions& functions() {return funcs_;}
+    const Functions& functions() const {return funcs_;}
+
+    /// A variable of this scope or of the closest parent that has it, nullptr if none has
+    const double* find_variable(const std::string& _name) const;
+
+    const Function* find_function(const std::string& _name) const;
+
+private:
+    const Scope* parent_ = nullptr;
+    Variables vars_;
+    Functions funcs_;
+};
+
+/// The variables of common_variables() and the functions of common_functions(),
+/// built once on first use and never changed, so all threads can share it.
+const Scope& default_scope();
 
 ///==================
 ///  Postfix
 ///==================
 
+/// Precedence of an operator, higher binds tighter, or -1 if the token is no operator
+constexpr int precedence(Token::Type _type)
+{
+    switch (_type) {
+    case Token::Type::ASSIGN: return 0;
+    case Token::Type::QUESTION: return 1;
+    case Token::Type::LOR: return 2;
+    case Token::Type::LAND: return 3;
+    case Token::Type::EQ: case Token::Type::NEQ: case Token::Type::LESS:
+    case Token::Type::GREATER: case Token::Type::LEQ: case Token::Type::GEQ: return 4;
+    case Token::Type::PLUS: case Token::Type::MINUS: return 5;
+    case Token::Type::TIMES: case Token::Type::DIV: return 6;
+    case Token::Type::UNARY_PLUS: case Token::Type::UNARY_MINUS: case Token::Type::NOT: return 8;
+    case Token::Type::POW: return 9;
+    default: return -1;
+    }
+}
+
+constexpr bool is_right_associative(Token::Type _type)
+{
+    switch (_type) {
+    case Token::Type::ASSIGN: case Token::Type::QUESTION: case Token::Type::POW:
+    case Token::Type::UNARY_PLUS: case Token::Type::UNARY_MINUS: case Token::Type::NOT: return true;
+    default: return false;
+    }
+}
+
+constexpr bool is_unary_operator(Token::Type _type)
+{
+    return _type == Token::Type::NOT || _type == Token::Type::UNARY_PLUS || _type == Token::Type::UNARY_MINUS;
+}
+
+/// Operators with a left operand, and the : of a conditional. A + or - that follows one of them is unary.
+constexpr bool is_binary_operator(Token::Type _type)
+{
+    return (precedence(_type) >= 0 && !is_unary_operator(_type)) || _type == Token::Type::COLON;
+}
+
 std::vector<Token> generate_postfix(const std::vector<Token>& tokens);
 
+/// Same as above, writing into a reused buffer. Returns false, leaves _postfix
+/// empty and sets _error if the parentheses do not match or a token is unexpected.
+/// _source is the text the tokens refer to, for the position of errors.
+bool generate_postfix(const std::vector<TokenView>& _tokens, std::vector<TokenView>& _postfix,
+                      Error* _error = nullptr, std::string_view _source = {});
+
 ///==================
 /// Evaluation
 ///==================
 
 double eval_postfix(const std::vector<Token>& _postfix, Variables& _vars, Functions& _funcs);
 
+/// Evaluates with the variables and functions of a scope and its parents.
+/// Assignments go into _scope.
+double eval_postfix(const std::vector<Token>& _postfix, Scope& _scope);
+
+/// Evaluates in a scope of its own over default_scope()
 double eval_postfix(const std::vector<Token>& _postfix);
 
 double eval(const char* _text, Variables& _vars, Functions& _funcs);
 
+/// Evaluates in another scalar type, e.g. with BasicVariables<float> and
+/// common_functions<float>(). Instantiated for float, double and long double.
+template<typename T>
+T eval(const char* _text, BasicVariables<T>& _vars, const BasicFunctions<T>& _funcs);
+
+double eval(const char* _text, Scope& _scope);
+
 double eval(const char* _text);
 
+/// Same as eval(), with the error if the text does not compile or a function reports one
+Result try_eval(std::string_view _text, Variables& _vars, Functions& _funcs);
+
+Result try_eval(std::string_view _text, Scope& _scope);
+
 }
@@ -0,0 +1,126 @@
+#include <ibex/memo.hpp>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+namespace ibex
+{
+
+// Hash of the bits of the arguments. Small numbers differ in their high bits
+// only, so every bit is mixed into the low ones that select the entry.
+static size_t hash(FunctionArgsView args)
+{
+    uint64_t h = args.size();
+    for (double arg : args) {
+        h = (h ^ std::bit_cast<uint64_t>(arg)) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool same(FunctionArgsView a, const FunctionArgs& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](double x, double y) {
+        return std::bit_cast<uint64_t>(x) == std::bit_cast<uint64_t>(y);
+    });
+}
+
+///==================
+/// Memoization
+///==================
+
+Memo::Memo(size_t _capacity) :
+    entries_(std::bit_ceil(std::max<size_t>(_capacity, WAYS))), locks_(std::make_unique<std::mutex[]>(LOCKS)) {}
+
+double Memo::call(const NativeImpl& _impl, FunctionArgsView _args)
+{
+    const size_t set = hash(_args) & (entries_.size() / WAYS - 1);
+    Entry* ways = entries_.data() + set * WAYS;
+    std::mutex& mutex = locks_[set % LOCKS];
+
+    // Moves the entry of _args to the front of the set, false if there is none.
+    // Requires the lock of the set.
+    auto touch = [&]() {
+        for (size_t i = 0; i < WAYS && ways[i].used; ++i) {
+            if (!same(_args, ways[i].args)) {continue;}
+            std::rotate(ways, ways + i, ways + i + 1);
+            return true;
+        }
+        return false;
+    };
+
+    {
+        std::lock_guard lock(mutex);
+        if (touch()) {
+            ++hits_;
+            return ways[0].value;
+        }
+    }
+
+    // Call without holding the lock, other threads may use the set meanwhile
+    ++misses_;
+    const size_t errors = function_error_count();
+    const double value = _impl(_args);
+
+    // A call that reported an error is not remembered, so calling again reports it again
+    if (function_error_count() != errors) {return value;}
+
+    // Another thread may have stored the result of the same arguments meanwhile
+    std::lock_guard lock(mutex);
+    if (touch()) {return ways[0].value;}
+
+    // The result goes first and the least recently used one drops out
+    if (ways[WAYS - 1].used) {++evictions_;}
+    std::rotate(ways, ways + WAYS - 1, ways + WAYS);
+    ways[0].args.assign(_args.begin(), _args.end());
+    ways[0].value = value;
+    ways[0].used = true;
+    return value;
+}
+
+MemoStats Memo::stats() const
+{
+    MemoStats stats{.hits = hits_, .misses = misses_, .evictions = evictions_, .capacity = entries_.size()};
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        std::lock_guard lock(locks_[i / WAYS % LOCKS]);
+        stats.entries += entries_[i].used;
+    }
+    return stats;
+}
+
+void Memo::clear()
+{
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        std::lock_guard lock(locks_[i / WAYS % LOCKS]);
+        entries_[i].used = false;
+    }
+}
+
+// The implementation of a memoized function, found again by memo_of()
+struct Memoized
+{
+    std::shared_ptr<Memo> memo;
+    NativeImpl impl;
+
+    double operator()(FunctionArgsView args) const {return memo->call(impl, args);}
+};
+
+Function memoized(Function _func, size_t _capacity)
+{
+    _func.impl = Memoized{std::make_shared<Memo>(_capacity), std::move(_func.impl)};
+    _func.pure = true;
+    return _func;
+}
+
+std::shared_ptr<Memo> memo_of(const Function& _func)
+{
+    const Memoized* memoized = _func.impl.target<Memoized>();
+    return memoized ? memoized->memo : nullptr;
+}
+
+}
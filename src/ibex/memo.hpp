@@ -0,0 +1,73 @@
+#pragma once
+
+#include <ibex/ibex.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace ibex
+{
+
+///==================
+/// Memoization
+///==================
+
+struct MemoStats
+{
+    size_t hits = 0;
+    size_t misses = 0; // calls that ran the function
+    size_t evictions = 0; // results replaced by the one of other arguments
+    size_t entries = 0;
+    size_t capacity = 0;
+};
+
+/// A bounded cache of the results of a pure function keyed by its arguments,
+/// safe to use from several threads. Arguments map to a set of four entries by
+/// their hash and a miss replaces the least recently used result of the set.
+/// Arguments are compared bit by bit, so -0 and 0 are different keys and NaN
+/// arguments hit. Sets are guarded by a fixed number of locks, so calls with
+/// different arguments rarely contend. Calls that report an error through
+/// function_error() are not remembered.
+class Memo
+{
+public:
+    explicit Memo(size_t _capacity = 1024);
+
+    /// Returns the remembered result for _args or calls _impl and remembers its result.
+    /// The function runs without holding a lock.
+    double call(const NativeImpl& _impl, FunctionArgsView _args);
+
+    MemoStats stats() const;
+
+    /// Removes all entries. The counters are kept.
+    void clear();
+
+private:
+    static constexpr size_t WAYS = 4;
+    static constexpr size_t LOCKS = 16;
+
+    struct Entry
+    {
+        FunctionArgs args;
+        double value = 0.0;
+        bool used = false;
+    };
+
+    std::vector<Entry> entries_; // sets of WAYS entries, most recently used first
+    std::unique_ptr<std::mutex[]> locks_; // set i is guarded by lock i % LOCKS
+    std::atomic<size_t> hits_ = 0;
+    std::atomic<size_t> misses_ = 0;
+    std::atomic<size_t> evictions_ = 0;
+};
+
+/// Returns _func with a Memo of _capacity results, for expensive pure functions
+/// that are called with the same arguments again, e.g. table lookups or solvers.
+/// The result is marked pure. Copies of it, like those in compiled expressions,
+/// share the memo. Calls with the same arguments within one expression are
+/// already computed once by the compiler.
+Function memoized(Function _func, size_t _capacity = 1024);
+
+/// The memo of a function returned by memoized(), nullptr for other functions
+std::shared_ptr<Memo> memo_of(const Function& _func);
+
+}
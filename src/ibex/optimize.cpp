@@ -0,0 +1,422 @@
+#include <ibex/optimize.hpp>
+#include <ibex/profile.hpp>
+#include <ibex/scratch.hpp>
+#include <charconv>
+#include <cstdlib>
+#include <unordered_set>
+
+namespace ibex
+{
+
+OptimizeStats& OptimizeStats::operator+=(const OptimizeStats& s)
+{
+    nodes_before += s.nodes_before;
+    nodes_after += s.nodes_after;
+    folded += s.folded;
+    identities += s.identities;
+    strength_reduced += s.strength_reduced;
+    return *this;
+}
+
+///==================
+/// Expression Tree
+///==================
+
+// The postfix program is turned into a tree, simplified bottom-up and emitted again.
+// Nodes live in an arena and refer to their children by index.
+struct Node
+{
+    enum class Kind : unsigned char {CONSTANT, VARIABLE, CALL, UNARY, BINARY, ASSIGN, CONDITIONAL};
+
+    Kind kind = Kind::CONSTANT;
+    Token token = {};
+    std::vector<int> children = {};
+    double value = 0.0; // of a CONSTANT
+    bool pure = true; // the subtree has no assignments and calls no impure functions
+};
+
+static bool is_unary(Token::Type type)
+{
+    return type == Token::Type::UNARY_PLUS || type == Token::Type::UNARY_MINUS || type == Token::Type::NOT;
+}
+
+static bool is_binary(Token::Type type)
+{
+    switch (type) {
+    case Token::Type::PLUS: case Token::Type::MINUS: case Token::Type::TIMES: case Token::Type::DIV:
+    case Token::Type::POW: case Token::Type::EQ: case Token::Type::NEQ: case Token::Type::LESS:
+    case Token::Type::LEQ: case Token::Type::GREATER: case Token::Type::GEQ:
+    case Token::Type::LAND: case Token::Type::LOR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Same semantics as the evaluator
+static double apply(Token::Type type, double lhs, double rhs)
+{
+    switch (type) {
+    case Token::Type::PLUS: return lhs + rhs;
+    case Token::Type::MINUS: return lhs - rhs;
+    case Token::Type::TIMES: return lhs * rhs;
+    case Token::Type::DIV: return lhs / rhs;
+    case Token::Type::POW: return std::pow(lhs, rhs);
+    case Token::Type::EQ: return lhs == rhs;
+    case Token::Type::NEQ: return lhs != rhs;
+    case Token::Type::LESS: return lhs < rhs;
+    case Token::Type::LEQ: return lhs <= rhs;
+    case Token::Type::GREATER: return lhs > rhs;
+    case Token::Type::GEQ: return lhs >= rhs;
+    case Token::Type::LAND: return (lhs != 0.0 && rhs != 0.0);
+    case Token::Type::LOR: return (lhs != 0.0 || rhs != 0.0);
+    case Token::Type::UNARY_PLUS: return lhs;
+    case Token::Type::UNARY_MINUS: return -lhs;
+    case Token::Type::NOT: return !lhs;
+    default: return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+class Optimizer
+{
+public:
+    Optimizer(const Functions& funcs, const Variables& constants, OptimizeStats& stats) :
+        funcs_(funcs), constants_(constants), stats_(stats) {}
+
+    bool build(const std::vector<Token>& postfix);
+
+    void run() {root_ = simplify(root_);}
+
+    std::vector<Token> emit() const {
+        std::vector<Token> output;
+        emit(root_, output);
+        return output;
+    }
+
+private:
+    int add(Node node) {
+        nodes_.push_back(std::move(node));
+        return nodes_.size() - 1;
+    }
+
+    int constant(double value) {
+        char buffer[32];
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        std::string lexeme(buffer, end);
+        Token::Type type = std::all_of(lexeme.begin(), lexeme.end(), ::isdigit) ? Token::Type::INT : Token::Type::FLOAT;
+        return add({.kind = Node::Kind::CONSTANT, .token = {type, lexeme}, .value = value});
+    }
+
+    int binary(Token::Type type, const char* lexeme, int lhs, int rhs) {
+        Node node{.kind = Node::Kind::BINARY, .token = {type, lexeme}};
+        node.children = {lhs, rhs};
+        node.pure = nodes_[lhs].pure && nodes_[rhs].pure;
+        return add(std::move(node));
+    }
+
+    bool is_constant(int id, double value) const {
+        return nodes_[id].kind == Node::Kind::CONSTANT && nodes_[id].value == value;
+    }
+
+    // Simplifies the subtree of a node, returns the node that replaces it
+    int simplify(int root);
+    // Simplifies a node whose children are simplified
+    int rewrite(int id);
+    int simplify_binary(int id);
+    void emit(int id, std::vector<Token>& output) const;
+
+    const Functions& funcs_;
+    const Variables& constants_;
+    OptimizeStats& stats_;
+    std::vector<Node> nodes_;
+    std::unordered_set<std::string> assigned_;
+    int root_ = -1;
+};
+
+bool Optimizer::build(const std::vector<Token>& postfix)
+{
+    std::vector<int> stack;
+    auto pop = [&](size_t n) {
+        std::vector<int> children(stack.end() - n, stack.end());
+        stack.resize(stack.size() - n);
+        return children;
+    };
+
+    for (const Token& token : postfix)
+    {
+        Node node{.token = token};
+        if (token.type == Token::Type::INT || token.type == Token::Type::FLOAT) {
+            node.kind = Node::Kind::CONSTANT;
+            node.value = std::strtod(token.lexeme.c_str(), nullptr);
+        } else if (token.type == Token::Type::IDENTIFIER) {
+            if (funcs_.contains(token.lexeme)) {
+                const int arity = funcs_.at(token.lexeme).arity;
+                if (stack.size() < token.metadata) {return false;}
+                if (arity >= 0 && token.metadata != static_cast<size_t>(arity)) {return false;}
+                node.kind = Node::Kind::CALL;
+                node.children = pop(token.metadata);
+            } else {
+                if (token.metadata > 0) {return false;}
+                node.kind = Node::Kind::VARIABLE;
+            }
+        } else if (is_unary(token.type)) {
+            if (stack.empty()) {return false;}
+            node.kind = Node::Kind::UNARY;
+            node.children = pop(1);
+        } else if (is_binary(token.type) || token.type == Token::Type::ASSIGN) {
+            if (stack.size() < 2) {return false;}
+            node.kind = token.type == Token::Type::ASSIGN ? Node::Kind::ASSIGN : Node::Kind::BINARY;
+            node.children = pop(2);
+            if (node.kind == Node::Kind::ASSIGN) {
+                const Node& target = nodes_[node.children[0]];
+                if (target.kind != Node::Kind::VARIABLE) {return false;}
+                assigned_.insert(target.token.lexeme);
+            }
+        } else if (token.type == Token::Type::QUESTION) {
+            if (token.metadata != 3 || stack.size() < 3) {return false;}
+            node.kind = Node::Kind::CONDITIONAL;
+            node.children = pop(3);
+        } else {
+            return false;
+        }
+
+        node.pure = node.kind != Node::Kind::ASSIGN &&
+                    (node.kind != Node::Kind::CALL || funcs_.at(token.lexeme).pure);
+        for (int child : node.children) {node.pure = node.pure && nodes_[child].pure;}
+        stack.push_back(add(std::move(node)));
+    }
+
+    if (stack.size() != 1) {return false;}
+    root_ = stack.back();
+    return true;
+}
+
+int Optimizer::simplify(int root)
+{
+    // Children first, with an explicit stack since trees may be deeper than the
+    // native stack allows. The arena may grow, so nodes are accessed by index only.
+    struct Frame
+    {
+        int id;
+        size_t child; // next child to simplify
+    };
+    std::vector<Frame> frames = {{root, 0}};
+    int result = root;
+    while (!frames.empty()) {
+        const int id = frames.back().id;
+        size_t& child = frames.back().child;
+        // The target of an assignment stays a variable
+        if (child == 0 && nodes_[id].kind == Node::Kind::ASSIGN) {child = 1;}
+        if (child < nodes_[id].children.size()) {
+            const int next = nodes_[id].children[child];
+            frames.push_back({next, 0});
+            continue;
+        }
+        result = rewrite(id);
+        frames.pop_back();
+        if (!frames.empty()) {
+            Frame& parent = frames.back();
+            nodes_[parent.id].children[parent.child++] = result;
+        }
+    }
+    return result;
+}
+
+int Optimizer::rewrite(int id)
+{
+    const Node& node = nodes_[id];
+    auto all_constant = [&]() {
+        return std::all_of(node.children.begin(), node.children.end(),
+                           [&](int c) {return nodes_[c].kind == Node::Kind::CONSTANT;});
+    };
+
+    switch (node.kind)
+    {
+    case Node::Kind::VARIABLE: {
+        auto it = constants_.find(node.token.lexeme);
+        if (it != constants_.end() && !assigned_.contains(node.token.lexeme)) {
+            ++stats_.folded;
+            return constant(it->second);
+        }
+        return id;
+    }
+
+    case Node::Kind::CALL: {
+        // Calls without arguments, like max(), usually fail, and the branch that
+        // holds them may never run. A call that fails is left to fail when it runs.
+        const Function& func = funcs_.at(node.token.lexeme);
+        if (!func.pure || node.children.empty() || !all_constant()) {return id;}
+        FunctionArgs args;
+        for (int c : node.children) {args.push_back(nodes_[c].value);}
+        take_function_error();
+        const double value = func(args);
+        if (take_function_error()) {return id;}
+        ++stats_.folded;
+        return constant(value);
+    }
+
+    case Node::Kind::UNARY: {
+        int operand = node.children[0];
+        if (all_constant()) {
+            ++stats_.folded;
+            return constant(apply(node.token.type, nodes_[operand].value, 0.0));
+        }
+        if (node.token.type == Token::Type::UNARY_PLUS) {
+            ++stats_.identities;
+            return operand;
+        }
+        if (node.token.type == Token::Type::UNARY_MINUS &&
+            nodes_[operand].kind == Node::Kind::UNARY && nodes_[operand].token.type == Token::Type::UNARY_MINUS) {
+            ++stats_.identities;
+            return nodes_[operand].children[0];
+        }
+        return id;
+    }
+
+    case Node::Kind::BINARY:
+        if (all_constant()) {
+            ++stats_.folded;
+            return constant(apply(node.token.type, nodes_[node.children[0]].value, nodes_[node.children[1]].value));
+        }
+        return simplify_binary(id);
+
+    case Node::Kind::CONDITIONAL: {
+        // Only the branch taken is evaluated
+        const Node& condition = nodes_[node.children[0]];
+        if (condition.kind != Node::Kind::CONSTANT) {return id;}
+        ++stats_.folded;
+        return node.children[condition.value != 0.0 ? 1 : 2];
+    }
+
+    default:
+        return id;
+    }
+}
+
+int Optimizer::simplify_binary(int id)
+{
+    const Token::Type type = nodes_[id].token.type;
+    const int lhs = nodes_[id].children[0];
+    const int rhs = nodes_[id].children[1];
+
+    // The right operand is not evaluated if the left one decides the result
+    if ((type == Token::Type::LAND && is_constant(lhs, 0.0)) ||
+        (type == Token::Type::LOR && nodes_[lhs].kind == Node::Kind::CONSTANT && nodes_[lhs].value != 0.0)) {
+        ++stats_.folded;
+        return constant(type == Token::Type::LOR);
+    }
+
+    // Identities
+    if ((type == Token::Type::PLUS && is_constant(rhs, 0.0)) ||
+        (type == Token::Type::MINUS && is_constant(rhs, 0.0)) ||
+        (type == Token::Type::TIMES && is_constant(rhs, 1.0)) ||
+        (type == Token::Type::DIV && is_constant(rhs, 1.0)) ||
+        (type == Token::Type::POW && is_constant(rhs, 1.0))) {
+        ++stats_.identities;
+        return lhs;
+    }
+    if ((type == Token::Type::PLUS && is_constant(lhs, 0.0)) ||
+        (type == Token::Type::TIMES && is_constant(lhs, 1.0))) {
+        ++stats_.identities;
+        return rhs;
+    }
+
+    // Strength reduction of powers with a constant integer exponent
+    if (type != Token::Type::POW || nodes_[rhs].kind != Node::Kind::CONSTANT) {return id;}
+    const double n = nodes_[rhs].value;
+    if (n == 0.0 && nodes_[lhs].pure) {
+        ++stats_.strength_reduced;
+        return constant(1.0);
+    }
+    if (n == -1.0) {
+        ++stats_.strength_reduced;
+        return binary(Token::Type::DIV, "/", constant(1.0), lhs);
+    }
+    if ((n == 2.0 || n == 3.0 || n == 4.0) && nodes_[lhs].kind == Node::Kind::VARIABLE) {
+        ++stats_.strength_reduced;
+        int product = lhs;
+        for (int i = 1; i < n; ++i) {product = binary(Token::Type::TIMES, "*", product, lhs);}
+        return product;
+    }
+    return id;
+}
+
+void Optimizer::emit(int root, std::vector<Token>& output) const
+{
+    // Post-order with an explicit stack, a node is emitted when it is popped the second time
+    std::vector<std::pair<int, bool>> stack = {{root, false}};
+    while (!stack.empty()) {
+        auto [id, expanded] = stack.back();
+        stack.pop_back();
+        if (expanded) {
+            output.push_back(nodes_[id].token);
+            continue;
+        }
+        stack.emplace_back(id, true);
+        const std::vector<int>& children = nodes_[id].children;
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {stack.emplace_back(*it, false);}
+    }
+}
+
+///==================
+/// Optimization
+///==================
+
+std::vector<Token> optimize(const std::vector<Token>& _postfix, const Functions& _funcs,
+                            const Variables& _constants, OptimizeStats* _stats)
+{
+    ProfileScope profile(Stage::OPTIMIZE);
+    OptimizeStats stats{.nodes_before = _postfix.size()};
+    Optimizer optimizer(_funcs, _constants, stats);
+
+    std::vector<Token> output;
+    if (optimizer.build(_postfix)) {
+        optimizer.run();
+        output = optimizer.emit();
+    } else {
+        stats = {.nodes_before = _postfix.size()};
+        output = _postfix;
+    }
+
+    stats.nodes_after = output.size();
+    if (_stats) {*_stats = stats;}
+    return output;
+}
+
+///==================
+/// Specialization
+///==================
+
+bool specialize(const std::vector<Token>& _postfix, const Functions& _funcs, const Variables& _params,
+                CompiledExpression& _expr, OptimizeStats* _stats)
+{
+    return compile(optimize(_postfix, _funcs, _params, _stats), _funcs, _expr);
+}
+
+Specializer::Specializer(std::string_view _text, const Functions& _funcs) : funcs_(_funcs)
+{
+    Scratch<std::vector<TokenView>> tokens;
+    Scratch<std::vector<TokenView>> views;
+    if (!tokenize(_text, *tokens, &error_) || !generate_postfix(*tokens, *views, &error_, _text)) {return;}
+    postfix_.reserve(views->size());
+    for (const TokenView& view : *views) {postfix_.push_back({view.type, std::string(view.lexeme), view.metadata});}
+}
+
+bool Specializer::specialize(const Variables& _params, CompiledExpression& _expr, OptimizeStats* _stats) const
+{
+    if (!valid()) {
+        _expr.clear();
+        if (_stats) {*_stats = {};}
+        return false;
+    }
+    return ibex::specialize(postfix_, funcs_, _params, _expr, _stats);
+}
+
+CompiledExpression Specializer::specialize(const Variables& _params) const
+{
+    CompiledExpression expr;
+    specialize(_params, expr);
+    return expr;
+}
+
+}
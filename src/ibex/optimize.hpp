@@ -0,0 +1,81 @@
+#pragma once
+
+#include <ibex/ibex.hpp>
+#include <ibex/compile.hpp>
+
+namespace ibex
+{
+
+///==================
+/// Optimization
+///==================
+
+struct OptimizeStats
+{
+    size_t nodes_before = 0; // tokens in the input postfix
+    size_t nodes_after = 0; // tokens in the optimized postfix
+    size_t folded = 0; // operators and calls replaced by their constant result
+    size_t identities = 0; // identity operations removed (+0, *1, --x, +x, ...)
+    size_t strength_reduced = 0; // powers rewritten into multiplications
+
+    size_t removed() const {return nodes_before - nodes_after;}
+
+    OptimizeStats& operator+=(const OptimizeStats& s);
+};
+
+/// Optimizes a postfix program and returns an equivalent, usually shorter one.
+///  - Constant subtrees are folded, including calls to pure functions with
+///    constant arguments, e.g. the built-ins of common_functions().
+///  - Variables in _constants that the expression never assigns are treated as
+///    constants, e.g. pass common_variables() to fold "2*pi".
+///  - Small integer powers of a variable are rewritten into multiplications,
+///    x^-1 into 1/x and x^0 into 1.
+///  - Identities are removed: x+0, 0+x, x-0, x*1, 1*x, x/1, x^1, --x and +x.
+/// Folding follows the operators of the evaluator, so results only differ where
+/// x^3 and x^4 are rounded differently from pow and x+0 turns -0 into +0.
+/// Malformed postfix is returned unchanged so the evaluator can report it.
+std::vector<Token> optimize(const std::vector<Token>& _postfix, const Functions& _funcs,
+                            const Variables& _constants = {}, OptimizeStats* _stats = nullptr);
+
+///==================
+/// Specialization
+///==================
+
+/// Compiles _postfix with the values of _params substituted as constants and
+/// optimized, so the result only reads the other variables, e.g. the inputs of a
+/// row while the parameters change rarely. Parameters the expression assigns stay
+/// variables. Constants fold as far as the tree allows, so in x*a*b, which is
+/// (x*a)*b, a*b is not folded. Returns false if compilation failed, the reason
+/// is then in _expr.error().
+bool specialize(const std::vector<Token>& _postfix, const Functions& _funcs, const Variables& _params,
+                CompiledExpression& _expr, OptimizeStats* _stats = nullptr);
+
+/// An expression that keeps its postfix program, so it is specialized again
+/// without parsing when the parameters change.
+class Specializer
+{
+public:
+    Specializer() = default;
+
+    /// Parses _text, the reason if that fails is in error()
+    explicit Specializer(std::string_view _text, const Functions& _funcs = default_scope().functions());
+
+    bool valid() const {return !postfix_.empty();}
+
+    const Error& error() const {return error_;}
+
+    const std::vector<Token>& postfix() const {return postfix_;}
+
+    /// Compiles the expression for _params into _expr, reusing its memory. Returns
+    /// false if the text did not parse or compilation failed.
+    bool specialize(const Variables& _params, CompiledExpression& _expr, OptimizeStats* _stats = nullptr) const;
+
+    CompiledExpression specialize(const Variables& _params) const;
+
+private:
+    std::vector<Token> postfix_;
+    Functions funcs_;
+    Error error_;
+};
+
+}
@@ -0,0 +1,207 @@
+#include <ibex/parallel.hpp>
+#include <ibex/scratch.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+///==================
+/// Thread Pool
+///==================
+
+// Pool whose tasks the current thread is running, a run() on it from within a task
+// would wait for itself and runs its tasks on the calling thread instead
+static thread_local const ThreadPool* runningPool = nullptr;
+
+struct RunningPool
+{
+    const ThreadPool* previous;
+
+    explicit RunningPool(const ThreadPool* _pool) : previous(runningPool) {runningPool = _pool;}
+    ~RunningPool() {runningPool = previous;}
+};
+
+ThreadPool::ThreadPool(size_t _threads)
+{
+    _threads = std::max<size_t>(_threads, 1);
+    for (size_t i = 0; i < _threads; ++i) {queues_.push_back(std::make_unique<Queue>());}
+    for (size_t i = 1; i < _threads; ++i) {workers_.emplace_back([this, i]() {work(i);});}
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {worker.join();}
+}
+
+ThreadPool& ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::next(size_t _queue, size_t& _task)
+{
+    // Own queue first, newest task first since its data is likely still cached
+    {
+        Queue& own = *queues_[_queue];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            _task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // Then steal the oldest task of another participant
+    for (size_t k = 1; k < participants_; ++k) {
+        Queue& victim = *queues_[(_queue + k) % participants_];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            _task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::work(size_t _queue)
+{
+    size_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex_);
+            wake_.wait(lock, [&]() {return stop_ || (generation_ != seen && _queue < participants_);});
+            if (stop_) {return;}
+            seen = generation_;
+            ++active_;
+        }
+
+        RunningPool running(this);
+        size_t task;
+        while (next(_queue, task)) {
+            (*task_)(task);
+            if (remaining_.fetch_sub(1) == 1) {
+                std::lock_guard lock(mutex_);
+                done_.notify_all();
+            }
+        }
+
+        {
+            std::lock_guard lock(mutex_);
+            --active_;
+        }
+        done_.notify_all();
+    }
+}
+
+void ThreadPool::run(size_t _ntasks, const std::function<void(size_t)>& _task, size_t _threads)
+{
+    if (_ntasks == 0) {return;}
+    if (runningPool == this) {
+        for (size_t i = 0; i < _ntasks; ++i) {_task(i);}
+        return;
+    }
+    std::lock_guard runLock(runMutex_);
+    RunningPool running(this);
+
+    size_t participants = std::min({_threads ? _threads : size(), size(), _ntasks});
+    if (participants == 1) {
+        for (size_t i = 0; i < _ntasks; ++i) {_task(i);}
+        return;
+    }
+
+    // Consecutive tasks go to the same thread, stealing evens out the rest
+    for (size_t p = 0; p < participants; ++p) {
+        Queue& queue = *queues_[p];
+        std::lock_guard lock(queue.mutex);
+        size_t begin = _ntasks * p / participants;
+        size_t end = _ntasks * (p + 1) / participants;
+        // Pushed in reverse so the owner starts with the first of its tasks
+        for (size_t i = end; i > begin; --i) {queue.tasks.push_back(i - 1);}
+    }
+
+    {
+        std::lock_guard lock(mutex_);
+        task_ = &_task;
+        participants_ = participants;
+        remaining_ = _ntasks;
+        ++generation_;
+    }
+    wake_.notify_all();
+
+    size_t task;
+    while (next(0, task)) {
+        _task(task);
+        remaining_.fetch_sub(1);
+    }
+
+    // Workers must be idle before the queues are filled again by the next run
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [&]() {return remaining_ == 0 && active_ == 0;});
+    task_ = nullptr;
+    participants_ = 0;
+}
+
+///==================
+/// Parallel Evaluation
+///==================
+
+bool evaluate_parallel(std::span<const BatchJob> _jobs, const ParallelOptions& _options)
+{
+    const size_t chunk = std::max<size_t>(_options.chunk_size, 1);
+
+    // All jobs are checked up front so that no thread reports an error
+    bool ok = true;
+    for (const BatchJob& job : _jobs) {
+        if (!job.expr || !check_columns(*job.expr, job.columns, job.out.size())) {
+            std::fill(job.out.begin(), job.out.end(), ERRD);
+            ok = false;
+        }
+    }
+    if (!ok) {return false;}
+
+    // Task i covers rows [first, first + chunk) of one job, with first[j] the
+    // first task of job j
+    std::vector<size_t> first(_jobs.size() + 1, 0);
+    for (size_t j = 0; j < _jobs.size(); ++j) {
+        first[j + 1] = first[j] + (_jobs[j].out.size() + chunk - 1) / chunk;
+    }
+
+    auto task = [&](size_t i) {
+        size_t j = std::upper_bound(first.begin(), first.end(), i) - first.begin() - 1;
+        const BatchJob& job = _jobs[j];
+        size_t begin = (i - first[j]) * chunk;
+        size_t n = std::min(chunk, job.out.size() - begin);
+
+        Scratch<std::vector<std::span<const double>>> columns;
+        columns->resize(job.columns.size());
+        for (size_t c = 0; c < job.columns.size(); ++c) {
+            // Columns of slots that are only assigned may be shorter or empty
+            const std::span<const double>& column = job.columns[c];
+            (*columns)[c] = column.size() >= begin + n ? column.subspan(begin, n) : std::span<const double>();
+        }
+        evaluate_batch(*job.expr, *columns, job.out.subspan(begin, n));
+    };
+
+    ThreadPool& pool = _options.pool ? *_options.pool : ThreadPool::global();
+    pool.run(first.back(), task, _options.threads);
+    return true;
+}
+
+bool evaluate_parallel(const CompiledExpression& _expr, std::span<const std::span<const double>> _columns,
+                       std::span<double> _out, const ParallelOptions& _options)
+{
+    BatchJob job{&_expr, _columns, _out};
+    return evaluate_parallel(std::span<const BatchJob>(&job, 1), _options);
+}
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <ibex/batch.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ibex
+{
+
+///==================
+/// Thread Pool
+///==================
+
+/// A fixed set of worker threads with one task queue each. A worker takes tasks
+/// from the back of its own queue and, once that is empty, steals from the front
+/// of the queues of the others, so uneven tasks balance out.
+class ThreadPool
+{
+public:
+    /// Creates a pool that runs tasks on _threads threads, including the calling thread
+    explicit ThreadPool(size_t _threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Number of threads that run tasks, including the calling thread
+    size_t size() const {return queues_.size();}
+
+    /// Calls _task(i) for every i in [0, _ntasks) on at most _threads threads
+    /// (0 for all) and returns once all calls have finished. The calling thread
+    /// works on the tasks too. Concurrent calls are run one after another.
+    /// A task may call run() on the same pool again, e.g. through a function that
+    /// evaluates in parallel itself; the nested tasks then run on the thread of
+    /// that task. Tasks must not wait for another thread that runs on this pool.
+    void run(size_t _ntasks, const std::function<void(size_t)>& _task, size_t _threads = 0);
+
+    /// Process wide pool with one thread per core, created on first use
+    static ThreadPool& global();
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void work(size_t _queue);
+    bool next(size_t _queue, size_t& _task);
+
+    std::vector<std::unique_ptr<Queue>> queues_; // queue 0 belongs to the calling thread
+    std::vector<std::thread> workers_;
+
+    std::mutex runMutex_; // serializes calls to run()
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* task_ = nullptr;
+    size_t participants_ = 0;
+    size_t generation_ = 0;
+    size_t active_ = 0; // workers currently taking part in a run
+    std::atomic<size_t> remaining_ = 0;
+    bool stop_ = false;
+};
+
+///==================
+/// Parallel Evaluation
+///==================
+
+struct ParallelOptions
+{
+    size_t threads = 0; // 0 uses every thread of the pool
+    size_t chunk_size = 1 << 16; // rows per task
+    ThreadPool* pool = nullptr; // nullptr uses ThreadPool::global()
+};
+
+/// One expression evaluated over columns, see evaluate_batch()
+struct BatchJob
+{
+    const CompiledExpression* expr = nullptr;
+    std::span<const std::span<const double>> columns;
+    std::span<double> out;
+};
+
+/// Evaluates several batch jobs in parallel. Every job is split into ranges of
+/// ParallelOptions::chunk_size rows and the (job x range) tasks are spread over
+/// the pool. Each thread works on its own scratch memory and every task writes
+/// only its own rows, so the output does not depend on the scheduling.
+/// As in evaluate_batch(), assignments are local to a row.
+/// Returns false if any job does not match its columns; nothing is evaluated then.
+bool evaluate_parallel(std::span<const BatchJob> _jobs, const ParallelOptions& _options = {});
+
+bool evaluate_parallel(const CompiledExpression& _expr, std::span<const std::span<const double>> _columns,
+                       std::span<double> _out, const ParallelOptions& _options = {});
+
+}
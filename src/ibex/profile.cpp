@@ -0,0 +1,150 @@
+#include <ibex/profile.hpp>
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+
+namespace ibex
+{
+
+const char* stage_name(Stage _stage)
+{
+    switch (_stage) {
+    case Stage::TOKENIZE: return "tokenize";
+    case Stage::POSTFIX: return "generate_postfix";
+    case Stage::OPTIMIZE: return "optimize";
+    case Stage::COMPILE: return "compile";
+    case Stage::EVALUATE: return "evaluate";
+    case Stage::BATCH: return "evaluate_batch";
+    }
+    return "";
+}
+
+///==================
+/// Counters
+///==================
+
+// Shared by all threads. Scopes add their counts once when they end.
+struct StageCounters
+{
+    std::atomic<uint64_t> calls = 0;
+    std::atomic<uint64_t> failures = 0;
+    std::atomic<uint64_t> nanResults = 0;
+    std::atomic<uint64_t> nanoseconds = 0;
+};
+
+struct FunctionCounters
+{
+    std::atomic<uint64_t> calls = 0;
+    std::atomic<uint64_t> nanoseconds = 0;
+};
+
+static std::array<StageCounters, STAGE_COUNT> stageCounters;
+static std::array<std::atomic<uint64_t>, ERROR_CODE_COUNT> errorCounters;
+
+// Entries are never removed, so wrappers can keep pointers to their counters
+static std::mutex functionMutex;
+static std::map<std::string, FunctionCounters, std::less<>> functionCounters;
+
+Profile profile()
+{
+    Profile result;
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        result.stages[i] = {.calls = stageCounters[i].calls, .failures = stageCounters[i].failures,
+                            .nan_results = stageCounters[i].nanResults, .nanoseconds = stageCounters[i].nanoseconds};
+    }
+    for (size_t i = 0; i < ERROR_CODE_COUNT; ++i) {result.errors[i] = errorCounters[i];}
+    std::lock_guard lock(functionMutex);
+    for (const auto& [name, counters] : functionCounters) {
+        if (counters.calls > 0) {result.functions[name] = {.calls = counters.calls, .nanoseconds = counters.nanoseconds};}
+    }
+    return result;
+}
+
+void reset_profile()
+{
+    for (StageCounters& counters : stageCounters) {
+        counters.calls = 0;
+        counters.failures = 0;
+        counters.nanResults = 0;
+        counters.nanoseconds = 0;
+    }
+    for (std::atomic<uint64_t>& counter : errorCounters) {counter = 0;}
+    std::lock_guard lock(functionMutex);
+    for (auto& [name, counters] : functionCounters) {
+        counters.calls = 0;
+        counters.nanoseconds = 0;
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, const Profile& _profile)
+{
+    auto mean = [](uint64_t nanoseconds, uint64_t calls) {return calls > 0 ? nanoseconds / calls : 0;};
+    os << std::left << std::setw(20) << "stage" << std::right << std::setw(12) << "calls" << std::setw(12) << "failures"
+       << std::setw(12) << "NaN" << std::setw(14) << "total us" << std::setw(12) << "mean ns" << "\n";
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        const StageProfile& stage = _profile.stages[i];
+        os << std::left << std::setw(20) << stage_name(static_cast<Stage>(i)) << std::right
+           << std::setw(12) << stage.calls << std::setw(12) << stage.failures << std::setw(12) << stage.nan_results
+           << std::setw(14) << stage.nanoseconds / 1000 << std::setw(12) << mean(stage.nanoseconds, stage.calls) << "\n";
+    }
+    if (!_profile.functions.empty()) {
+        os << std::left << std::setw(20) << "function" << std::right << std::setw(12) << "calls"
+           << std::setw(38) << "total us" << std::setw(12) << "mean ns" << "\n";
+    }
+    for (const auto& [name, function] : _profile.functions) {
+        os << std::left << std::setw(20) << name << std::right << std::setw(12) << function.calls
+           << std::setw(38) << function.nanoseconds / 1000 << std::setw(12) << mean(function.nanoseconds, function.calls) << "\n";
+    }
+    for (size_t i = 1; i < ERROR_CODE_COUNT; ++i) {
+        if (_profile.errors[i] > 0) {
+            os << std::left << std::setw(32) << error_message(static_cast<ErrorCode>(i)) << std::right
+               << std::setw(12) << _profile.errors[i] << "\n";
+        }
+    }
+    return os;
+}
+
+///==================
+/// Hooks
+///==================
+
+#if defined(IBEX_PROFILING)
+
+static uint64_t elapsed(std::chrono::steady_clock::time_point _start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+}
+
+ProfileScope::~ProfileScope()
+{
+    StageCounters& counters = stageCounters[static_cast<size_t>(stage_)];
+    counters.nanoseconds.fetch_add(elapsed(start_), std::memory_order_relaxed);
+    counters.calls.fetch_add(1, std::memory_order_relaxed);
+    if (failed_) {counters.failures.fetch_add(1, std::memory_order_relaxed);}
+    if (nans_) {counters.nanResults.fetch_add(nans_, std::memory_order_relaxed);}
+}
+
+NativeImpl profiled(const std::string& _name, const NativeImpl& _impl)
+{
+    FunctionCounters* counters;
+    {
+        std::lock_guard lock(functionMutex);
+        counters = &functionCounters[_name];
+    }
+    return [_impl, counters](FunctionArgsView args) {
+        const auto start = std::chrono::steady_clock::now();
+        const double result = _impl(args);
+        counters->nanoseconds.fetch_add(elapsed(start), std::memory_order_relaxed);
+        counters->calls.fetch_add(1, std::memory_order_relaxed);
+        return result;
+    };
+}
+
+void count_error(ErrorCode _code)
+{
+    errorCounters[static_cast<size_t>(_code)].fetch_add(1, std::memory_order_relaxed);
+}
+
+#endif
+
+}
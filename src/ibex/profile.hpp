@@ -0,0 +1,118 @@
+#pragma once
+
+#include <ibex/ibex.hpp>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace ibex
+{
+
+///==================
+/// Profiling
+///==================
+
+/// Profiling is compiled in when configured with -DIBEX_ENABLE_PROFILING=ON, which
+/// defines IBEX_PROFILING. Otherwise the hooks below are empty inline functions that
+/// the compiler removes, and profile() stays empty.
+#if defined(IBEX_PROFILING)
+inline constexpr bool PROFILING_ENABLED = true;
+#else
+inline constexpr bool PROFILING_ENABLED = false;
+#endif
+
+/// Stages of the pipeline. BATCH is one call of evaluate_batch.
+enum class Stage : unsigned char {TOKENIZE, POSTFIX, OPTIMIZE, COMPILE, EVALUATE, BATCH};
+
+inline constexpr size_t STAGE_COUNT = 6;
+
+const char* stage_name(Stage _stage);
+
+struct StageProfile
+{
+    uint64_t calls = 0;
+    uint64_t failures = 0; // calls that reported an error
+    uint64_t nan_results = 0; // results of evaluations, per row for batches
+    uint64_t nanoseconds = 0;
+};
+
+struct FunctionProfile
+{
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+};
+
+struct Profile
+{
+    std::array<StageProfile, STAGE_COUNT> stages;
+    std::map<std::string, FunctionProfile> functions; // that were called, by name
+    std::array<uint64_t, ERROR_CODE_COUNT> errors{}; // reported errors by code
+
+    const StageProfile& operator[](Stage _stage) const {return stages[static_cast<size_t>(_stage)];}
+    uint64_t operator[](ErrorCode _code) const {return errors[static_cast<size_t>(_code)];}
+};
+
+/// Counters of all threads since the start of the program or the last reset_profile()
+Profile profile();
+
+void reset_profile();
+
+/// A table of the stages and functions with their calls and times
+std::ostream& operator<<(std::ostream& os, const Profile& _profile);
+
+#if defined(IBEX_PROFILING)
+
+/// Times a stage until the end of the scope
+class ProfileScope
+{
+public:
+    explicit ProfileScope(Stage _stage) : stage_(_stage), start_(std::chrono::steady_clock::now()) {}
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    void fail() {failed_ = true;}
+
+    void result(double _value) {nans_ += std::isnan(_value);}
+
+    void results(std::span<const double> _values) {
+        for (double value : _values) {result(value);}
+    }
+
+private:
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+    bool failed_ = false;
+    uint64_t nans_ = 0;
+};
+
+/// Wraps a function such that its calls are counted and timed under its name.
+/// Compiled expressions call their functions through this wrapper.
+NativeImpl profiled(const std::string& _name, const NativeImpl& _impl);
+
+/// Counts a reported error, called by report()
+void count_error(ErrorCode _code);
+
+#else
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(Stage) {}
+
+    void fail() {}
+    void result(double) {}
+    void results(std::span<const double>) {}
+};
+
+inline const NativeImpl& profiled(const std::string&, const NativeImpl& _impl) {return _impl;}
+
+inline void count_error(ErrorCode) {}
+
+#endif
+
+}
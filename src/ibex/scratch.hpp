@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+
+namespace ibex
+{
+
+///==================
+/// Scratch Memory
+///==================
+
+/// Borrows a thread local object of type T for the lifetime of the Scratch.
+/// Objects are pooled per thread and indexed by nesting depth, so a function
+/// that evaluates another expression while being called does not clobber the
+/// buffers of its caller. Pooled objects are reused as they are, so containers
+/// keep their capacity and code that clears and refills them stops allocating
+/// once warmed up.
+template<typename T>
+class Scratch
+{
+public:
+    Scratch() : value_(acquire()) {}
+    ~Scratch() {--pool().depth;}
+
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+
+    T& operator*() {return value_;}
+    T* operator->() {return &value_;}
+
+private:
+    struct Pool
+    {
+        std::deque<T> items; // deque keeps references stable while growing
+        size_t depth = 0;
+    };
+
+    static Pool& pool() {
+        static thread_local Pool p;
+        return p;
+    }
+
+    static T& acquire() {
+        Pool& p = pool();
+        if (p.depth == p.items.size()) {p.items.emplace_back();}
+        return p.items[p.depth++];
+    }
+
+    T& value_;
+};
+
+}
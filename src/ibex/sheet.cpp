@@ -0,0 +1,224 @@
+#include <ibex/sheet.hpp>
+#include <algorithm>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+// Equal values, where NaN equals NaN so that it does not count as a change
+static bool same(double a, double b)
+{
+    return a == b || (a != a && b != b);
+}
+
+///==================
+/// Sheets
+///==================
+
+Sheet::Sheet() : Sheet(default_scope().functions()) {}
+
+Sheet::Sheet(const Functions& _funcs) : funcs_(_funcs) {}
+
+uint32_t Sheet::variable(const std::string& _name)
+{
+    const uint32_t var = symbols_.intern(_name);
+    if (var == definers_.size()) {
+        definers_.push_back(-1);
+        readers_.emplace_back();
+    }
+    return var;
+}
+
+// True if a statement marked in _targets reads one of _variables, directly or
+// through statements that assign other variables
+bool Sheet::reaches(const std::vector<uint32_t>& _variables, const std::vector<bool>& _targets) const
+{
+    std::vector<bool> visited(statements_.size(), false);
+    std::vector<uint32_t> stack;
+    auto push = [&](uint32_t var) {
+        for (uint32_t reader : readers_[var]) {
+            if (!visited[reader]) {
+                visited[reader] = true;
+                stack.push_back(reader);
+            }
+        }
+    };
+
+    for (uint32_t var : _variables) {push(var);}
+    while (!stack.empty())
+    {
+        const Statement& statement = statements_[stack.back()];
+        if (_targets[stack.back()]) {return true;}
+        stack.pop_back();
+        for (size_t i = 0; i < statement.vars.size(); ++i) {
+            if (statement.expr.assigns(i)) {push(statement.vars[i]);}
+        }
+    }
+    return false;
+}
+
+int Sheet::add(std::string_view _text, Error* _error)
+{
+    auto fail = [&](const Error& error) {
+        if (_error) {*_error = error;}
+        return -1;
+    };
+
+    Statement statement;
+    if (!compile(_text, funcs_, statement.expr)) {return fail(statement.expr.error());}
+    const CompiledExpression& expr = statement.expr;
+
+    // Statements assigning the inputs of the new one, and known variables it assigns
+    std::vector<bool> inputs(statements_.size(), false);
+    std::vector<uint32_t> assigned;
+    for (size_t i = 0; i < expr.slots().size(); ++i)
+    {
+        const std::string& name = expr.slots()[i];
+        const int known = symbols_.find(name);
+        const int definer = known < 0 ? -1 : definers_[known];
+        if (expr.assigns(i)) {
+            if (definer >= 0 || expr.reads(i)) {return fail(report(Error(ErrorCode::DEPENDENCY, name)));}
+            if (known >= 0) {assigned.push_back(known);}
+        } else if (definer >= 0) {
+            inputs[definer] = true;
+        }
+    }
+    if (reaches(assigned, inputs)) {return fail(report(Error(ErrorCode::DEPENDENCY, _text)));}
+
+    const uint32_t index = statements_.size();
+    statement.vars.resize(expr.slots().size());
+    statement.values.resize(expr.slots().size());
+    statement.result = ERRD;
+    for (size_t i = 0; i < expr.slots().size(); ++i) {
+        const uint32_t var = variable(expr.slots()[i]);
+        statement.vars[i] = var;
+        if (expr.assigns(i)) {definers_[var] = index;}
+        if (expr.reads(i)) {readers_[var].push_back(index);}
+    }
+    statements_.push_back(std::move(statement));
+    pending_.push_back(index);
+    sorted_ = false;
+    return index;
+}
+
+double Sheet::get(const std::string& _name) const
+{
+    const int var = symbols_.find(_name);
+    return var < 0 ? ERRD : symbols_[var];
+}
+
+bool Sheet::set(const std::string& _name, double _value)
+{
+    const uint32_t var = variable(_name);
+    if (definers_[var] >= 0) {
+        report(Error(ErrorCode::DEPENDENCY, _name));
+        return false;
+    }
+    if (!same(symbols_[var], _value)) {
+        symbols_[var] = _value;
+        mark(var);
+    }
+    return true;
+}
+
+void Sheet::set(const Variables& _vars)
+{
+    for (const auto& [name, value] : _vars) {
+        const int var = symbols_.find(name);
+        if (var >= 0 && definers_[var] < 0 && !same(symbols_[var], value)) {
+            symbols_[var] = value;
+            mark(var);
+        }
+    }
+}
+
+void Sheet::unbind(Variables& _vars) const
+{
+    symbols_.get(_vars);
+}
+
+// Schedules the statements that read a changed variable
+void Sheet::mark(uint32_t _variable)
+{
+    for (uint32_t reader : readers_[_variable]) {
+        Statement& statement = statements_[reader];
+        if (!statement.dirty) {
+            statement.dirty = true;
+            pending_.push_back(reader);
+        }
+    }
+}
+
+// Ranks the statements in a topological order (Kahn's algorithm). add() keeps
+// the graph acyclic, so every statement gets a rank.
+void Sheet::sort()
+{
+    std::vector<uint32_t> degrees(statements_.size(), 0);
+    std::vector<uint32_t> ready;
+    for (uint32_t s = 0; s < statements_.size(); ++s) {
+        const Statement& statement = statements_[s];
+        for (size_t i = 0; i < statement.vars.size(); ++i) {
+            if (statement.expr.reads(i) && definers_[statement.vars[i]] >= 0) {++degrees[s];}
+        }
+        if (degrees[s] == 0) {ready.push_back(s);}
+    }
+
+    uint32_t rank = 0;
+    while (!ready.empty())
+    {
+        Statement& statement = statements_[ready.back()];
+        ready.pop_back();
+        statement.rank = rank++;
+        for (size_t i = 0; i < statement.vars.size(); ++i) {
+            if (!statement.expr.assigns(i)) {continue;}
+            for (uint32_t reader : readers_[statement.vars[i]]) {
+                if (--degrees[reader] == 0) {ready.push_back(reader);}
+            }
+        }
+    }
+    sorted_ = true;
+}
+
+void Sheet::evaluate(Statement& _statement)
+{
+    for (size_t i = 0; i < _statement.vars.size(); ++i) {_statement.values[i] = symbols_[_statement.vars[i]];}
+    _statement.result = _statement.expr.evaluate(_statement.values);
+    for (size_t i = 0; i < _statement.vars.size(); ++i) {
+        double& value = symbols_[_statement.vars[i]];
+        if (_statement.expr.assigns(i) && !same(value, _statement.values[i])) {
+            value = _statement.values[i];
+            mark(_statement.vars[i]);
+        }
+    }
+}
+
+size_t Sheet::update()
+{
+    if (!sorted_) {sort();}
+
+    // Dependents always have a higher rank, so taking the lowest rank first
+    // evaluates every statement once, after all statements it depends on
+    auto later = [this](uint32_t a, uint32_t b) {return statements_[a].rank > statements_[b].rank;};
+    std::make_heap(pending_.begin(), pending_.end(), later);
+
+    size_t count = 0;
+    while (!pending_.empty())
+    {
+        std::pop_heap(pending_.begin(), pending_.end(), later);
+        Statement& statement = statements_[pending_.back()];
+        pending_.pop_back();
+        statement.dirty = false;
+
+        const size_t before = pending_.size();
+        evaluate(statement);
+        ++count;
+        for (size_t k = before; k < pending_.size(); ++k) {
+            std::push_heap(pending_.begin(), pending_.begin() + k + 1, later);
+        }
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <ibex/compile.hpp>
+#include <ibex/symbols.hpp>
+#include <string_view>
+
+namespace ibex
+{
+
+///==================
+/// Sheets
+///==================
+
+/// Statements over one set of variables that are kept up to date like the cells
+/// of a spreadsheet. Every statement is compiled once and the sheet records which
+/// variables it reads and assigns. A variable is assigned by at most one
+/// statement, all other variables are inputs. After inputs change, update()
+/// evaluates only the statements that depend on them, directly or through other
+/// statements, each after the statements it depends on. Statements whose
+/// assignments keep their values do not cause their dependents to be evaluated.
+class Sheet
+{
+public:
+    Sheet();
+
+    explicit Sheet(const Functions& _funcs);
+
+    /// Adds a statement and returns its index. Returns -1 and sets _error if it does
+    /// not compile, assigns a variable that another statement assigns, or depends
+    /// on itself. The statement is evaluated by the next update().
+    int add(std::string_view _text, Error* _error = nullptr);
+
+    /// Number of statements
+    size_t size() const {return statements_.size();}
+
+    /// Result of a statement at the last update()
+    double result(size_t _statement) const {return statements_[_statement].result;}
+
+    /// Current value of a variable, NaN if it is unknown or was never set.
+    double get(const std::string& _name) const;
+
+    /// Sets an input. Returns false if a statement assigns the variable.
+    bool set(const std::string& _name, double _value);
+
+    /// Sets the inputs that statements read from a variable map. Variables that
+    /// statements assign or that no statement references are ignored.
+    void set(const Variables& _vars);
+
+    /// Writes all variables into a variable map.
+    void unbind(Variables& _vars) const;
+
+    /// Evaluates the statements affected by changes since the last update and
+    /// returns how many were evaluated.
+    size_t update();
+
+private:
+    struct Statement
+    {
+        CompiledExpression expr;
+        std::vector<uint32_t> vars; // variable of each slot
+        std::vector<double> values; // of the slots while evaluating
+        double result;
+        uint32_t rank = 0; // position in a topological order
+        bool dirty = true;
+    };
+
+    uint32_t variable(const std::string& _name);
+    bool reaches(const std::vector<uint32_t>& _variables, const std::vector<bool>& _targets) const;
+    void mark(uint32_t _variable);
+    void sort();
+    void evaluate(Statement& _statement);
+
+    const Functions funcs_;
+    std::vector<Statement> statements_;
+    SymbolTable symbols_;
+    std::vector<int> definers_; // statement assigning each variable, or -1
+    std::vector<std::vector<uint32_t>> readers_; // statements reading each variable
+    std::vector<uint32_t> pending_; // dirty statements, a heap by rank during update()
+    bool sorted_ = true;
+};
+
+}
@@ -0,0 +1,593 @@
+#pragma once
+
+#include <ibex/ibex.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+namespace ibex
+{
+
+///==================
+/// Static Expressions
+///==================
+
+/// Text of an expression as a template argument
+template<size_t N>
+struct FixedString
+{
+    char text[N] = {};
+
+    constexpr FixedString(const char (&_text)[N]) {std::copy_n(_text, N, text);}
+
+    constexpr std::string_view view() const {return {text, N - 1};}
+};
+
+/// Reports a malformed static expression. It is not constexpr, so reaching it
+/// fails the compile time parse and the compiler shows the call with its message.
+inline void static_expression_error(const char*) {}
+
+/// The functions of common_functions(), which static expressions can call
+enum class StaticFunction : unsigned char {ABS, SIN, COS, TAN, EXP, LOG, LOG2, SQRT, POW, MAX, MIN};
+
+struct StaticFunctionInfo
+{
+    std::string_view name;
+    StaticFunction function;
+    int arity; // -1 for at least one argument
+};
+
+inline constexpr StaticFunctionInfo STATIC_FUNCTIONS[] = {
+    {"abs", StaticFunction::ABS, 1}, {"sin", StaticFunction::SIN, 1}, {"cos", StaticFunction::COS, 1},
+    {"tan", StaticFunction::TAN, 1}, {"exp", StaticFunction::EXP, 1}, {"log", StaticFunction::LOG, 1},
+    {"ln", StaticFunction::LOG, 1}, {"log2", StaticFunction::LOG2, 1}, {"sqrt", StaticFunction::SQRT, 1},
+    {"pow", StaticFunction::POW, 2}, {"max", StaticFunction::MAX, -1}, {"min", StaticFunction::MIN, -1},
+};
+
+/// An expression parsed at compile time with the grammar of tokenize() and
+/// generate_postfix() and the checks of compile(), as a tree of nodes. N is the
+/// size of the text, which bounds the number of tokens and thus of nodes.
+template<size_t N>
+struct StaticProgram
+{
+    struct Node
+    {
+        enum class Kind : unsigned char {CONSTANT, VARIABLE, ASSIGN, UNARY, BINARY, SQUARE, CONDITIONAL, CALL};
+
+        Kind kind = Kind::CONSTANT;
+        Token::Type type = Token::Type::UNKNOWN; // of UNARY and BINARY
+        double value = 0.0; // of a CONSTANT
+        size_t slot = 0; // of a VARIABLE or the target of an ASSIGN
+        StaticFunction function = StaticFunction::ABS; // of a CALL
+        size_t first = 0; // the children are children[first, first + count)
+        size_t count = 0;
+    };
+
+    std::array<Node, N> nodes{};
+    std::array<size_t, N> children{};
+    std::array<std::string_view, N> slots{};
+    size_t nnodes = 0;
+    size_t nslots = 0;
+    size_t root = 0;
+
+    consteval explicit StaticProgram(std::string_view _text) {
+        std::array<TokenView, N> tokens{};
+        const size_t ntokens = tokenize(_text, tokens);
+        std::array<TokenView, N> postfix{};
+        const size_t npostfix = generate_postfix(tokens, ntokens, postfix);
+        build(postfix, npostfix);
+    }
+
+    constexpr size_t child(size_t _node, size_t _i) const {return children[nodes[_node].first + _i];}
+
+private:
+    static constexpr bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+    static constexpr bool is_digit(char c) {return c >= '0' && c <= '9';}
+    static constexpr bool is_alpha(char c) {return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';}
+
+    static constexpr size_t tokenize(std::string_view _text, std::array<TokenView, N>& _tokens) {
+        size_t n = 0;
+        size_t p = 0;
+        auto peek = [&](size_t q) {return q < _text.size() ? _text[q] : '\0';};
+
+        while (p < _text.size())
+        {
+            if (is_space(_text[p])) {
+                ++p;
+                continue;
+            }
+
+            const size_t start = p;
+            Token::Type type = Token::Type::UNKNOWN;
+            if (is_digit(_text[p])) {
+                type = Token::Type::INT;
+                while (is_digit(peek(p))) {++p;}
+                if (peek(p) == '.') {
+                    ++p;
+                    while (is_digit(peek(p))) {++p;}
+                    type = Token::Type::FLOAT;
+                }
+                if (peek(p) == 'e') {
+                    type = Token::Type::FLOAT;
+                    ++p;
+                    if (peek(p) == '-') {++p;}
+                    if (!is_digit(peek(p))) {static_expression_error("Exponent has no digits!");}
+                    while (is_digit(peek(p))) {++p;}
+                }
+                const std::string_view lexeme = _text.substr(start, p - start);
+                _tokens[n++] = {.type = type, .lexeme = lexeme, .value = literal(lexeme)};
+                continue;
+            }
+            if (is_alpha(_text[p])) {
+                while (is_alpha(peek(p)) || is_digit(peek(p))) {++p;}
+                _tokens[n++] = {.type = Token::Type::IDENTIFIER, .lexeme = _text.substr(start, p - start)};
+                continue;
+            }
+
+            auto pair = [&](char second, Token::Type both, Token::Type single) {
+                if (peek(p + 1) == second) {++p; return both;}
+                return single;
+            };
+            switch (_text[p])
+            {
+            case ',': type = Token::Type::COMMA; break;
+            case '(': type = Token::Type::LPAREN; break;
+            case ')': type = Token::Type::RPAREN; break;
+            case '*': type = Token::Type::TIMES; break;
+            case '/': type = Token::Type::DIV; break;
+            case '^': type = Token::Type::POW; break;
+            case '?': type = Token::Type::QUESTION; break;
+            case ':': type = Token::Type::COLON; break;
+            case '+':
+            case '-': {
+                const bool unary = n == 0 || _tokens[n - 1].type == Token::Type::LPAREN ||
+                                   _tokens[n - 1].type == Token::Type::COMMA ||
+                                   is_unary_operator(_tokens[n - 1].type) || is_binary_operator(_tokens[n - 1].type);
+                if (_text[p] == '+') {type = unary ? Token::Type::UNARY_PLUS : Token::Type::PLUS;}
+                else {type = unary ? Token::Type::UNARY_MINUS : Token::Type::MINUS;}
+                break;
+            }
+            case '!': type = pair('=', Token::Type::NEQ, Token::Type::NOT); break;
+            case '<': type = pair('=', Token::Type::LEQ, Token::Type::LESS); break;
+            case '>': type = pair('=', Token::Type::GEQ, Token::Type::GREATER); break;
+            case '=': type = pair('=', Token::Type::EQ, Token::Type::ASSIGN); break;
+            case '|': type = pair('|', Token::Type::LOR, Token::Type::UNKNOWN); break;
+            case '&': type = pair('&', Token::Type::LAND, Token::Type::UNKNOWN); break;
+            default: break;
+            }
+            ++p;
+            _tokens[n++] = {.type = type, .lexeme = _text.substr(start, p - start)};
+        }
+        return n;
+    }
+
+    static constexpr size_t generate_postfix(const std::array<TokenView, N>& _tokens, size_t _ntokens,
+                                             std::array<TokenView, N>& _output) {
+        std::array<TokenView, N> opStack{};
+        std::array<size_t, N> nargStack{};
+        size_t nout = 0, nops = 0, nargs = 0;
+        auto pop = [&]() {_output[nout++] = opStack[--nops];};
+
+        for (size_t i = 0; i < _ntokens; ++i)
+        {
+            const TokenView& token = _tokens[i];
+            const Token::Type next = i + 1 < _ntokens ? _tokens[i + 1].type : Token::Type::UNKNOWN;
+            switch (token.type)
+            {
+            case Token::Type::INT:
+            case Token::Type::FLOAT:
+                _output[nout++] = token;
+                break;
+            case Token::Type::IDENTIFIER:
+                if (next == Token::Type::LPAREN) {opStack[nops++] = token;}
+                else {_output[nout++] = token;}
+                break;
+            case Token::Type::COMMA:
+                while (nops > 0 && opStack[nops - 1].type != Token::Type::LPAREN) {pop();}
+                if (nargs > 0) {++nargStack[nargs - 1];}
+                break;
+            case Token::Type::LPAREN:
+                opStack[nops++] = token;
+                if (nops >= 2 && opStack[nops - 2].type == Token::Type::IDENTIFIER) {
+                    nargStack[nargs++] = next == Token::Type::RPAREN ? 0 : 1;
+                }
+                break;
+            case Token::Type::RPAREN:
+                while (nops > 0 && opStack[nops - 1].type != Token::Type::LPAREN) {pop();}
+                if (nops == 0) {static_expression_error("Mismatched parentheses");}
+                --nops;
+                if (nops > 0 && opStack[nops - 1].type == Token::Type::IDENTIFIER) {
+                    TokenView func = opStack[--nops];
+                    func.metadata = nargStack[--nargs];
+                    if (func.lexeme == "if" && func.metadata == 3) {func.type = Token::Type::QUESTION;}
+                    _output[nout++] = func;
+                }
+                break;
+            case Token::Type::COLON:
+                while (nops > 0 && opStack[nops - 1].type != Token::Type::LPAREN &&
+                       !(opStack[nops - 1].type == Token::Type::QUESTION && opStack[nops - 1].metadata == 0)) {pop();}
+                if (nops == 0 || opStack[nops - 1].type != Token::Type::QUESTION) {
+                    static_expression_error("Unexpected : without ?");
+                }
+                opStack[nops - 1].metadata = 3;
+                break;
+            default:
+                if (precedence(token.type) < 0) {static_expression_error("Unexpected token");}
+                while (nops > 0 && !is_unary_operator(token.type)) {
+                    const TokenView& top = opStack[nops - 1];
+                    if (precedence(top.type) < 0) break;
+                    if (top.type == Token::Type::QUESTION && top.metadata == 0) break;
+                    const int prec1 = precedence(token.type);
+                    const int prec2 = precedence(top.type);
+                    if ((is_right_associative(token.type) && prec1 < prec2) ||
+                        (!is_right_associative(token.type) && prec1 <= prec2)) {pop();}
+                    else {break;}
+                }
+                opStack[nops++] = token;
+                break;
+            }
+        }
+
+        while (nops > 0) {
+            if (opStack[nops - 1].type == Token::Type::LPAREN) {static_expression_error("Mismatched parentheses in expression.");}
+            pop();
+        }
+        return nout;
+    }
+
+    constexpr void build(const std::array<TokenView, N>& _postfix, size_t _npostfix) {
+        std::array<size_t, N> stack{};
+        size_t depth = 0;
+        size_t nchildren = 0;
+        // Adds a node whose children are the top _count entries of the stack
+        auto add = [&](Node node, size_t _count) {
+            if (depth < _count) {static_expression_error("Insufficient operands");}
+            node.first = nchildren;
+            node.count = _count;
+            for (size_t i = depth - _count; i < depth; ++i) {children[nchildren++] = stack[i];}
+            depth -= _count;
+            nodes[nnodes] = node;
+            stack[depth++] = nnodes++;
+        };
+
+        for (size_t i = 0; i < _npostfix; ++i)
+        {
+            const TokenView& token = _postfix[i];
+            switch (token.type)
+            {
+            case Token::Type::INT:
+            case Token::Type::FLOAT:
+                add({.kind = Node::Kind::CONSTANT, .value = token.value}, 0);
+                break;
+            case Token::Type::IDENTIFIER: {
+                const StaticFunctionInfo* func = std::find_if(std::begin(STATIC_FUNCTIONS), std::end(STATIC_FUNCTIONS),
+                    [&](const StaticFunctionInfo& f) {return f.name == token.lexeme;});
+                if (func != std::end(STATIC_FUNCTIONS)) {
+                    if (func->arity >= 0 && token.metadata != static_cast<size_t>(func->arity)) {
+                        static_expression_error("Wrong number of arguments for function");
+                    }
+                    if (token.metadata == 0) {static_expression_error("Function expects at least 1 argument");}
+                    add({.kind = Node::Kind::CALL, .function = func->function}, token.metadata);
+                    break;
+                }
+                if (token.metadata > 0) {static_expression_error("Unknown function");}
+                const size_t slot = std::find(slots.begin(), slots.begin() + nslots, token.lexeme) - slots.begin();
+                if (slot == nslots) {slots[nslots++] = token.lexeme;}
+                add({.kind = Node::Kind::VARIABLE, .slot = slot}, 0);
+                break;
+            }
+            case Token::Type::UNARY_PLUS:
+            case Token::Type::UNARY_MINUS:
+            case Token::Type::NOT:
+                add({.kind = Node::Kind::UNARY, .type = token.type}, 1);
+                break;
+            case Token::Type::ASSIGN: {
+                if (depth < 2 || nodes[stack[depth - 2]].kind != Node::Kind::VARIABLE) {
+                    static_expression_error("Expression is not assignable");
+                }
+                const size_t slot = nodes[stack[depth - 2]].slot;
+                stack[depth - 2] = stack[depth - 1];
+                --depth;
+                add({.kind = Node::Kind::ASSIGN, .slot = slot}, 1);
+                break;
+            }
+            case Token::Type::QUESTION:
+                if (token.metadata != 3) {static_expression_error("Expected : in conditional");}
+                add({.kind = Node::Kind::CONDITIONAL}, 3);
+                break;
+            case Token::Type::POW: {
+                // x^2 runs as x*x like in compile()
+                size_t exponent = depth > 0 ? stack[depth - 1] : 0;
+                while (nodes[exponent].kind == Node::Kind::UNARY && nodes[exponent].type == Token::Type::UNARY_PLUS) {
+                    exponent = children[nodes[exponent].first];
+                }
+                if (depth >= 2 && nodes[exponent].kind == Node::Kind::CONSTANT && nodes[exponent].value == 2.0) {
+                    --depth;
+                    add({.kind = Node::Kind::SQUARE}, 1);
+                } else {
+                    add({.kind = Node::Kind::BINARY, .type = token.type}, 2);
+                }
+                break;
+            }
+            default:
+                if (!is_binary_operator(token.type)) {static_expression_error("Unexpected token in postfix notation");}
+                add({.kind = Node::Kind::BINARY, .type = token.type}, 2);
+                break;
+            }
+        }
+
+        if (depth != 1) {static_expression_error("Invalid postfix expression: stack size != 1");}
+        root = stack[0];
+    }
+
+    // Unsigned integer of fixed capacity for correctly rounded literals
+    struct BigInt
+    {
+        std::array<uint32_t, 160> limbs{};
+        size_t size = 0;
+
+        constexpr void multiply_add(uint32_t _factor, uint32_t _add) {
+            uint64_t carry = _add;
+            for (size_t i = 0; i < size; ++i) {
+                const uint64_t product = static_cast<uint64_t>(limbs[i]) * _factor + carry;
+                limbs[i] = static_cast<uint32_t>(product);
+                carry = product >> 32;
+            }
+            if (carry) {limbs[size++] = static_cast<uint32_t>(carry);}
+        }
+
+        constexpr size_t bits() const {return size == 0 ? 0 : 32 * (size - 1) + std::bit_width(limbs[size - 1]);}
+
+        constexpr BigInt shifted(size_t _bits) const {
+            BigInt result;
+            const size_t words = _bits / 32, rest = _bits % 32;
+            for (size_t i = 0; i < size; ++i) {
+                const uint64_t value = static_cast<uint64_t>(limbs[i]) << rest;
+                result.limbs[i + words] |= static_cast<uint32_t>(value);
+                if (value >> 32) {result.limbs[i + words + 1] |= static_cast<uint32_t>(value >> 32);}
+            }
+            result.size = size + words + 1;
+            while (result.size > 0 && result.limbs[result.size - 1] == 0) {--result.size;}
+            return result;
+        }
+
+        constexpr bool operator<(const BigInt& _b) const {
+            if (size != _b.size) {return size < _b.size;}
+            for (size_t i = size; i-- > 0;) {
+                if (limbs[i] != _b.limbs[i]) {return limbs[i] < _b.limbs[i];}
+            }
+            return false;
+        }
+
+        constexpr void subtract(const BigInt& _b) {
+            int64_t borrow = 0;
+            for (size_t i = 0; i < size; ++i) {
+                const int64_t difference = static_cast<int64_t>(limbs[i]) - (i < _b.size ? _b.limbs[i] : 0) - borrow;
+                borrow = difference < 0;
+                limbs[i] = static_cast<uint32_t>(difference + (borrow << 32));
+            }
+            while (size > 0 && limbs[size - 1] == 0) {--size;}
+        }
+    };
+
+    // Same value as strtod, i.e. correctly rounded, inf if too large and 0 if too small.
+    // value = digits * 10^exponent with at most 800 significant digits; digits beyond
+    // only decide ties and are replaced by a trailing 1 if any of them is nonzero.
+    static constexpr size_t MAX_DIGITS = 800;
+
+    static constexpr double literal(std::string_view _lexeme) {
+        std::array<char, MAX_DIGITS + 1> digits{};
+        size_t n = 0;
+        int64_t exponent = 0;
+        bool truncated = false;
+        size_t p = 0;
+        auto digit = [&](char c, bool fraction) {
+            if (n == 0 && c == '0') {exponent -= fraction; return;}
+            if (n < MAX_DIGITS) {
+                digits[n++] = c;
+                exponent -= fraction;
+            } else {
+                truncated = truncated || c != '0';
+                exponent += !fraction;
+            }
+        };
+        for (; p < _lexeme.size() && is_digit(_lexeme[p]); ++p) {digit(_lexeme[p], false);}
+        if (p < _lexeme.size() && _lexeme[p] == '.') {
+            for (++p; p < _lexeme.size() && is_digit(_lexeme[p]); ++p) {digit(_lexeme[p], true);}
+        }
+        if (p < _lexeme.size() && _lexeme[p] == 'e') {
+            const bool negative = ++p < _lexeme.size() && _lexeme[p] == '-';
+            int64_t e = 0;
+            for (p += negative; p < _lexeme.size(); ++p) {e = std::min<int64_t>(10 * e + (_lexeme[p] - '0'), 1000000);}
+            exponent += negative ? -e : e;
+        }
+        if (truncated) {
+            digits[n++] = '1';
+            --exponent;
+        }
+        while (n > 0 && digits[n - 1] == '0') {
+            --n;
+            ++exponent;
+        }
+
+        const int64_t magnitude = static_cast<int64_t>(n) + exponent; // value < 10^magnitude
+        if (n == 0 || magnitude < -324) {return 0.0;}
+        if (magnitude > 310) {return std::numeric_limits<double>::infinity();}
+
+        // Both operands are exact, so the one rounding of * or / is the correct one
+        if (n <= 15 && exponent >= -22 && exponent <= 22) {
+            double value = 0.0, scale = 1.0;
+            for (size_t i = 0; i < n; ++i) {value = 10.0 * value + (digits[i] - '0');}
+            for (int64_t i = 0; i < (exponent < 0 ? -exponent : exponent); ++i) {scale *= 10.0;}
+            return exponent < 0 ? value / scale : value * scale;
+        }
+
+        // value = numerator / denominator, scaled by 2^shift so the quotient has 54 or 55 bits
+        BigInt numerator, denominator;
+        denominator.limbs[0] = 1;
+        denominator.size = 1;
+        for (size_t i = 0; i < n; ++i) {numerator.multiply_add(10, digits[i] - '0');}
+        for (int64_t i = 0; i < (exponent < 0 ? -exponent : exponent); ++i) {
+            (exponent < 0 ? denominator : numerator).multiply_add(10, 0);
+        }
+        const int64_t shift = 54 - (static_cast<int64_t>(numerator.bits()) - static_cast<int64_t>(denominator.bits()));
+        if (shift > 0) {numerator = numerator.shifted(shift);}
+        else {denominator = denominator.shifted(-shift);}
+        uint64_t quotient = 0;
+        for (int bit = 55; bit >= 0; --bit) {
+            const BigInt part = denominator.shifted(bit);
+            if (!(numerator < part)) {
+                numerator.subtract(part);
+                quotient |= uint64_t(1) << bit;
+            }
+        }
+        bool sticky = numerator.size > 0;
+        int64_t exponent2 = -shift; // value ~ quotient * 2^exponent2
+        if (quotient >> 54) {
+            sticky = sticky || (quotient & 1);
+            quotient >>= 1;
+            ++exponent2;
+        }
+        // 53 bits of mantissa and one to round, fewer for subnormals
+        if (exponent2 + 1 < -1074) {
+            const int64_t drop = -1074 - (exponent2 + 1);
+            if (drop > 60) {return 0.0;}
+            sticky = sticky || (quotient & ((uint64_t(1) << drop) - 1));
+            quotient >>= drop;
+            exponent2 += drop;
+        }
+        uint64_t mantissa = quotient >> 1;
+        if ((quotient & 1) && (sticky || (mantissa & 1))) {++mantissa;}
+        if (mantissa >> 53) {
+            mantissa >>= 1;
+            ++exponent2;
+        }
+        if (mantissa < (uint64_t(1) << 52)) {return std::bit_cast<double>(mantissa);}
+        const int64_t biased = exponent2 + 1 + 52 + 1023;
+        if (biased >= 2047) {return std::numeric_limits<double>::infinity();}
+        return std::bit_cast<double>((static_cast<uint64_t>(biased) << 52) | (mantissa & ((uint64_t(1) << 52) - 1)));
+    }
+};
+
+/// An expression whose text is parsed at compile time into an evaluator that the
+/// compiler can inline completely. Variables are bound by position in the order
+/// of slots(), the same order as CompiledExpression::slots(). The grammar, the
+/// functions of common_functions() and the results are those of the runtime path,
+/// as long as floating point contraction (e.g. -ffp-contract=fast with FMA) is off.
+/// Malformed text fails to compile. Assignments write to the values passed to
+/// evaluate() and to copies of the arguments of operator().
+///
+///     double y = ibex::static_expr<"a*x^2 + b">(2.0, 3.0, 1.0); // a = 2, x = 3, b = 1
+template<FixedString Text>
+class StaticExpression
+{
+public:
+    static constexpr StaticProgram<sizeof(Text.text)> program{Text.view()};
+
+    /// Number of variables
+    static constexpr size_t size() {return program.nslots;}
+
+    /// Names of the variables in slot order
+    static constexpr std::span<const std::string_view> slots() {return {program.slots.data(), program.nslots};}
+
+    /// Slot index of a variable or -1 if the expression does not reference it
+    static constexpr int slot(std::string_view _name) {
+        auto it = std::find(slots().begin(), slots().end(), _name);
+        return it != slots().end() ? static_cast<int>(it - slots().begin()) : -1;
+    }
+
+    template<typename... A>
+    requires (sizeof...(A) == size() && (std::is_convertible_v<A, double> && ...))
+    double operator()(A... _values) const {
+        std::array<double, size()> values{static_cast<double>(_values)...};
+        return eval<program.root>(values.data());
+    }
+
+    /// Evaluates with one value per slot, which receives the results of assignments
+    double evaluate(std::span<double> _values) const {return eval<program.root>(_values.data());}
+
+private:
+    using Node = typename StaticProgram<sizeof(Text.text)>::Node;
+
+    template<size_t I>
+    static double eval(double* _slots) {
+        constexpr Node node = program.nodes[I];
+        if constexpr (node.kind == Node::Kind::CONSTANT) {
+            return node.value;
+        } else if constexpr (node.kind == Node::Kind::VARIABLE) {
+            return _slots[node.slot];
+        } else if constexpr (node.kind == Node::Kind::ASSIGN) {
+            return _slots[node.slot] = eval<program.child(I, 0)>(_slots);
+        } else if constexpr (node.kind == Node::Kind::UNARY) {
+            const double a = eval<program.child(I, 0)>(_slots);
+            if constexpr (node.type == Token::Type::UNARY_MINUS) {return -a;}
+            else if constexpr (node.type == Token::Type::NOT) {return !a;}
+            else {return a;}
+        } else if constexpr (node.kind == Node::Kind::SQUARE) {
+            const double a = eval<program.child(I, 0)>(_slots);
+            return a * a;
+        } else if constexpr (node.kind == Node::Kind::CONDITIONAL) {
+            if (eval<program.child(I, 0)>(_slots) == 0.0) {return eval<program.child(I, 2)>(_slots);}
+            return eval<program.child(I, 1)>(_slots);
+        } else if constexpr (node.kind == Node::Kind::CALL) {
+            return call<I>(_slots, std::make_index_sequence<node.count>());
+        } else if constexpr (node.type == Token::Type::LAND) {
+            if (eval<program.child(I, 0)>(_slots) == 0.0) {return 0.0;}
+            return eval<program.child(I, 1)>(_slots) != 0.0;
+        } else if constexpr (node.type == Token::Type::LOR) {
+            if (eval<program.child(I, 0)>(_slots) != 0.0) {return 1.0;}
+            return eval<program.child(I, 1)>(_slots) != 0.0;
+        } else {
+            // Operands are evaluated left to right, which matters for assignments
+            const double a = eval<program.child(I, 0)>(_slots);
+            const double b = eval<program.child(I, 1)>(_slots);
+            if constexpr (node.type == Token::Type::PLUS) {return a + b;}
+            else if constexpr (node.type == Token::Type::MINUS) {return a - b;}
+            else if constexpr (node.type == Token::Type::TIMES) {return a * b;}
+            else if constexpr (node.type == Token::Type::DIV) {return a / b;}
+            else if constexpr (node.type == Token::Type::POW) {return std::pow(a, b);}
+            else if constexpr (node.type == Token::Type::EQ) {return a == b;}
+            else if constexpr (node.type == Token::Type::NEQ) {return a != b;}
+            else if constexpr (node.type == Token::Type::LESS) {return a < b;}
+            else if constexpr (node.type == Token::Type::LEQ) {return a <= b;}
+            else if constexpr (node.type == Token::Type::GREATER) {return a > b;}
+            else {return a >= b;}
+        }
+    }
+
+    template<size_t I, size_t... K>
+    static double call(double* _slots, std::index_sequence<K...>) {
+        constexpr StaticFunction function = program.nodes[I].function;
+        // Braced initialization evaluates the arguments in order
+        const std::array<double, sizeof...(K)> args{eval<program.child(I, K)>(_slots)...};
+        if constexpr (function == StaticFunction::ABS) {return std::abs(args[0]);}
+        else if constexpr (function == StaticFunction::SIN) {return std::sin(args[0]);}
+        else if constexpr (function == StaticFunction::COS) {return std::cos(args[0]);}
+        else if constexpr (function == StaticFunction::TAN) {return std::tan(args[0]);}
+        else if constexpr (function == StaticFunction::EXP) {return std::exp(args[0]);}
+        else if constexpr (function == StaticFunction::LOG) {return std::log(args[0]);}
+        else if constexpr (function == StaticFunction::LOG2) {return std::log2(args[0]);}
+        else if constexpr (function == StaticFunction::SQRT) {return std::sqrt(args[0]);}
+        else if constexpr (function == StaticFunction::POW) {return std::pow(args[0], args[1]);}
+        else if constexpr (function == StaticFunction::MAX) {
+            double max = -std::numeric_limits<double>::infinity();
+            for (double arg : args) {if (arg > max) {max = arg;}}
+            return max;
+        } else {
+            double min = std::numeric_limits<double>::infinity();
+            for (double arg : args) {if (arg < min) {min = arg;}}
+            return min;
+        }
+    }
+};
+
+/// The evaluator of an expression known at compile time, e.g. ibex::static_expr<"sqrt(x*x + y*y)">(3, 4)
+template<FixedString Text>
+inline constexpr StaticExpression<Text> static_expr{};
+
+}
@@ -0,0 +1,122 @@
+#include <ibex/symbols.hpp>
+#include <ibex/profile.hpp>
+#include <limits>
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+///==================
+/// Symbols
+///==================
+
+SymbolTable::SymbolTable(const SymbolTable& _other)
+    : ids_(_other.ids_), names_(_other.names_), values_(_other.values_), addresses_(_other.addresses_), bound_(_other.bound_)
+{
+    repoint();
+}
+
+SymbolTable& SymbolTable::operator=(const SymbolTable& _other)
+{
+    if (this != &_other) {
+        ids_ = _other.ids_;
+        names_ = _other.names_;
+        values_ = _other.values_;
+        addresses_ = _other.addresses_;
+        bound_ = _other.bound_;
+        repoint();
+    }
+    return *this;
+}
+
+// Points the variables that are not bound at their values, after the array moved
+void SymbolTable::repoint()
+{
+    for (size_t i = 0; i < addresses_.size(); ++i) {
+        if (!bound_[i]) {addresses_[i] = &values_[i];}
+    }
+}
+
+uint32_t SymbolTable::intern(std::string_view _name)
+{
+    auto it = ids_.find(_name);
+    if (it != ids_.end()) {return it->second;}
+
+    const uint32_t id = names_.size();
+    ids_.emplace(_name, id);
+    names_.emplace_back(_name);
+    const double* before = values_.data();
+    values_.push_back(ERRD);
+    addresses_.push_back(&values_.back());
+    bound_.push_back(false);
+    if (values_.data() != before) {repoint();}
+    return id;
+}
+
+int SymbolTable::find(std::string_view _name) const
+{
+    auto it = ids_.find(_name);
+    return it != ids_.end() ? static_cast<int>(it->second) : -1;
+}
+
+void SymbolTable::bind(uint32_t _id, double* _address)
+{
+    addresses_[_id] = _address;
+    bound_[_id] = true;
+}
+
+uint32_t SymbolTable::bind(std::string_view _name, double* _address)
+{
+    const uint32_t id = intern(_name);
+    bind(id, _address);
+    return id;
+}
+
+void SymbolTable::unbind(uint32_t _id)
+{
+    if (!bound_[_id]) {return;}
+    values_[_id] = *addresses_[_id];
+    addresses_[_id] = &values_[_id];
+    bound_[_id] = false;
+}
+
+void SymbolTable::set(const Variables& _vars)
+{
+    for (const auto& [name, value] : _vars) {(*this)[intern(name)] = value;}
+}
+
+void SymbolTable::get(Variables& _vars) const
+{
+    for (size_t i = 0; i < names_.size(); ++i) {_vars[names_[i]] = *addresses_[i];}
+}
+
+///==================
+/// Bound Expressions
+///==================
+
+BoundExpression::BoundExpression(CompiledExpression _expr, SymbolTable& _symbols)
+    : expr_(std::move(_expr)), symbols_(&_symbols)
+{
+    for (const std::string& name : expr_.slots()) {ids_.push_back(_symbols.intern(name));}
+}
+
+double BoundExpression::evaluate() const
+{
+    if (!symbols_) {return ERRD;}
+    ProfileScope profile(Stage::EVALUATE);
+    if (!expr_.valid()) {
+        profile.fail();
+        return ERRD;
+    }
+
+    // Slot i is the variable ids_[i], read and written where the table keeps it
+    const Bytecode& code = expr_.bytecode();
+    const IndirectSlots<double> slots{.addresses = symbols_->addresses(), .index = ids_.data()};
+    const double result = execute(code.code.data(), code.constants.data(), expr_.functions().data(), slots,
+                                  code.stack_size);
+    profile.result(result);
+    return result;
+}
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <ibex/compile.hpp>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ibex
+{
+
+///==================
+/// Symbols
+///==================
+
+/// Interns variable names to dense ids and keeps the values in a flat array, so
+/// variables are accessed by id without hashing their names. A variable can
+/// instead be bound to memory of the caller, e.g. a field of a simulation state,
+/// which is then read and written in place. Ids never change.
+class SymbolTable
+{
+public:
+    SymbolTable() = default;
+
+    SymbolTable(const SymbolTable& _other);
+    SymbolTable& operator=(const SymbolTable& _other);
+    SymbolTable(SymbolTable&&) = default;
+    SymbolTable& operator=(SymbolTable&&) = default;
+
+    /// Id of a variable, which is added as NaN if it is new
+    uint32_t intern(std::string_view _name);
+
+    /// Id of a variable or -1 if it is unknown
+    int find(std::string_view _name) const;
+
+    /// Number of variables, ids are below
+    size_t size() const {return names_.size();}
+
+    const std::string& name(uint32_t _id) const {return names_[_id];}
+
+    double& operator[](uint32_t _id) {return *addresses_[_id];}
+    double operator[](uint32_t _id) const {return *addresses_[_id];}
+
+    /// Where the value of a variable is, until variables are added or bound
+    double* address(uint32_t _id) const {return addresses_[_id];}
+
+    /// Where the values of all variables are, by id, until variables are added or bound
+    double* const* addresses() const {return addresses_.data();}
+
+    /// Reads and writes the variable at _address from now on. The memory must stay
+    /// valid until the variable is unbound or the table is destroyed.
+    void bind(uint32_t _id, double* _address);
+
+    /// Same as above, interning the variable. Returns its id.
+    uint32_t bind(std::string_view _name, double* _address);
+
+    /// Moves a variable back into the table, keeping its current value
+    void unbind(uint32_t _id);
+
+    bool bound(uint32_t _id) const {return bound_[_id];}
+
+    /// Interns and sets every variable of a map
+    void set(const Variables& _vars);
+
+    /// Writes all variables into a map
+    void get(Variables& _vars) const;
+
+private:
+    // Hashes std::string and std::string_view alike, so lookups by view do not allocate
+    struct Hash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view _name) const {return std::hash<std::string_view>()(_name);}
+    };
+
+    void repoint();
+
+    std::unordered_map<std::string, uint32_t, Hash, std::equal_to<>> ids_;
+    std::vector<std::string> names_;
+    std::vector<double> values_; // of the variables that are not bound
+    std::vector<double*> addresses_;
+    std::vector<bool> bound_;
+};
+
+/// A compiled expression with its slots resolved to the variables of a symbol
+/// table once. Evaluating reads and writes the variables through their addresses
+/// in the table, so there is no name lookup and no copying, and bound variables
+/// are used in place.
+class BoundExpression
+{
+public:
+    BoundExpression() = default;
+
+    /// Interns the variables of _expr. _symbols must outlive the bound expression.
+    BoundExpression(CompiledExpression _expr, SymbolTable& _symbols);
+
+    const CompiledExpression& expression() const {return expr_;}
+
+    /// Variable of each slot
+    const std::vector<uint32_t>& ids() const {return ids_;}
+
+    /// Evaluates with the current values of the variables. Assignments are written
+    /// to the variables as they happen.
+    double evaluate() const;
+
+private:
+    CompiledExpression expr_;
+    SymbolTable* symbols_ = nullptr;
+    std::vector<uint32_t> ids_;
+};
+
+}
@@ -0,0 +1,294 @@
+#include <ibex/table.hpp>
+#include <ibex/scratch.hpp>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define IBEX_HAS_MMAP 1
+#endif
+
+namespace ibex
+{
+
+static double ERRD = std::numeric_limits<double>::quiet_NaN();
+
+///==================
+/// Mapped Files
+///==================
+
+MappedFile::MappedFile(const char* _path)
+{
+#ifdef IBEX_HAS_MMAP
+    int fd = ::open(_path, O_RDONLY);
+    if (fd < 0) {return;}
+    struct stat info;
+    if (fstat(fd, &info) == 0) {
+        size_ = info.st_size;
+        if (size_ == 0) {
+            open_ = true;
+        } else {
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                madvise(data, size_, MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(data);
+                open_ = mapped_ = true;
+            }
+        }
+    }
+    ::close(fd);
+#else
+    std::ifstream file(_path, std::ios::binary | std::ios::ate);
+    if (!file) {return;}
+    size_ = file.tellg();
+    char* data = new char[size_];
+    file.seekg(0);
+    file.read(data, size_);
+    data_ = data;
+    open_ = true;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& _other) noexcept
+{
+    *this = std::move(_other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& _other) noexcept
+{
+    if (this != &_other) {
+        close();
+        data_ = std::exchange(_other.data_, nullptr);
+        size_ = std::exchange(_other.size_, 0);
+        open_ = std::exchange(_other.open_, false);
+        mapped_ = std::exchange(_other.mapped_, false);
+    }
+    return *this;
+}
+
+void MappedFile::close()
+{
+#ifdef IBEX_HAS_MMAP
+    if (mapped_) {munmap(const_cast<char*>(data_), size_);}
+#else
+    delete[] data_;
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    open_ = mapped_ = false;
+}
+
+void MappedFile::release(size_t _begin, size_t _end) const
+{
+#ifdef IBEX_HAS_MMAP
+    if (!mapped_) {return;}
+    // Only whole pages inside the range are released
+    const size_t page = sysconf(_SC_PAGESIZE);
+    _begin = (_begin + page - 1) / page * page;
+    _end = std::min(_end, size_) / page * page;
+    if (_begin < _end) {madvise(const_cast<char*>(data_) + _begin, _end - _begin, MADV_DONTNEED);}
+#endif
+}
+
+///==================
+/// Table Evaluation
+///==================
+
+// Parses a CSV field as a number, NaN if it is not one
+static double parse_number(const char* begin, const char* end)
+{
+    while (begin < end && (*begin == ' ' || *begin == '\t')) {++begin;}
+    while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {--end;}
+    if (begin < end && *begin == '+') {++begin;}
+    double value;
+    auto [ptr, ec] = std::from_chars(begin, end, value);
+    return (begin < end && ec == std::errc() && ptr == end) ? value : ERRD;
+}
+
+// Finds the end of the field starting at p. Quoted fields may contain delimiters
+// and line breaks, their content without the quotes is returned in [begin, end).
+static const char* scan_field(const char* p, const char* stop, char delimiter, const char*& begin, const char*& end)
+{
+    if (p < stop && *p == '"') {
+        begin = ++p;
+        while (p < stop && !(*p == '"' && (p + 1 == stop || p[1] != '"'))) {p += (*p == '"') ? 2 : 1;}
+        end = p;
+        if (p < stop) {++p;} // closing quote
+        while (p < stop && *p != delimiter && *p != '\n') {++p;}
+        return p;
+    }
+    begin = p;
+    while (p < stop && *p != delimiter && *p != '\n') {++p;}
+    end = (p > begin && p[-1] == '\r') ? p - 1 : p;
+    return p;
+}
+
+// Column index of every slot the expression reads, -1 for slots it only assigns.
+// Reports missing columns.
+static bool find_columns(const CompiledExpression& expr, const std::vector<std::string>& names, std::vector<int>& columns)
+{
+    columns.assign(expr.slots().size(), -1);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (!expr.reads(i)) {continue;}
+        auto it = std::find(names.begin(), names.end(), expr.slots()[i]);
+        if (it == names.end()) {
+            report(Error(ErrorCode::UNKNOWN_VARIABLE, expr.slots()[i]));
+            return false;
+        }
+        columns[i] = it - names.begin();
+    }
+    return true;
+}
+
+static bool evaluate_csv(const CompiledExpression& expr, const MappedFile& file, const TableSink& sink,
+                         const TableOptions& options, std::span<double> out)
+{
+    const char* p = file.data();
+    const char* stop = p + file.size();
+
+    // Header
+    std::vector<std::string> names;
+    while (p < stop) {
+        const char *begin, *end;
+        p = scan_field(p, stop, options.delimiter, begin, end);
+        names.emplace_back(begin, end);
+        names.back().erase(0, names.back().find_first_not_of(" \t"));
+        names.back().erase(names.back().find_last_not_of(" \t") + 1);
+        if (p < stop && *p++ == '\n') {break;}
+    }
+
+    std::vector<int> columns;
+    if (!find_columns(expr, names, columns)) {return false;}
+
+    // Every field of the file maps to the slot it is parsed into, or -1
+    std::vector<int> targets(names.size(), -1);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i] >= 0) {targets[columns[i]] = i;}
+    }
+
+    const size_t chunk = out.size();
+    std::vector<double> buffers(columns.size() * chunk);
+    std::vector<std::span<const double>> spans(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i] >= 0) {spans[i] = std::span<const double>(buffers.data() + i * chunk, chunk);}
+    }
+
+    while (p < stop)
+    {
+        const char* first = p;
+        size_t rows = 0;
+        while (rows < chunk && p < stop)
+        {
+            // Skip empty lines, unless the table has a single column, where
+            // an empty line is a row with an empty field
+            if (names.size() > 1 && (*p == '\n' || *p == '\r')) {++p; continue;}
+
+            double* row = buffers.data() + rows;
+            for (size_t i = 0; i < columns.size(); ++i) {row[i * chunk] = ERRD;} // missing fields
+            for (size_t field = 0; ; ++field) {
+                const char *begin, *end;
+                p = scan_field(p, stop, options.delimiter, begin, end);
+                if (field < targets.size() && targets[field] >= 0) {
+                    row[targets[field] * chunk] = parse_number(begin, end);
+                }
+                if (p < stop && *p == options.delimiter) {++p; continue;}
+                if (p < stop) {++p;} // line break
+                break;
+            }
+            ++rows;
+        }
+
+        if (rows > 0) {
+            std::vector<std::span<const double>> slice(spans.size());
+            for (size_t i = 0; i < spans.size(); ++i) {
+                if (!spans[i].empty()) {slice[i] = spans[i].first(rows);}
+            }
+            evaluate_batch(expr, slice, out.first(rows));
+            sink(out.first(rows));
+        }
+        file.release(first - file.data(), p - file.data());
+    }
+    return true;
+}
+
+static bool evaluate_binary(const CompiledExpression& expr, const MappedFile& file, const TableSink& sink,
+                            const TableOptions& options, std::span<double> out)
+{
+    const size_t ncols = options.columns.size();
+    if (ncols == 0 || file.size() % (ncols * sizeof(double)) != 0) {
+        report(Error(ErrorCode::WRONG_VALUE_COUNT));
+        return false;
+    }
+    const size_t nrows = file.size() / (ncols * sizeof(double));
+
+    std::vector<int> columns;
+    if (!find_columns(expr, options.columns, columns)) {return false;}
+
+    // Columns are used in place on little-endian machines, otherwise swapped into buffers
+    constexpr bool inPlace = std::endian::native == std::endian::little;
+    const size_t chunk = out.size();
+    std::vector<double> buffers(inPlace ? 0 : columns.size() * chunk);
+    std::vector<std::span<const double>> slice(columns.size());
+
+    for (size_t begin = 0; begin < nrows; begin += chunk)
+    {
+        const size_t rows = std::min(chunk, nrows - begin);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i] < 0) {slice[i] = {}; continue;}
+            const size_t offset = (columns[i] * nrows + begin) * sizeof(double);
+            if constexpr (inPlace) {
+                slice[i] = std::span<const double>(reinterpret_cast<const double*>(file.data() + offset), rows);
+            } else {
+                double* buffer = buffers.data() + i * chunk;
+                for (size_t r = 0; r < rows; ++r) {
+                    unsigned char bytes[sizeof(double)];
+                    std::memcpy(bytes, file.data() + offset + r * sizeof(double), sizeof(double));
+                    std::reverse(bytes, bytes + sizeof(double));
+                    std::memcpy(buffer + r, bytes, sizeof(double));
+                }
+                slice[i] = std::span<const double>(buffer, rows);
+            }
+        }
+
+        evaluate_batch(expr, slice, out.first(rows));
+        sink(out.first(rows));
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (columns[i] < 0) {continue;}
+            const size_t offset = (columns[i] * nrows + begin) * sizeof(double);
+            file.release(offset, offset + rows * sizeof(double));
+        }
+    }
+    return true;
+}
+
+bool evaluate_table(const CompiledExpression& _expr, const char* _path, const TableSink& _sink,
+                    const TableOptions& _options)
+{
+    if (!_expr.valid()) {return false;}
+    MappedFile file(_path);
+    if (!file.is_open()) {
+        report(Error(ErrorCode::IO, _path));
+        return false;
+    }
+
+    std::vector<double> out(std::max<size_t>(_options.chunk_rows, 1));
+    switch (_options.format) {
+    case TableFormat::CSV: return evaluate_csv(_expr, file, _sink, _options, out);
+    case TableFormat::BINARY: return evaluate_binary(_expr, file, _sink, _options, out);
+    }
+    return false;
+}
+
+}
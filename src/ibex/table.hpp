@@ -0,0 +1,77 @@
+#pragma once
+
+#include <ibex/batch.hpp>
+#include <string_view>
+
+namespace ibex
+{
+
+///==================
+/// Mapped Files
+///==================
+
+/// A file mapped read-only into memory. Where memory mapping is not available
+/// the file is read instead.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const char* _path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& _other) noexcept;
+    MappedFile& operator=(MappedFile&& _other) noexcept;
+
+    /// False if the file could not be opened or mapped
+    bool is_open() const {return open_;}
+
+    const char* data() const {return data_;}
+    size_t size() const {return size_;}
+    std::string_view text() const {return {data_, size_};}
+
+    /// Hints that the bytes [_begin, _end) are not needed anymore, so their pages
+    /// can leave memory. Reading them again later is still valid.
+    void release(size_t _begin, size_t _end) const;
+
+private:
+    void close();
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+    bool mapped_ = false;
+};
+
+///==================
+/// Table Evaluation
+///==================
+
+enum class TableFormat : unsigned char
+{
+    CSV, // text with a header line naming the columns
+    BINARY // little-endian doubles, all values of a column stored one after another, column after column
+};
+
+struct TableOptions
+{
+    TableFormat format = TableFormat::CSV;
+    char delimiter = ','; // of CSV fields
+    std::vector<std::string> columns = {}; // names of the columns of a BINARY table, in file order
+    size_t chunk_rows = 1 << 16; // rows that are parsed and evaluated at once
+};
+
+/// Receives the results of consecutive rows
+using TableSink = std::function<void(std::span<const double>)>;
+
+/// Evaluates an expression once per row of a table file and passes the results
+/// to _sink, chunk_rows at a time. The file is memory mapped and only the columns
+/// the expression reads are parsed. Memory use is bounded by the chunk size,
+/// independent of the size of the file. CSV fields that are empty or not a
+/// number evaluate as NaN. Empty lines are skipped, except in a CSV file of one
+/// column, where they are rows with an empty field. As in evaluate_batch(),
+/// assignments are local to a row.
+/// Returns false if the file cannot be read or lacks a column the expression reads.
+bool evaluate_table(const CompiledExpression& _expr, const char* _path, const TableSink& _sink,
+                    const TableOptions& _options = {});
+
+}
@@ -0,0 +1,266 @@
+#include <ibex/vm.hpp>
+#include <ibex/scratch.hpp>
+#include <algorithm>
+
+namespace ibex
+{
+
+///==================
+/// Bytecode
+///==================
+
+std::ostream& operator<<(std::ostream& os, const Instruction& ins)
+{
+    os << "Instruction("
+       << static_cast<int>(ins.op) << ", "
+       << static_cast<int>(ins.nargs) << ", "
+       << ins.arg << ")";
+    return os;
+}
+
+bool binary_opcode(Token::Type type, OpCode& op)
+{
+    switch (type) {
+    case Token::Type::PLUS: op = OpCode::ADD; return true;
+    case Token::Type::MINUS: op = OpCode::SUB; return true;
+    case Token::Type::TIMES: op = OpCode::MUL; return true;
+    case Token::Type::DIV: op = OpCode::DIV; return true;
+    case Token::Type::POW: op = OpCode::POW; return true;
+    case Token::Type::EQ: op = OpCode::EQ; return true;
+    case Token::Type::NEQ: op = OpCode::NEQ; return true;
+    case Token::Type::LESS: op = OpCode::LESS; return true;
+    case Token::Type::LEQ: op = OpCode::LEQ; return true;
+    case Token::Type::GREATER: op = OpCode::GREATER; return true;
+    case Token::Type::GEQ: op = OpCode::GEQ; return true;
+    case Token::Type::LAND: op = OpCode::LAND; return true;
+    case Token::Type::LOR: op = OpCode::LOR; return true;
+    default: return false;
+    }
+}
+
+///==================
+/// Virtual Machine
+///==================
+
+template<typename T>
+static inline T& slot(T* slots, size_t i) {return slots[i];}
+
+template<typename T>
+static inline T& slot(IndirectSlots<T> slots, size_t i) {return *slots.addresses[slots.index[i]];}
+
+template<typename T, typename Slots>
+static T interpret(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, Slots slots, T* stack)
+{
+    // The top of the stack is cached in tos, sp points one past the spilled entries.
+    // The first push spills the uninitialized tos into stack[0], which is why
+    // Bytecode::stack_size counts one entry more than the expression depth.
+    const Instruction* ip = code;
+    T* sp = stack;
+    T tos = 0;
+
+#if defined(__GNUC__)
+    // Direct threading through the labels-as-values extension of GCC and Clang.
+    // The order must match OpCode.
+    static const void* const labels[] = {
+        &&L_CONST, &&L_LOAD, &&L_STORE, &&L_CALL,
+        &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV, &&L_POW,
+        &&L_EQ, &&L_NEQ, &&L_LESS, &&L_LEQ, &&L_GREATER, &&L_GEQ,
+        &&L_LAND, &&L_LOR,
+        &&L_NEG, &&L_NOT, &&L_SQR,
+        &&L_ADD_C, &&L_SUB_C, &&L_MUL_C, &&L_DIV_C,
+        &&L_ADD_L, &&L_SUB_L, &&L_MUL_L, &&L_DIV_L,
+        &&L_JUMP, &&L_JUMP_IF_NOT, &&L_AND_JUMP, &&L_OR_JUMP, &&L_BOOL,
+        &&L_PICK, &&L_RET
+    };
+    static_assert(std::size(labels) == static_cast<size_t>(OpCode::RET) + 1);
+#define CASE(op) L_##op:
+#define NEXT goto *labels[static_cast<uint8_t>((++ip)->op)]
+#define GOTO ip = code + ip->arg; goto *labels[static_cast<uint8_t>(ip->op)]
+    goto *labels[static_cast<uint8_t>(ip->op)];
+#else
+#define CASE(op) case OpCode::op:
+#define NEXT ++ip; break
+#define GOTO ip = code + ip->arg; break
+    for (;;) switch (ip->op) {
+#endif
+
+    CASE(CONST) *sp++ = tos; tos = constants[ip->arg]; NEXT;
+    CASE(LOAD) *sp++ = tos; tos = slot(slots, ip->arg); NEXT;
+    CASE(STORE) slot(slots, ip->arg) = tos; NEXT;
+    CASE(CALL)
+        *sp++ = tos;
+        sp -= ip->nargs;
+        tos = funcs[ip->arg](BasicFunctionArgsView<T>(sp, ip->nargs)); // arguments are passed in place
+        NEXT;
+
+    CASE(ADD) tos = *--sp + tos; NEXT;
+    CASE(SUB) tos = *--sp - tos; NEXT;
+    CASE(MUL) tos = *--sp * tos; NEXT;
+    CASE(DIV) tos = *--sp / tos; NEXT;
+    CASE(POW) tos = std::pow(*--sp, tos); NEXT;
+    CASE(EQ) tos = *--sp == tos; NEXT;
+    CASE(NEQ) tos = *--sp != tos; NEXT;
+    CASE(LESS) tos = *--sp < tos; NEXT;
+    CASE(LEQ) tos = *--sp <= tos; NEXT;
+    CASE(GREATER) tos = *--sp > tos; NEXT;
+    CASE(GEQ) tos = *--sp >= tos; NEXT;
+    CASE(LAND) tos = (*--sp != 0.0 && tos != 0.0); NEXT;
+    CASE(LOR) tos = (*--sp != 0.0 || tos != 0.0); NEXT;
+
+    CASE(NEG) tos = -tos; NEXT;
+    CASE(NOT) tos = !tos; NEXT;
+    CASE(SQR) tos *= tos; NEXT;
+
+    CASE(ADD_C) tos += constants[ip->arg]; NEXT;
+    CASE(SUB_C) tos -= constants[ip->arg]; NEXT;
+    CASE(MUL_C) tos *= constants[ip->arg]; NEXT;
+    CASE(DIV_C) tos /= constants[ip->arg]; NEXT;
+    CASE(ADD_L) tos += slot(slots, ip->arg); NEXT;
+    CASE(SUB_L) tos -= slot(slots, ip->arg); NEXT;
+    CASE(MUL_L) tos *= slot(slots, ip->arg); NEXT;
+    CASE(DIV_L) tos /= slot(slots, ip->arg); NEXT;
+
+    CASE(JUMP) GOTO;
+    CASE(JUMP_IF_NOT) {
+        const T condition = tos;
+        tos = *--sp;
+        if (condition == 0.0) {GOTO;}
+        NEXT;
+    }
+    CASE(AND_JUMP) if (tos == 0.0) {tos = 0.0; GOTO;} tos = *--sp; NEXT;
+    CASE(OR_JUMP) if (tos != 0.0) {tos = 1.0; GOTO;} tos = *--sp; NEXT;
+    CASE(BOOL) tos = tos != 0.0; NEXT;
+    CASE(PICK) *sp++ = tos; tos = stack[ip->arg + 1]; NEXT; // entry k is spilled to stack[k + 1]
+
+    CASE(RET) return tos;
+
+#if !defined(__GNUC__)
+    }
+#endif
+#undef CASE
+#undef NEXT
+#undef GOTO
+}
+
+template<typename T>
+T run(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, T* slots, T* stack)
+{
+    return interpret(code, constants, funcs, slots, stack);
+}
+
+template<typename T, typename Slots>
+static T execute_on(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, Slots slots,
+                    size_t _stack_size)
+{
+    // Shallow stacks are a buffer on the C++ stack, deeper ones borrow a buffer from the scratch pool
+    static constexpr size_t LOCAL_STACK_SIZE = 64;
+    if (_stack_size <= LOCAL_STACK_SIZE) {
+        T stack[LOCAL_STACK_SIZE];
+        return interpret(code, constants, funcs, slots, stack);
+    }
+    Scratch<std::vector<T>> stack;
+    if (stack->size() < _stack_size) {stack->resize(_stack_size);}
+    return interpret(code, constants, funcs, slots, stack->data());
+}
+
+template<typename T>
+T execute(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, T* slots, size_t _stack_size)
+{
+    return execute_on(code, constants, funcs, slots, _stack_size);
+}
+
+template<typename T>
+T execute(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, IndirectSlots<T> slots,
+          size_t _stack_size)
+{
+    return execute_on(code, constants, funcs, slots, _stack_size);
+}
+
+template float run(const Instruction*, const float*, const BasicNativeImpl<float>*, float*, float*);
+template double run(const Instruction*, const double*, const NativeImpl*, double*, double*);
+template long double run(const Instruction*, const long double*, const BasicNativeImpl<long double>*,
+                         long double*, long double*);
+template float execute(const Instruction*, const float*, const BasicNativeImpl<float>*, float*, size_t);
+template double execute(const Instruction*, const double*, const NativeImpl*, double*, size_t);
+template long double execute(const Instruction*, const long double*, const BasicNativeImpl<long double>*,
+                             long double*, size_t);
+template double execute(const Instruction*, const double*, const NativeImpl*, IndirectSlots<double>, size_t);
+
+bool verify(std::span<const Instruction> _code, size_t _constants, size_t _slots, size_t _functions,
+            size_t& _stack_size)
+{
+    if (_code.empty()) {return false;}
+    // Depth at the targets of the jumps seen so far, -1 where nothing jumps to
+    Scratch<std::vector<int64_t>> targets;
+    targets->assign(_code.size(), -1);
+    int64_t depth = 0;
+    int64_t max = 0;
+    bool live = true; // false after a JUMP until the next target
+
+    auto jump = [&](size_t _from, size_t _to, int64_t _depth) {
+        if (_to <= _from || _to >= _code.size()) {return false;}
+        int64_t& target = (*targets)[_to];
+        if (target >= 0 && target != _depth) {return false;}
+        target = _depth;
+        return true;
+    };
+
+    for (size_t i = 0; i < _code.size(); ++i)
+    {
+        const Instruction& ins = _code[i];
+        if ((*targets)[i] >= 0) {
+            if (live && depth != (*targets)[i]) {return false;}
+            depth = (*targets)[i];
+            live = true;
+        }
+        if (!live || ins.op > OpCode::RET) {return false;}
+
+        switch (ins.op) {
+        case OpCode::CONST: if (ins.arg >= _constants) {return false;} ++depth; break;
+        case OpCode::LOAD: if (ins.arg >= _slots) {return false;} ++depth; break;
+        case OpCode::STORE: if (ins.arg >= _slots || depth < 1) {return false;} break;
+        case OpCode::CALL:
+            if (ins.arg >= _functions || depth < ins.nargs) {return false;}
+            depth = depth - ins.nargs + 1;
+            break;
+        case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::POW:
+        case OpCode::EQ: case OpCode::NEQ: case OpCode::LESS: case OpCode::LEQ:
+        case OpCode::GREATER: case OpCode::GEQ: case OpCode::LAND: case OpCode::LOR:
+            if (depth < 2) {return false;}
+            --depth;
+            break;
+        case OpCode::NEG: case OpCode::NOT: case OpCode::SQR: case OpCode::BOOL:
+            if (depth < 1) {return false;}
+            break;
+        case OpCode::ADD_C: case OpCode::SUB_C: case OpCode::MUL_C: case OpCode::DIV_C:
+            if (ins.arg >= _constants || depth < 1) {return false;}
+            break;
+        case OpCode::ADD_L: case OpCode::SUB_L: case OpCode::MUL_L: case OpCode::DIV_L:
+            if (ins.arg >= _slots || depth < 1) {return false;}
+            break;
+        // The code after a JUMP is only reached through another jump
+        case OpCode::JUMP:
+            if (depth < 1 || !jump(i, ins.arg, depth)) {return false;}
+            live = false;
+            break;
+        case OpCode::JUMP_IF_NOT:
+            if (depth < 1 || !jump(i, ins.arg, depth - 1)) {return false;}
+            --depth;
+            break;
+        case OpCode::AND_JUMP: case OpCode::OR_JUMP:
+            if (depth < 1 || !jump(i, ins.arg, depth)) {return false;}
+            --depth;
+            break;
+        case OpCode::PICK: if (ins.arg >= depth) {return false;} ++depth; break;
+        case OpCode::RET:
+            if (i + 1 != _code.size() || depth < 1) {return false;}
+            break;
+        }
+        max = std::max(max, depth);
+    }
+
+    _stack_size = max + 1; // run() spills its cached top of stack once
+    return _code.back().op == OpCode::RET;
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <ibex/ibex.hpp>
+#include <cstdint>
+#include <span>
+
+namespace ibex
+{
+
+///==================
+/// Bytecode
+///==================
+
+enum class OpCode : uint8_t
+{
+    CONST, LOAD, STORE, CALL,
+    ADD, SUB, MUL, DIV, POW,
+    EQ, NEQ, LESS, LEQ, GREATER, GEQ,
+    LAND, LOR,
+    NEG, NOT, SQR,
+    ADD_C, SUB_C, MUL_C, DIV_C, // binary operator with a constant as right operand
+    ADD_L, SUB_L, MUL_L, DIV_L, // binary operator with a slot as right operand
+    JUMP, // to arg, ends the first branch of a conditional
+    JUMP_IF_NOT, // pops a condition and jumps to arg if it is zero
+    AND_JUMP, // leaves 0 and jumps to arg if the top is zero, pops it otherwise
+    OR_JUMP, // leaves 1 and jumps to arg if the top is not zero, pops it otherwise
+    BOOL, // 1 if the top is not zero, 0 otherwise
+    PICK, // pushes a copy of the arg-th entry from the bottom of the stack, a call computed once
+    RET
+};
+
+/// Fixed-width instruction. arg is a constant, slot or function index or the
+/// target of a jump depending on the opcode, nargs is the number of arguments of a CALL.
+/// Jumps only go forward, so evaluation always terminates.
+struct Instruction
+{
+    OpCode op = OpCode::RET;
+    uint8_t nargs = 0;
+    uint16_t arg = 0;
+
+    inline bool operator==(const Instruction& i) const {
+        return op == i.op && nargs == i.nargs && arg == i.arg;
+    }
+};
+static_assert(sizeof(Instruction) == 4);
+
+struct Bytecode
+{
+    std::vector<Instruction> code; // always terminated by RET
+    std::vector<double> constants;
+    size_t stack_size = 0; // number of stack entries run() needs
+};
+
+std::ostream& operator<<(std::ostream& os, const Instruction& ins);
+
+/// Maps a binary operator token to its opcode. Returns false for other tokens.
+bool binary_opcode(Token::Type _type, OpCode& _op);
+
+inline bool is_jump(OpCode _op) {return _op >= OpCode::JUMP && _op <= OpCode::OR_JUMP;}
+
+///==================
+/// Virtual Machine
+///==================
+
+/// Executes bytecode on a stack of scalars and returns the value left on top.
+/// slots holds the variable values and receives the results of STORE.
+/// stack must have room for at least Bytecode::stack_size entries.
+/// Instantiated for float, double and long double.
+template<typename T>
+T run(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, T* slots, T* stack);
+
+/// Same as above on a stack of _stack_size entries, which is on the native stack
+/// if it is small and otherwise a reused buffer.
+template<typename T>
+T execute(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, T* slots, size_t _stack_size);
+
+/// Slots that live elsewhere, slot i is *addresses[index[i]]. LOAD and STORE
+/// read and write that memory directly.
+template<typename T>
+struct IndirectSlots
+{
+    T* const* addresses;
+    const uint32_t* index;
+};
+
+/// Same as above with indirect slots. Instantiated for double.
+template<typename T>
+T execute(const Instruction* code, const T* constants, const BasicNativeImpl<T>* funcs, IndirectSlots<T> slots,
+          size_t _stack_size);
+
+/// Checks that bytecode is safe to run: constant, slot and function indices are in
+/// range, jumps go forward within the code, the stack never underflows, branches
+/// join with the same depth, PICK reads an entry below the top and the code ends
+/// with RET and at least one value, the result on top. Sets
+/// _stack_size to the number of stack entries run() needs.
+bool verify(std::span<const Instruction> _code, size_t _constants, size_t _slots, size_t _functions,
+            size_t& _stack_size);
+
+}
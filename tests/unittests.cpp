@@ -1,5 +1,26 @@
 #include <ibex/ibex.hpp>
+#include <ibex/compile.hpp>
+#include <ibex/batch.hpp>
+#include <ibex/optimize.hpp>
+#include <ibex/expression_set.hpp>
+#include <ibex/parallel.hpp>
+#include <ibex/cache.hpp>
+#include <ibex/table.hpp>
+#include <ibex/sheet.hpp>
+#include <ibex/autodiff.hpp>
+#include <ibex/static_expr.hpp>
+#include <ibex/profile.hpp>
+#include <ibex/archive.hpp>
+#include <ibex/symbols.hpp>
+#include <ibex/arrays.hpp>
+#include <ibex/memo.hpp>
 #include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numbers>
+#include <sstream>
+#include <thread>
 
 static constexpr double EPS = 1e-12;
 
@@ -22,6 +43,39 @@ TEST(TokensTest, ScientificTest)
     EXPECT_NEAR(eval("1e-12"), 1e-12, EPS);
 }
 
+TEST(TokensTest, TokenViewTest)
+{
+    const char* text = "x1 = 12345678901234567890123 * sin(2.5e-1) >= -y_2";
+    std::vector<TokenView> views;
+    ASSERT_TRUE(tokenize(text, views));
+
+    // Same tokens as the owning tokenizer, with lexemes pointing into the text
+    std::vector<Token> tokens = tokenize(text);
+    ASSERT_EQ(views.size(), tokens.size());
+    for (size_t i = 0; i < views.size(); ++i) {
+        EXPECT_EQ(views[i].type, tokens[i].type);
+        EXPECT_EQ(views[i].lexeme, tokens[i].lexeme);
+        EXPECT_GE(views[i].lexeme.data(), text);
+        EXPECT_LE(views[i].lexeme.data() + views[i].lexeme.size(), text + std::strlen(text));
+    }
+
+    // Literals are parsed by the tokenizer, large integers do not overflow
+    EXPECT_EQ(views[2].type, Token::Type::INT);
+    EXPECT_DOUBLE_EQ(views[2].value, 12345678901234567890123.0);
+    EXPECT_DOUBLE_EQ(views[6].value, 0.25);
+
+    // The buffer is reused
+    const TokenView* data = views.data();
+    ASSERT_TRUE(tokenize("1 + 2", views));
+    EXPECT_EQ(views.data(), data);
+    EXPECT_EQ(views.size(), 3);
+
+    EXPECT_FALSE(tokenize("1e", views));
+    EXPECT_TRUE(views.empty());
+    ASSERT_TRUE(tokenize("a |& b", views));
+    EXPECT_EQ(views[1].type, Token::Type::UNKNOWN);
+}
+
 TEST(PostfixTest, OnePlusTwoTest)
 {
     Token one{Token::Type::INT, "1", 0};
@@ -30,6 +84,27 @@ TEST(PostfixTest, OnePlusTwoTest)
     EXPECT_EQ(generate_postfix(tokenize("1 + 2")), std::vector<Token>({one, two, plus}));
 }
 
+TEST(PostfixTest, TokenViewTest)
+{
+    for (const char* text : {"1 + 2", "-x^2 + max(a, b, -c) * (d = 3)", "f()", "!(a || b) && c <= 2"}) {
+        std::vector<TokenView> tokens, postfix;
+        ASSERT_TRUE(tokenize(text, tokens));
+        ASSERT_TRUE(generate_postfix(tokens, postfix));
+        std::vector<Token> expected = generate_postfix(tokenize(text));
+        ASSERT_EQ(postfix.size(), expected.size()) << text;
+        for (size_t i = 0; i < postfix.size(); ++i) {
+            EXPECT_EQ(postfix[i].type, expected[i].type);
+            EXPECT_EQ(postfix[i].lexeme, expected[i].lexeme);
+            EXPECT_EQ(postfix[i].metadata, expected[i].metadata);
+        }
+    }
+
+    std::vector<TokenView> tokens, postfix;
+    ASSERT_TRUE(tokenize("(1 + 2", tokens));
+    EXPECT_FALSE(generate_postfix(tokens, postfix));
+    EXPECT_TRUE(postfix.empty());
+}
+
 TEST(PipelineTest, SimplePipelineTest1)
 {
     EXPECT_NEAR(eval("2^3^2"), 512, EPS);
@@ -41,6 +116,8 @@ TEST(PipelineTest, SimplePipelineTest1)
     EXPECT_NEAR(eval("1-0.99"), 0.01, EPS);
     EXPECT_NEAR(eval("-12.5"), -12.5, EPS);
     EXPECT_NEAR(eval("--13.5"), 13.5, EPS);
+    EXPECT_NEAR(eval("2^-1"), 0.5, EPS);
+    EXPECT_NEAR(eval("-2^2"), -4, EPS);
 }
 
 TEST(PipelineTest, AssignmentTest)
@@ -64,6 +141,38 @@ TEST(PipelineTest, FunctionsTest)
     EXPECT_NEAR(eval("pow(3,2)"), 9, EPS);
 }
 
+static double half(double x) {return x / 2;}
+
+TEST(PipelineTest, NativeFunctionsTest)
+{
+    Variables vars;
+    Functions funcs;
+    funcs["half"] = half;
+    funcs["hypot"] = pure([](double x, double y) {return std::hypot(x, y);});
+    funcs["diff"] = fixed<2>([](auto x, auto y) {return x - y;});
+    funcs["sum"] = [](FunctionArgsView args) {
+        double sum = 0.0;
+        for (double arg : args) {sum += arg;}
+        return sum;
+    };
+    EXPECT_EQ(funcs["half"].arity, 1);
+    EXPECT_EQ(funcs["hypot"].arity, 2);
+    EXPECT_TRUE(funcs["hypot"].pure);
+    EXPECT_EQ(funcs["diff"].arity, 2);
+    EXPECT_EQ(funcs["sum"].arity, -1);
+    EXPECT_EQ(common_functions()["sin"].arity, 1);
+    EXPECT_EQ(common_functions()["max"].arity, -1);
+
+    EXPECT_NEAR(eval("half(hypot(3, 4)) + diff(5, 7) + sum(1, 2, 3) + sum()", vars, funcs), 6.5, EPS);
+
+    // The arity is checked when compiling, before any call
+    EXPECT_TRUE(std::isnan(eval("half(1, 2)", vars, funcs)));
+    EXPECT_TRUE(std::isnan(eval("sin()")));
+    EXPECT_FALSE(compile("pow(2)").valid());
+    EXPECT_EQ(ExpressionSet().add("sqrt(1, 2)"), -1);
+    EXPECT_EQ(optimize(generate_postfix(tokenize("sin(1, 2)")), common_functions()).size(), 3);
+}
+
 TEST(PipelineTest, ArgMaxTest)
 {
     Variables vars = common_variables();
@@ -98,8 +207,1432 @@ TEST(PipelineTest, SimplePipelineTest2)
     EXPECT_NEAR(eval("(1 + 1/10000)^10000"), 2.71814592682, 1e-6);
 }
 
+TEST(CompileTest, MatchesEvalTest)
+{
+    for (const char* text : {"2^3^2", "3/(2*(10-4))", "--13.5", "max(4,-7,2,4)", "5 <= 5 && 5 != 7",
+                             "(1 + 1/10000)^10000", "pow(3,2)", "1e-12", "pi"}) {
+        Variables vars = common_variables();
+        CompiledExpression expr = compile(text);
+        ASSERT_TRUE(expr.valid()) << text;
+        std::vector<double> values = expr.bind(vars);
+        EXPECT_NEAR(expr.evaluate(values), eval(text), EPS) << text;
+    }
+}
+
+TEST(CompileTest, SlotsTest)
+{
+    CompiledExpression expr = compile("a*x^2 + b*x + c");
+    ASSERT_EQ(expr.slots(), std::vector<std::string>({"a", "x", "b", "c"}));
+    EXPECT_EQ(expr.slot("x"), 1);
+    EXPECT_EQ(expr.slot("y"), -1);
+
+    std::vector<double> values = {2, 3, 4, 5};
+    EXPECT_NEAR(expr.evaluate(values), 35, EPS);
+    values[1] = -1;
+    EXPECT_NEAR(expr.evaluate(values), 3, EPS);
+}
+
+TEST(CompileTest, AssignmentTest)
+{
+    Variables vars = common_variables();
+    CompiledExpression expr = compile("x = (y = 42) + 1");
+    ASSERT_TRUE(expr.valid());
+    std::vector<double> values = expr.bind(vars);
+    EXPECT_NEAR(expr.evaluate(values), 43, EPS);
+    expr.unbind(values, vars);
+    EXPECT_NEAR(vars["y"], 42, EPS);
+    EXPECT_NEAR(vars["x"], 43, EPS);
+
+    EXPECT_FALSE(compile("1 = 2").valid());
+    EXPECT_FALSE(compile("(1+2").valid());
+}
+
+TEST(CompileTest, RecompileTest)
+{
+    // Text does not need to be null terminated, e.g. a line of a larger buffer
+    std::string_view lines = "x = 3\nx * 2\n1 +\n";
+    Variables vars;
+    Functions funcs = common_functions();
+    CompiledExpression expr;
+    ASSERT_TRUE(compile(lines.substr(0, 5), funcs, expr));
+    EXPECT_NEAR(expr.evaluate(vars), 3, EPS);
+    ASSERT_TRUE(compile(lines.substr(6, 5), funcs, expr));
+    EXPECT_NEAR(expr.evaluate(vars), 6, EPS);
+    EXPECT_FALSE(compile(lines.substr(12, 3), funcs, expr));
+    EXPECT_FALSE(expr.valid());
+}
+
+TEST(VmTest, FusedOperatorsTest)
+{
+    CompiledExpression expr = compile("x/2 - y");
+    const auto& code = expr.bytecode().code;
+    ASSERT_EQ(code.size(), 4);
+    EXPECT_EQ(code[0].op, OpCode::LOAD);
+    EXPECT_EQ(code[1].op, OpCode::DIV_C);
+    EXPECT_EQ(code[2].op, OpCode::SUB_L);
+    EXPECT_EQ(code[3].op, OpCode::RET);
+
+    std::vector<double> values = {5, 0.5};
+    EXPECT_NEAR(expr.evaluate(values), 2, EPS);
+}
+
+TEST(VmTest, DeepStackTest)
+{
+    std::string text = "1";
+    for (int i = 0; i < 100; ++i) {text = "1+(" + text + ")";}
+    CompiledExpression expr = compile(text.c_str());
+    EXPECT_GT(expr.bytecode().stack_size, 100);
+    EXPECT_NEAR(expr.evaluate({}), 101, EPS);
+}
+
+TEST(VmTest, ReentrantTest)
+{
+    CompiledExpression inner = compile("max(a, 2*a)");
+    Functions funcs = common_functions();
+    funcs["twice"] = [&](const FunctionArgs& args) -> double {
+        std::vector<double> values = {args[0]};
+        return inner.evaluate(values);
+    };
+    CompiledExpression outer = compile("min(twice(3), 10, twice(4))", funcs);
+    EXPECT_NEAR(outer.evaluate({}), 6, EPS);
+}
+
+TEST(BatchTest, MatchesEvaluateTest)
+{
+    const size_t nrows = 1000;
+    std::vector<double> x(nrows), y(nrows);
+    for (size_t i = 0; i < nrows; ++i) {
+        x[i] = 0.25 * i - 100.0;
+        y[i] = (i % 7 == 0) ? 0.0 : std::sin(0.1 * i);
+    }
+    x[17] = std::numeric_limits<double>::quiet_NaN();
+
+    for (const char* text : {"x + 2*y", "x - y", "x/y", "x^2 - y^3", "(x < y) + (x <= 1) + (x > y) + (x >= 0)",
+                             "x == y || y != 0", "x && !y", "-x*y - (-y)", "max(x, y, 1) + sqrt(abs(y))",
+                             "(z = x*y) + z", "x - (z = 2) + z"}) {
+        CompiledExpression expr = compile(text);
+        ASSERT_TRUE(expr.valid()) << text;
+        Columns columns = {{"x", x}, {"y", y}};
+        for (size_t n : {0, 1, 3, 255, 256, 257, 1000}) {
+            std::vector<double> out(n);
+            ASSERT_TRUE(evaluate_batch(expr, columns, out)) << text;
+            for (size_t i = 0; i < n; ++i) {
+                std::vector<double> values = expr.bind({{"x", x[i]}, {"y", y[i]}});
+                double expected = expr.evaluate(values);
+                if (std::isnan(expected)) {EXPECT_TRUE(std::isnan(out[i])) << text << " row " << i;}
+                else if (std::isinf(expected)) {EXPECT_EQ(out[i], expected) << text << " row " << i;}
+                else {EXPECT_NEAR(out[i], expected, EPS) << text << " row " << i;}
+            }
+        }
+    }
+}
+
+TEST(BatchTest, MissingColumnTest)
+{
+    CompiledExpression expr = compile("x + y");
+    std::vector<double> x = {1, 2, 3};
+    std::vector<double> out(3);
+    EXPECT_FALSE(evaluate_batch(expr, Columns{{"x", x}}, out));
+    EXPECT_TRUE(std::isnan(out[0]));
+}
+
+TEST(OptimizeTest, ConstantFoldingTest)
+{
+    Functions funcs = common_functions();
+    OptimizeStats stats;
+    std::vector<Token> postfix = optimize(generate_postfix(tokenize("(1 + 1/10000)^10000")), funcs, {}, &stats);
+    ASSERT_EQ(postfix.size(), 1);
+    EXPECT_NEAR(eval_postfix(postfix), eval("(1 + 1/10000)^10000"), EPS);
+    EXPECT_EQ(stats.nodes_before, 7);
+    EXPECT_EQ(stats.removed(), 6);
+
+    postfix = optimize(generate_postfix(tokenize("2*pi*r + max(sin(0), 1)")), funcs, common_variables());
+    ASSERT_EQ(postfix.size(), 5);
+    EXPECT_EQ(postfix[1].lexeme, "r");
+    Variables vars = {{"r", 2}};
+    EXPECT_NEAR(eval_postfix(postfix, vars, funcs), 4*M_PI + 1, EPS);
+}
+
+TEST(OptimizeTest, IdentitiesTest)
+{
+    Functions funcs = common_functions();
+    for (const char* text : {"x+0", "0+x", "x-0", "x*1", "1*x", "x/1", "x^1", "--x", "+x", "(x*(3-2))^(0+1)"}) {
+        std::vector<Token> postfix = optimize(generate_postfix(tokenize(text)), funcs);
+        EXPECT_EQ(postfix, generate_postfix(tokenize("x"))) << text;
+    }
+}
+
+TEST(OptimizeTest, StrengthReductionTest)
+{
+    Functions funcs = common_functions();
+    OptimizeStats stats;
+    EXPECT_EQ(optimize(generate_postfix(tokenize("x^2")), funcs, {}, &stats), generate_postfix(tokenize("x*x")));
+    EXPECT_EQ(stats.strength_reduced, 1);
+    EXPECT_EQ(optimize(generate_postfix(tokenize("x^3")), funcs), generate_postfix(tokenize("x*x*x")));
+    EXPECT_EQ(optimize(generate_postfix(tokenize("x^-1")), funcs), generate_postfix(tokenize("1/x")));
+    EXPECT_EQ(optimize(generate_postfix(tokenize("sin(x)^0")), funcs).size(), 1);
+
+    // (x+1)^2 keeps its power, which the compiler turns into SQR
+    CompiledExpression expr = compile(optimize(generate_postfix(tokenize("(x+1)^2")), funcs), funcs);
+    EXPECT_EQ(expr.bytecode().code[2].op, OpCode::SQR);
+    std::vector<double> values = {2};
+    EXPECT_NEAR(expr.evaluate(values), 9, EPS);
+}
+
+TEST(OptimizeTest, SideEffectsTest)
+{
+    Functions funcs = common_functions();
+    funcs["next"] = [](const FunctionArgs& args) -> double {return args[0] + 1;};
+
+    // Impure calls and assigned variables are kept
+    EXPECT_EQ(optimize(generate_postfix(tokenize("next(1)")), funcs).size(), 2);
+    EXPECT_EQ(optimize(generate_postfix(tokenize("(pi = 3) + pi")), funcs, common_variables()).size(), 5);
+    EXPECT_EQ(optimize(generate_postfix(tokenize("(x = 2)^0")), funcs).size(), 5);
+
+    // Calls without arguments or that fail are not folded, they fail when they run
+    static int reported = 0;
+    funcs["checked"] = Function([](double v) {return v < 0 ? function_error(ErrorCode::INVALID_EXPRESSION, "checked") : v;},
+                                true);
+    set_diagnostics_sink([](const Error&) {++reported;});
+    std::vector<Token> postfix = optimize(generate_postfix(tokenize("c ? max() : 1")), funcs);
+    set_diagnostics_sink(nullptr);
+    EXPECT_EQ(reported, 0);
+    EXPECT_EQ(postfix, generate_postfix(tokenize("c ? max() : 1")));
+    EXPECT_EQ(optimize(generate_postfix(tokenize("checked(-1)")), funcs).size(), 2);
+    EXPECT_EQ(optimize(generate_postfix(tokenize("checked(2)")), funcs).size(), 1);
+    Variables vars = {{"c", 1}};
+    EXPECT_EQ(compile(postfix, funcs).try_evaluate(vars).error.code, ErrorCode::WRONG_ARGUMENT_COUNT);
+}
+
+TEST(OptimizeTest, MatchesEvalTest)
+{
+    Functions funcs = common_functions();
+    for (const char* text : {"2^3^2", "2+3*4", "3/(2*(10-4))", "--13.5", "-12.5", "max(4,-7,2,4)", "tan(x = pi)",
+                             "x = (y = 42) + 1", "5 <= 5 && 5 != 7", "0 || 1", "pow(2,3)", "1-0.99", "1e-12"}) {
+        Variables vars = common_variables();
+        Variables optimizedVars = common_variables();
+        std::vector<Token> postfix = optimize(generate_postfix(tokenize(text)), funcs, common_variables());
+        EXPECT_NEAR(eval_postfix(postfix, optimizedVars, funcs), eval(text, vars, funcs), EPS) << text;
+        EXPECT_EQ(optimizedVars, vars) << text;
+    }
+}
+
+TEST(OptimizeTest, DeepExpressionTest)
+{
+    // A left-leaning sum is as deep as it is long
+    std::string text = "1";
+    for (int i = 0; i < 100000; ++i) {text += "+x";}
+    Functions funcs = common_functions();
+    std::vector<Token> postfix = generate_postfix(tokenize(text.c_str()));
+    std::vector<Token> optimized = optimize(postfix, funcs);
+    EXPECT_EQ(optimized, postfix);
+
+    CompiledExpression expr;
+    ASSERT_TRUE(specialize(postfix, funcs, {{"x", 2}}, expr));
+    EXPECT_TRUE(expr.slots().empty());
+    EXPECT_EQ(expr.evaluate({}), 200001);
+}
+
+TEST(ExpressionSetTest, SharedSubexpressionsTest)
+{
+    const char* texts[] = {"sqrt(x*x+y*y)", "2*sqrt(x*x+y*y)", "exp(-t/tau) + sqrt(x*x+y*y)", "exp(-t/tau)*x"};
+    ExpressionSet set;
+    for (const char* text : texts) {EXPECT_GE(set.add(text), 0);}
+    ASSERT_EQ(set.size(), 4);
+    EXPECT_EQ(set.nodes(), 15);
+    EXPECT_EQ(set.shared(), 24);
+
+    Variables vars = {{"x", 3}, {"y", 4}, {"t", 1}, {"tau", 2}};
+    std::vector<double> values = set.bind(vars);
+    std::vector<double> out(set.size());
+    set.evaluate(values, out);
+    Functions funcs = common_functions();
+    for (size_t i = 0; i < set.size(); ++i) {
+        EXPECT_NEAR(out[i], eval(texts[i], vars, funcs), EPS) << texts[i];
+    }
+}
+
+TEST(ExpressionSetTest, ImpureFunctionsTest)
+{
+    int calls = 0;
+    Functions funcs = common_functions();
+    funcs["tick"] = [&](const FunctionArgs&) -> double {return ++calls;};
+    funcs["half"] = pure([&](const FunctionArgs& args) -> double {++calls; return args[0] / 2;});
+
+    ExpressionSet set(funcs);
+    set.add("tick() + half(x)");
+    set.add("tick() + half(x)");
+    std::vector<double> values = {8};
+    std::vector<double> out(2);
+    set.evaluate(values, out);
+    EXPECT_EQ(calls, 3);
+    EXPECT_NEAR(out[0], 5, EPS);
+    EXPECT_NEAR(out[1], 7, EPS);
+}
+
+TEST(ExpressionSetTest, AssignmentTest)
+{
+    ExpressionSet set;
+    set.add("x + 1");
+    set.add("x = 5");
+    set.add("x + 1");
+    EXPECT_EQ(set.add("1 +"), -1);
+    EXPECT_EQ(set.size(), 3);
+
+    Variables vars = {{"x", 1}};
+    std::vector<double> values = set.bind(vars);
+    std::vector<double> out(set.size());
+    set.evaluate(values, out);
+    EXPECT_NEAR(out[0], 2, EPS);
+    EXPECT_NEAR(out[1], 5, EPS);
+    EXPECT_NEAR(out[2], 6, EPS);
+    set.unbind(values, vars);
+    EXPECT_NEAR(vars["x"], 5, EPS);
+
+    // The right operand of && and || would always run, so it may not have side effects
+    Functions funcs = common_functions();
+    funcs["tick"] = [](const FunctionArgs&) -> double {return 1;};
+    ExpressionSet eager(funcs);
+    Error error;
+    EXPECT_EQ(eager.add("0 && (x = 1)", &error), -1);
+    EXPECT_EQ(error.code, ErrorCode::UNSUPPORTED);
+    EXPECT_EQ(eager.add("1 || tick()", &error), -1);
+    EXPECT_EQ(eager.add("(x = 1) || x > 0 && -sqrt(x)"), 0);
+    EXPECT_EQ(eager.size(), 1);
+}
+
+TEST(ParallelTest, ThreadPoolTest)
+{
+    ThreadPool pool(4);
+    EXPECT_EQ(pool.size(), 4);
+
+    // Every task runs exactly once, also when runs follow each other
+    for (size_t threads : {0, 1, 2, 4}) {
+        std::vector<std::atomic<int>> counts(1000);
+        pool.run(counts.size(), [&](size_t i) {++counts[i];}, threads);
+        for (const auto& count : counts) {EXPECT_EQ(count, 1);}
+    }
+
+    // Tasks that run on the same pool again do not wait for themselves
+    std::vector<std::atomic<int>> counts(64);
+    pool.run(8, [&](size_t i) {
+        pool.run(8, [&](size_t k) {++counts[i * 8 + k];});
+    });
+    for (const auto& count : counts) {EXPECT_EQ(count, 1);}
+}
+
+TEST(ParallelTest, EvaluateTest)
+{
+    CompiledExpression expr = compile("z = sqrt(x*x + y*y) + z");
+    CompiledExpression other = compile("x < y");
+    ASSERT_TRUE(expr.valid());
+
+    const size_t rows = 10007;
+    std::vector<double> x(rows), y(rows), z(rows);
+    for (size_t i = 0; i < rows; ++i) {x[i] = i * 0.5; y[i] = 100.0 - i; z[i] = i % 7;}
+    std::vector<std::span<const double>> columns = {z, x, y};
+    std::vector<std::span<const double>> otherColumns = {x, y};
+
+    std::vector<double> expected(rows), expectedOther(rows);
+    evaluate_batch(expr, columns, expected);
+    evaluate_batch(other, otherColumns, expectedOther);
+
+    ThreadPool pool(3);
+    for (size_t chunk : {1, 100, 4096, 100000}) {
+        std::vector<double> out(rows), outOther(rows);
+        BatchJob jobs[] = {{&expr, columns, out}, {&other, otherColumns, outOther}};
+        ASSERT_TRUE(evaluate_parallel(jobs, {.chunk_size = chunk, .pool = &pool}));
+        EXPECT_EQ(out, expected);
+        EXPECT_EQ(outOther, expectedOther);
+    }
+
+    // A function may evaluate in parallel on the pool it is called from
+    Functions funcs = common_functions();
+    funcs["total"] = [&](double scale) {
+        std::vector<double> sums(rows);
+        std::vector<std::span<const double>> inner = {x, y};
+        evaluate_parallel(other, inner, sums, {.chunk_size = 1000});
+        return scale * std::count(sums.begin(), sums.end(), 1.0);
+    };
+    CompiledExpression nested = compile("total(x)", funcs);
+    std::vector<double> scales(8, 2.0), totals(8);
+    std::vector<std::span<const double>> scaleColumns = {scales};
+    ASSERT_TRUE(evaluate_parallel(nested, scaleColumns, totals, {.chunk_size = 1}));
+    const double expectedTotal = 2.0 * std::count(expectedOther.begin(), expectedOther.end(), 1.0);
+    for (double total : totals) {EXPECT_EQ(total, expectedTotal);}
+
+    // Mismatching columns are rejected before anything runs
+    std::vector<double> out(rows + 1);
+    EXPECT_FALSE(evaluate_parallel(expr, columns, out, {.pool = &pool}));
+    EXPECT_TRUE(std::isnan(out[0]));
+}
+
+TEST(CacheTest, HitsAndEvictionsTest)
+{
+    ExpressionCache cache(2, 1 << 20, 1);
+    Variables vars = {{"x", 2}};
+    EXPECT_NEAR(cache.eval("x + 1", vars), 3, EPS);
+    EXPECT_NEAR(cache.eval("x + 1", vars), 3, EPS);
+    EXPECT_NEAR(cache.eval("y = x * 4", vars), 8, EPS);
+    EXPECT_NEAR(vars["y"], 8, EPS);
+    EXPECT_TRUE(std::isnan(cache.eval("x +", vars)));
+
+    // "y = x * 4" was the least recently used entry
+    CacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.misses, 3);
+    EXPECT_EQ(stats.evictions, 1);
+    EXPECT_EQ(stats.entries, 2);
+    EXPECT_GT(stats.bytes, 0);
+
+    // Evicted expressions stay usable
+    std::shared_ptr<const CompiledExpression> expr = cache.get("x * x");
+    cache.clear();
+    EXPECT_EQ(cache.stats().entries, 0);
+    EXPECT_EQ(cache.stats().bytes, 0);
+    EXPECT_NEAR(expr->evaluate(vars), 4, EPS);
+    EXPECT_EQ(cache.get("x * x"), cache.get("x * x"));
+
+    // Capacity that does not divide by the number of shards is not lost
+    ExpressionCache uneven(5, 1 << 20, 4);
+    for (int i = 0; i < 200; ++i) {uneven.get("x + " + std::to_string(i));}
+    EXPECT_EQ(uneven.stats().entries, 5);
+}
+
+TEST(CacheTest, BytesAndThreadsTest)
+{
+    // Room for about one expression per shard
+    ExpressionCache small(1000, 2 * 400, 2);
+    for (int i = 0; i < 20; ++i) {small.get("x + " + std::to_string(i));}
+    EXPECT_LE(small.stats().bytes, small.max_bytes());
+    EXPECT_GE(small.stats().evictions, 16);
+
+    ExpressionCache cache(64);
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong = 0;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 2000; ++i) {
+                int k = (i * 7 + t) % 100;
+                Variables vars = {{"x", 1.0 * k}};
+                if (cache.eval("x * 2 + " + std::to_string(k), vars) != 3.0 * k) {++wrong;}
+            }
+        });
+    }
+    for (std::thread& thread : threads) {thread.join();}
+    EXPECT_EQ(wrong, 0);
+    CacheStats stats = cache.stats();
+    EXPECT_EQ(stats.hits + stats.misses, 8000);
+    EXPECT_LE(stats.entries, 64);
+
+    // Threads that compile the same text at once count one miss
+    ExpressionCache shared;
+    threads.clear();
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 200; ++i) {shared.get("x * 3 + " + std::to_string(i % 50));}
+        });
+    }
+    for (std::thread& thread : threads) {thread.join();}
+    stats = shared.stats();
+    EXPECT_EQ(stats.misses, 50);
+    EXPECT_EQ(stats.hits, 750);
+    EXPECT_EQ(stats.entries, 50);
+}
+
+TEST(TableTest, CsvTest)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "ibex_table_test.csv").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "name, x,y ,unused\n"
+             << "a,1,2,x\r\n"
+             << "\"b, quoted\",3,\"4\",\"line\nbreak\"\n"
+             << "\n"
+             << "c,5,oops\n"
+             << "d,7";
+    }
+
+    // Chunks smaller than the table still give every row once, in order
+    for (size_t chunk : {1, 2, 100}) {
+        std::vector<double> out;
+        size_t calls = 0;
+        TableSink sink = [&](std::span<const double> values) {
+            out.insert(out.end(), values.begin(), values.end());
+            ++calls;
+        };
+        ASSERT_TRUE(evaluate_table(compile("z = x * 10 + y"), path.c_str(), sink, {.chunk_rows = chunk}));
+        ASSERT_EQ(out.size(), 4);
+        EXPECT_NEAR(out[0], 12, EPS);
+        EXPECT_NEAR(out[1], 34, EPS);
+        EXPECT_TRUE(std::isnan(out[2]));
+        EXPECT_TRUE(std::isnan(out[3]));
+        EXPECT_EQ(calls, (4 + chunk - 1) / chunk);
+    }
+
+    // With a single column an empty line is a row with an empty field
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "x\n1\n\n3\r\n\r\n5\n";
+    }
+    std::vector<double> column;
+    ASSERT_TRUE(evaluate_table(compile("x + 1"), path.c_str(), [&](std::span<const double> values) {
+        column.insert(column.end(), values.begin(), values.end());
+    }));
+    ASSERT_EQ(column.size(), 5);
+    EXPECT_NEAR(column[0], 2, EPS);
+    EXPECT_TRUE(std::isnan(column[1]));
+    EXPECT_NEAR(column[2], 4, EPS);
+    EXPECT_TRUE(std::isnan(column[3]));
+    EXPECT_NEAR(column[4], 6, EPS);
+
+    TableSink ignore = [](std::span<const double>) {};
+    EXPECT_FALSE(evaluate_table(compile("x + w"), path.c_str(), ignore));
+    EXPECT_FALSE(evaluate_table(compile("x"), "/nonexistent/ibex.csv", ignore));
+    std::filesystem::remove(path);
+}
+
+TEST(TableTest, BinaryTest)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "ibex_table_test.bin").string();
+    const size_t rows = 1000;
+    std::vector<double> data(3 * rows);
+    for (size_t i = 0; i < rows; ++i) {data[i] = i; data[rows + i] = 2.0 * i; data[2 * rows + i] = -1;}
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(double));
+    }
+
+    std::vector<double> out;
+    TableSink sink = [&](std::span<const double> values) {out.insert(out.end(), values.begin(), values.end());};
+    TableOptions options{.format = TableFormat::BINARY, .columns = {"a", "b", "c"}, .chunk_rows = 300};
+    ASSERT_TRUE(evaluate_table(compile("b - a*c"), path.c_str(), sink, options));
+    ASSERT_EQ(out.size(), rows);
+    for (size_t i = 0; i < rows; ++i) {EXPECT_NEAR(out[i], 3.0 * i, EPS);}
+
+    // The size must match the number of columns
+    options.columns = {"a", "b", "c", "d", "e", "f", "g"};
+    EXPECT_FALSE(evaluate_table(compile("a"), path.c_str(), sink, options));
+    std::filesystem::remove(path);
+}
+
+TEST(SheetTest, UpdateTest)
+{
+    Sheet sheet;
+    // Statements may come before the statements assigning their inputs
+    EXPECT_EQ(sheet.add("total = net + tax"), 0);
+    EXPECT_EQ(sheet.add("tax = net * rate"), 1);
+    EXPECT_EQ(sheet.add("net = (gross = price * qty) - discount"), 2);
+    EXPECT_EQ(sheet.add("other = scale * 2"), 3);
+    EXPECT_TRUE(sheet.set("price", 10));
+    EXPECT_TRUE(sheet.set("qty", 3));
+    EXPECT_TRUE(sheet.set("discount", 5));
+    EXPECT_TRUE(sheet.set("rate", 0.2));
+    EXPECT_TRUE(sheet.set("scale", 1));
+    EXPECT_EQ(sheet.update(), 4);
+    EXPECT_NEAR(sheet.get("gross"), 30, EPS);
+    EXPECT_NEAR(sheet.get("total"), 30, EPS);
+    EXPECT_NEAR(sheet.result(0), 30, EPS);
+    EXPECT_EQ(sheet.update(), 0);
+
+    // Only statements depending on a changed input are evaluated
+    sheet.set("rate", 0.5);
+    EXPECT_EQ(sheet.update(), 2);
+    EXPECT_NEAR(sheet.get("total"), 37.5, EPS);
+    sheet.set("scale", 4);
+    EXPECT_EQ(sheet.update(), 1);
+    EXPECT_NEAR(sheet.get("other"), 8, EPS);
+
+    // Unchanged assignments stop the propagation
+    sheet.set(Variables{{"price", 5}, {"qty", 6}, {"total", 100}, {"unknown", 1}});
+    EXPECT_EQ(sheet.update(), 1);
+    EXPECT_NEAR(sheet.get("total"), 37.5, EPS);
+
+    Variables vars;
+    sheet.unbind(vars);
+    EXPECT_NEAR(vars["net"], 25, EPS);
+    EXPECT_EQ(vars.count("unknown"), 0);
+}
+
+TEST(SheetTest, RejectTest)
+{
+    Sheet sheet;
+    EXPECT_EQ(sheet.add("b = a + 1"), 0);
+    EXPECT_EQ(sheet.add("c = b * 2"), 1);
+    EXPECT_EQ(sheet.add("a = c - 1"), -1); // cycle through b and c
+    EXPECT_EQ(sheet.add("d = d + 1"), -1);
+    EXPECT_EQ(sheet.add("b = 3"), -1); // already assigned
+    EXPECT_EQ(sheet.add("e = "), -1);
+    EXPECT_FALSE(sheet.set("c", 1));
+    EXPECT_EQ(sheet.size(), 2);
+
+    sheet.set("a", 1);
+    EXPECT_EQ(sheet.update(), 2);
+    EXPECT_NEAR(sheet.get("c"), 4, EPS);
+    EXPECT_TRUE(std::isnan(sheet.get("e")));
+}
+
+TEST(AutodiffTest, GradientTest)
+{
+    // Every operator and common function against its derivative by hand
+    CompiledExpression expr = compile("x*y - x/y + x^y + -x + (x+1)*(y-2)/3 + sin(x)*cos(y) + tan(x) + exp(y)"
+                                      " + log(x) + ln(y) + log2(x) + sqrt(y) + pow(y, x) + abs(-x) + max(x, y, 1)"
+                                      " + min(x, 0) + (x < y) + !x + y^2");
+    ASSERT_TRUE(expr.valid());
+    const double x = 1.3, y = 2.1;
+    const double dx = y - 1/y + y*std::pow(x, y - 1) - 1 + (y-2)/3 + std::cos(x)*std::cos(y)
+                      + 1/(std::cos(x)*std::cos(x)) + 1/x + 1/(x*std::log(2)) + std::pow(y, x)*std::log(y) + 1;
+    const double dy = x + x/(y*y) + std::pow(x, y)*std::log(x) + (x+1)/3 - std::sin(x)*std::sin(y)
+                      + std::exp(y) + 1/y + 0.5/std::sqrt(y) + x*std::pow(y, x - 1) + 1 + 2*y;
+
+    std::vector<double> values(2), partials(2), direction(2);
+    values[expr.slot("x")] = x;
+    values[expr.slot("y")] = y;
+    const double expected = expr.evaluate(values);
+    EXPECT_NEAR(gradient(expr, values, partials), expected, EPS);
+    EXPECT_NEAR(partials[expr.slot("x")], dx, 1e-9);
+    EXPECT_NEAR(partials[expr.slot("y")], dy, 1e-9);
+
+    // Forward mode agrees
+    direction[expr.slot("x")] = 1;
+    Dual dual = derivative(expr, values, direction);
+    EXPECT_NEAR(dual.value, expected, EPS);
+    EXPECT_NEAR(dual.derivative, dx, 1e-9);
+    direction = {1, 1};
+    EXPECT_NEAR(derivative(expr, values, direction).derivative, dx + dy, 1e-9);
+}
+
+TEST(AutodiffTest, AssignmentsAndFunctionsTest)
+{
+    // Derivatives flow through assigned variables
+    Variables vars = {{"x", 3}}, partials;
+    CompiledExpression expr = compile("(y = x*x) + y*x");
+    EXPECT_NEAR(gradient(expr, vars, partials), 36, EPS);
+    EXPECT_NEAR(vars["y"], 9, EPS);
+    EXPECT_NEAR(partials["x"], 6 + 27, EPS);
+    EXPECT_EQ(partials.count("y"), 0);
+
+    // Registered derivatives are used as given, others are approximated
+    Functions funcs = common_functions();
+    funcs["cube"] = differentiable([](double v) {return v*v*v;}, [](FunctionArgsView args, std::span<double> d) {
+        d[0] = 3*args[0]*args[0];
+    });
+    funcs["wrong"] = differentiable([](double v) {return v;}, [](FunctionArgsView, std::span<double> d) {d[0] = 7;});
+    funcs["hypot"] = [](double a, double b) {return std::hypot(a, b);};
+    expr = compile("cube(x) + wrong(x) + hypot(x, 4)", funcs);
+    ASSERT_TRUE(expr.valid());
+    std::vector<double> values = {3}, grad(1), direction = {1};
+    gradient(expr, values, grad);
+    EXPECT_NEAR(grad[0], 27 + 7 + 3.0/5, 1e-8);
+    EXPECT_NEAR(derivative(expr, values, direction).derivative, grad[0], 1e-8);
+
+    EXPECT_TRUE(std::isnan(gradient(compile("x +"), values, grad)));
+
+    // Spans shorter than the slots are rejected instead of overrun
+    expr = compile("x*y + z");
+    std::vector<double> three = {1, 2, 3}, one(1, 0.0);
+    EXPECT_TRUE(std::isnan(gradient(expr, three, one)));
+    EXPECT_TRUE(std::isnan(one[0]));
+    EXPECT_TRUE(std::isnan(gradient(expr, one, three)));
+    EXPECT_TRUE(std::isnan(derivative(expr, three, one).value));
+    EXPECT_TRUE(std::isnan(derivative(expr, one, three).derivative));
+}
+
 int main(int argc, char** argv)
 {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
+
+TEST(ConditionalTest, ShortCircuitTest)
+{
+    EXPECT_EQ(eval("1 < 2 ? 3 : 4"), 3);
+    EXPECT_EQ(eval("0 ? 3 : 1 ? 5 : 6"), 5);
+    EXPECT_EQ(eval("1 ? 0 ? 5 : 6 : 7"), 6);
+    EXPECT_EQ(eval("if(2 > 3, 1, -1) * 2"), -2);
+    EXPECT_EQ(eval("2 && 3"), 1);
+    EXPECT_EQ(eval("0 || -2"), 1);
+    EXPECT_TRUE(std::isnan(eval("1 ? 2")));
+    EXPECT_TRUE(std::isnan(eval("1 : 2")));
+
+    // The right operand and the branch not taken are not evaluated
+    int calls = 0;
+    Functions funcs = common_functions();
+    funcs["count"] = [&](FunctionArgsView) {return ++calls;};
+    CompiledExpression expr = compile("(x && count()) + (x || count()) + (x ? count() : -count())", funcs);
+    ASSERT_TRUE(expr.valid());
+    std::vector<double> values = {0};
+    EXPECT_EQ(expr.evaluate(values), 0 + 1 - 2);
+    EXPECT_EQ(calls, 2);
+    values[0] = 1;
+    EXPECT_EQ(expr.evaluate(values), 1 + 1 + 4);
+    EXPECT_EQ(calls, 4);
+
+    // The optimizer keeps the semantics
+    Variables vars;
+    EXPECT_EQ(optimize(generate_postfix(tokenize("0 && (y = 1)")), funcs), generate_postfix(tokenize("0")));
+    EXPECT_EQ(optimize(generate_postfix(tokenize("1 < 2 ? x : y")), funcs), generate_postfix(tokenize("x")));
+    EXPECT_EQ(eval_postfix(optimize(generate_postfix(tokenize("x > 1 ? 2 : 3")), funcs), vars = {{"x", 5}}, funcs), 2);
+
+    // Expression sets evaluate every node
+    ExpressionSet set;
+    EXPECT_EQ(set.add("x ? 1 : 2"), -1);
+}
+
+TEST(ConditionalTest, AssignmentTest)
+{
+    // An assignment in one branch leaves the variable unchanged in the other,
+    // so it is an input of the expression
+    CompiledExpression expr = compile("(x > 0 ? (y = x) : 0) + y");
+    ASSERT_TRUE(expr.valid());
+    EXPECT_TRUE(expr.reads(expr.slot("y")));
+    Variables vars = {{"x", 2}, {"y", 7}};
+    EXPECT_EQ(expr.evaluate(vars), 4);
+    EXPECT_EQ(vars["y"], 2);
+    vars = {{"x", -2}, {"y", 7}};
+    EXPECT_EQ(expr.evaluate(vars), 7);
+    EXPECT_EQ(vars["y"], 7);
+}
+
+TEST(ConditionalTest, BatchTest)
+{
+    // Mixed and uniform chunks agree with scalar evaluation
+    const size_t nrows = 1000;
+    std::vector<double> x(nrows), y(nrows);
+    for (size_t i = 0; i < nrows; ++i) {
+        x[i] = (i < 300) ? 1.0 : (i < 600) ? 0.0 : (i % 3 == 0);
+        y[i] = std::cos(0.1 * i);
+    }
+    int calls = 0;
+    Functions funcs = common_functions();
+    funcs["count"] = [&](FunctionArgsView args) {++calls; return args[0];};
+    for (const char* text : {"x ? y : -y", "x && y > 0", "x || y > 0", "x ? (y > 0 ? 1 : count(y)) : x || y",
+                             "(x ? (z = y) : 0) + z", "if(x && count(y) > 0, 2, 3) + (y < 0 || count(1))"}) {
+        CompiledExpression expr = compile(text, funcs);
+        ASSERT_TRUE(expr.valid()) << text;
+        std::vector<double> out(nrows);
+        std::vector<double> z(nrows, 5.0);
+        calls = 0;
+        ASSERT_TRUE(evaluate_batch(expr, Columns{{"x", x}, {"y", y}, {"z", z}}, out)) << text;
+        const int batchCalls = calls;
+        calls = 0;
+        for (size_t i = 0; i < nrows; ++i) {
+            Variables vars = {{"x", x[i]}, {"y", y[i]}, {"z", 5.0}};
+            EXPECT_NEAR(out[i], expr.evaluate(vars), EPS) << text << " row " << i;
+        }
+        // Functions are only called for the rows that reach them
+        EXPECT_EQ(batchCalls, calls) << text;
+    }
+}
+
+TEST(ConditionalTest, GradientTest)
+{
+    CompiledExpression expr = compile("x > 1 ? x*y : y^2");
+    std::vector<double> values = {2, 3}, partials(2);
+    EXPECT_EQ(gradient(expr, values, partials), 6);
+    EXPECT_EQ(partials, std::vector<double>({3, 2}));
+    values = {0, 3};
+    EXPECT_EQ(gradient(expr, values, partials), 9);
+    EXPECT_EQ(partials, std::vector<double>({0, 6}));
+    EXPECT_EQ(derivative(expr, values, std::vector<double>{0, 1}).derivative, 6);
+}
+
+// Same slots, result and assignments as the runtime path, bit for bit
+template<FixedString Text>
+static void expect_same_as_runtime(const Variables& _vars)
+{
+    CompiledExpression expr = compile(Text.text);
+    ASSERT_TRUE(expr.valid()) << Text.text;
+    ASSERT_EQ(StaticExpression<Text>::size(), expr.slots().size()) << Text.text;
+    for (size_t i = 0; i < expr.slots().size(); ++i) {
+        EXPECT_EQ(StaticExpression<Text>::slots()[i], expr.slots()[i]) << Text.text;
+    }
+    std::vector<double> values = expr.bind(_vars), staticValues = values;
+    const double expected = expr.evaluate(values);
+    const double result = static_expr<Text>.evaluate(staticValues);
+    EXPECT_EQ(std::bit_cast<uint64_t>(result), std::bit_cast<uint64_t>(expected)) << Text.text << " = " << expected;
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(std::bit_cast<uint64_t>(staticValues[i]), std::bit_cast<uint64_t>(values[i])) << Text.text;
+    }
+}
+
+TEST(StaticExpressionTest, MatchesRuntimeTest)
+{
+    EXPECT_EQ(static_expr<"a*x^2 + b">(2, 3, 1), 19);
+    static_assert(StaticExpression<"y + x*y">::size() == 2 && StaticExpression<"y + x*y">::slot("x") == 1);
+
+    for (double x : {-1.5, 0.0, 0.3, 2.0, std::numeric_limits<double>::quiet_NaN()}) {
+        const Variables vars = {{"x", x}, {"y", 0.7}, {"z", -4.0}};
+        expect_same_as_runtime<"2+3*2 - 2^3^2 / 3">(vars);
+        expect_same_as_runtime<"x*y - x/y + x^y + -x + (x+1)*(y-2)/3 + x^2 + y^+2 + x^(2)">(vars);
+        expect_same_as_runtime<"sin(x)*cos(y) + tan(x) + exp(y) + log(y) + ln(y) + log2(y) + sqrt(y) + abs(x)">(vars);
+        expect_same_as_runtime<"pow(x, y) + max(x, y, 1) + min(x, z) + max(x)">(vars);
+        expect_same_as_runtime<"(x < y) + (x <= y) * 2 + (x > y) * 4 + (x >= y) * 8 + (x == y) * 16 + (x != y) * 32">(vars);
+        expect_same_as_runtime<"!x + (x && y) + (x || 0) + (0 && z) + -(-x)">(vars);
+        expect_same_as_runtime<"x > 0 ? y : x < -1 ? z : if(x, 1, 2)">(vars);
+        expect_same_as_runtime<"(z = x*y) + z + (x > 0 ? (y = 2) : 3) + y">(vars);
+        expect_same_as_runtime<"x + (x = 3) + x">(vars);
+    }
+}
+
+TEST(StaticExpressionTest, LiteralsTest)
+{
+    // Literals are rounded like strtod, including ties, subnormals and overflow
+    auto expect_literal = [](double _value, const char* _text) {
+        EXPECT_EQ(std::bit_cast<uint64_t>(_value), std::bit_cast<uint64_t>(std::strtod(_text, nullptr))) << _text;
+        EXPECT_EQ(std::bit_cast<uint64_t>(_value), std::bit_cast<uint64_t>(eval(_text))) << _text;
+    };
+#define IBEX_EXPECT_LITERAL(text) expect_literal(static_expr<text>(), text)
+    IBEX_EXPECT_LITERAL("0.1");
+    IBEX_EXPECT_LITERAL("007.50");
+    IBEX_EXPECT_LITERAL("1e23");
+    IBEX_EXPECT_LITERAL("9007199254740993");
+    IBEX_EXPECT_LITERAL("9007199254740995");
+    IBEX_EXPECT_LITERAL("123456789012345678901234567890");
+    IBEX_EXPECT_LITERAL("0.000001234567890123456789");
+    IBEX_EXPECT_LITERAL("2.2250738585072011e-308");
+    IBEX_EXPECT_LITERAL("2.2250738585072014e-308");
+    IBEX_EXPECT_LITERAL("4.9406564584124654e-324");
+    IBEX_EXPECT_LITERAL("2.4703282292062328e-324");
+    IBEX_EXPECT_LITERAL("2e-324");
+    IBEX_EXPECT_LITERAL("1e-400");
+    IBEX_EXPECT_LITERAL("1.7976931348623157e308");
+    IBEX_EXPECT_LITERAL("1.7976931348623158e308");
+    IBEX_EXPECT_LITERAL("1.7976931348623159e308");
+    IBEX_EXPECT_LITERAL("1e400");
+    IBEX_EXPECT_LITERAL("0.50000000000000011102230246251565404236316680908203125");
+    IBEX_EXPECT_LITERAL("0.500000000000000111022302462515654042363166809082031250000000001");
+#undef IBEX_EXPECT_LITERAL
+}
+
+TEST(ProfileTest, CountersTest)
+{
+    reset_profile();
+    CompiledExpression expr = compile("sin(x) + sqrt(x)");
+    std::vector<double> values = {-1};
+    expr.evaluate(values);
+    values = {1};
+    expr.evaluate(values);
+    compile("1 +");
+    std::vector<TokenView> tokens;
+    tokenize("2e", tokens);
+
+    Profile counters = profile();
+    if constexpr (!PROFILING_ENABLED) {
+        EXPECT_EQ(counters[Stage::EVALUATE].calls, 0);
+        EXPECT_TRUE(counters.functions.empty());
+        return;
+    }
+    EXPECT_EQ(counters[Stage::EVALUATE].calls, 2);
+    EXPECT_EQ(counters[Stage::EVALUATE].nan_results, 1);
+    EXPECT_EQ(counters[Stage::COMPILE].calls, 2);
+    EXPECT_EQ(counters[Stage::COMPILE].failures, 1);
+    EXPECT_EQ(counters[Stage::TOKENIZE].calls, 3);
+    EXPECT_EQ(counters[Stage::TOKENIZE].failures, 1);
+    EXPECT_EQ(counters[Stage::POSTFIX].calls, 2);
+    EXPECT_EQ(counters.functions["sin"].calls, 2);
+    EXPECT_EQ(counters.functions["sqrt"].calls, 2);
+    EXPECT_GT(counters[Stage::EVALUATE].nanoseconds, 0);
+    EXPECT_EQ(counters[ErrorCode::INSUFFICIENT_OPERANDS], 1);
+    EXPECT_EQ(counters[ErrorCode::MALFORMED_NUMBER], 1);
+
+    std::ostringstream report;
+    report << counters;
+    EXPECT_NE(report.str().find("sqrt"), std::string::npos);
+
+    reset_profile();
+    EXPECT_EQ(profile()[Stage::EVALUATE].calls, 0);
+    EXPECT_TRUE(profile().functions.empty());
+}
+
+TEST(ErrorTest, CompileTest)
+{
+    auto error = [](const char* text) {
+        CompiledExpression expr;
+        EXPECT_FALSE(compile(text, common_functions(), expr)) << text;
+        return expr.error();
+    };
+    auto expect = [&](const char* text, ErrorCode code, std::string_view token, size_t position) {
+        const Error e = error(text);
+        EXPECT_EQ(e.code, code) << text;
+        EXPECT_EQ(e.token(), token) << text;
+        EXPECT_EQ(e.position, position) << text;
+    };
+
+    expect("2e", ErrorCode::MALFORMED_NUMBER, "2e", 0);
+    expect("1 + foo(2)", ErrorCode::UNKNOWN_FUNCTION, "foo", 4);
+    expect("(1 + 2", ErrorCode::MISMATCHED_PARENTHESES, "(", 0);
+    expect("1 + 2)", ErrorCode::MISMATCHED_PARENTHESES, ")", 5);
+    expect("1 + sqrt(1, 2)", ErrorCode::WRONG_ARGUMENT_COUNT, "sqrt", 4);
+    expect("3 = x", ErrorCode::NOT_ASSIGNABLE, "=", 2);
+    expect("1 : 2", ErrorCode::UNEXPECTED_COLON, ":", 2);
+    expect("1 +", ErrorCode::INSUFFICIENT_OPERANDS, "+", 2);
+    expect("1 + $", ErrorCode::UNEXPECTED_TOKEN, "$", 4);
+    expect("", ErrorCode::INVALID_EXPRESSION, "", Error::NPOS);
+
+    // Tokens are truncated, and compiling postfix tokens has no source text
+    const std::string name(40, 'f');
+    const Error e = error((name + "(1)").c_str());
+    EXPECT_EQ(e.token(), name.substr(0, Error::TOKEN_SIZE));
+    CompiledExpression expr;
+    EXPECT_FALSE(compile(generate_postfix(tokenize("1 + foo(2)")), common_functions(), expr));
+    EXPECT_EQ(expr.error().code, ErrorCode::UNKNOWN_FUNCTION);
+    EXPECT_EQ(expr.error().position, Error::NPOS);
+
+    EXPECT_TRUE(compile("1 + 2", common_functions(), expr));
+    EXPECT_FALSE(expr.error());
+}
+
+TEST(ErrorTest, EvaluateTest)
+{
+    Variables vars = common_variables();
+    Functions funcs = common_functions();
+
+    // A NaN result is not an error
+    Result result = try_eval("sqrt(-1)", vars, funcs);
+    EXPECT_TRUE(result.ok());
+    EXPECT_TRUE(std::isnan(result.value));
+
+    result = try_eval("1 + max()", vars, funcs);
+    EXPECT_EQ(result.error.code, ErrorCode::WRONG_ARGUMENT_COUNT);
+    EXPECT_EQ(result.error.token(), "max");
+    EXPECT_TRUE(std::isnan(result.value));
+    EXPECT_TRUE(try_eval("max(1)", vars, funcs).ok());
+
+    funcs["checked"] = [](double x) {return x < 0 ? function_error(ErrorCode::INVALID_ARGUMENT, "checked") : x;};
+    CompiledExpression expr = compile("checked(x) + checked(y)", funcs);
+    std::vector<double> values = {1, -1};
+    EXPECT_EQ(expr.try_evaluate(values).error.code, ErrorCode::INVALID_ARGUMENT);
+    values = {1, 2};
+    result = expr.try_evaluate(values);
+    EXPECT_TRUE(result.ok());
+    EXPECT_EQ(result.value, 3);
+
+    values = {1};
+    EXPECT_EQ(expr.try_evaluate(values).error.code, ErrorCode::WRONG_VALUE_COUNT);
+
+    result = try_eval("x + 1", vars, funcs);
+    EXPECT_EQ(result.error.code, ErrorCode::UNKNOWN_VARIABLE);
+    EXPECT_EQ(result.error.token(), "x");
+
+    result = try_eval("1 + foo(2)", vars, funcs);
+    EXPECT_EQ(result.error.code, ErrorCode::UNKNOWN_FUNCTION);
+    EXPECT_EQ(result.error.position, 4);
+    EXPECT_EQ(CompiledExpression().try_evaluate(values).error.code, ErrorCode::NOT_COMPILED);
+
+    ExpressionSet set(funcs);
+    Error error;
+    EXPECT_EQ(set.add("x ? 1 : 2", &error), -1);
+    EXPECT_EQ(error.code, ErrorCode::UNSUPPORTED);
+
+    Sheet sheet(funcs);
+    EXPECT_EQ(sheet.add("x = y + 1"), 0);
+    EXPECT_EQ(sheet.add("x = 2", &error), -1);
+    EXPECT_EQ(error.code, ErrorCode::DEPENDENCY);
+    EXPECT_EQ(error.token(), "x");
+}
+
+static std::vector<ErrorCode> reportedErrors;
+
+TEST(ErrorTest, SinkTest)
+{
+    set_diagnostics_sink([](const Error& error) {reportedErrors.push_back(error.code);});
+    compile("1 + foo(2)");
+    eval("min()");
+    set_diagnostics_sink(nullptr);
+    compile("(1");
+    EXPECT_EQ(reportedErrors, std::vector<ErrorCode>({ErrorCode::UNKNOWN_FUNCTION, ErrorCode::WRONG_ARGUMENT_COUNT}));
+
+    std::ostringstream text;
+    text << compile("1 + foo(2)").error();
+    EXPECT_EQ(text.str(), "Unknown function: foo at 4");
+    text.str("");
+    text << compile(generate_postfix(tokenize("1 + foo(2)")), common_functions()).error();
+    EXPECT_EQ(text.str(), "Unknown function: foo");
+}
+
+TEST(ArchiveTest, RoundTripTest)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "ibex_archive_test.bin").string();
+    Functions funcs = common_functions();
+    std::vector<CompiledExpression> exprs;
+    for (const char* text : {"a*x^2 + b*x + c", "y = sqrt(x*x + a*a) * exp(-x)", "1 + foo(2)",
+                             "x > 0 && a < 1 ? max(x, a, b) : min(a, 2)", "pi * x / 2"}) {
+        exprs.push_back(compile(text, funcs));
+    }
+    exprs.push_back(compile(optimize(generate_postfix(tokenize("x * 1 + (2 + 3)")), funcs), funcs));
+    ASSERT_TRUE(save_archive(path.c_str(), exprs));
+
+    ExpressionArchive archive;
+    ASSERT_TRUE(archive.open(path.c_str(), funcs));
+    ASSERT_EQ(archive.size(), exprs.size());
+    EXPECT_FALSE(archive[2].valid());
+    EXPECT_TRUE(std::isnan(archive[2].evaluate({})));
+
+    CompiledExpression loaded;
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        if (!exprs[i].valid()) {continue;}
+        const ArchivedExpression expr = archive[i];
+        ASSERT_EQ(expr.slot_count(), exprs[i].slots().size());
+        for (size_t s = 0; s < expr.slot_count(); ++s) {
+            EXPECT_EQ(expr.slot_name(s), exprs[i].slots()[s]);
+            EXPECT_EQ(expr.reads(s), exprs[i].reads(s));
+            EXPECT_EQ(expr.assigns(s), exprs[i].assigns(s));
+        }
+        ASSERT_TRUE(archive.load(i, loaded));
+        EXPECT_EQ(loaded.bytecode().code, exprs[i].bytecode().code);
+        EXPECT_EQ(loaded.function_names(), exprs[i].function_names());
+
+        for (double x : {-1.5, 0.0, 2.0}) {
+            std::vector<double> values(expr.slot_count(), 0.5);
+            if (expr.slot("x") >= 0) {values[expr.slot("x")] = x;}
+            std::vector<double> expected = values;
+            std::vector<double> copy = values;
+            EXPECT_EQ(expr.evaluate(values), exprs[i].evaluate(expected));
+            EXPECT_EQ(values, expected);
+            EXPECT_EQ(loaded.evaluate(copy), exprs[i].evaluate(values));
+        }
+    }
+
+    // Expressions stay valid when the archive is moved
+    ArchivedExpression expr = archive[0];
+    ExpressionArchive moved = std::move(archive);
+    std::vector<double> values = {1, 2, 3, 4};
+    EXPECT_EQ(expr.evaluate(values), 1*4 + 3*2 + 4);
+    std::filesystem::remove(path);
+}
+
+TEST(ArchiveTest, ValidationTest)
+{
+    std::string path = (std::filesystem::temp_directory_path() / "ibex_archive_test.bin").string();
+    Functions funcs = common_functions();
+    funcs["scale"] = [](double x, double y) {return x * y;};
+    std::vector<CompiledExpression> exprs = {compile("scale(x, 2) + 1", funcs), compile("x ? 1 : 2", funcs)};
+    ASSERT_TRUE(save_archive(path.c_str(), exprs));
+
+    ExpressionArchive archive;
+    Error error;
+    EXPECT_FALSE(archive.open(path.c_str(), common_functions(), &error));
+    EXPECT_EQ(error.code, ErrorCode::UNKNOWN_FUNCTION);
+    EXPECT_EQ(error.token(), "scale");
+    EXPECT_FALSE(archive.is_open());
+
+    Functions changed = funcs;
+    changed["scale"] = [](double x) {return x;};
+    EXPECT_FALSE(archive.open(path.c_str(), changed, &error));
+    EXPECT_EQ(error.code, ErrorCode::WRONG_ARGUMENT_COUNT);
+
+    EXPECT_FALSE(archive.open("/nonexistent/ibex.bin", funcs, &error));
+    EXPECT_EQ(error.code, ErrorCode::IO);
+
+    std::string bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), {});
+    }
+    auto corrupt = [&](size_t _offset, char _value) {
+        std::string copy = bytes;
+        copy[_offset] = _value;
+        std::ofstream(path, std::ios::binary) << copy;
+        return archive.open(path.c_str(), funcs, &error);
+    };
+    EXPECT_TRUE(corrupt(0, 'I'));
+    EXPECT_FALSE(corrupt(0, 'X')); // magic
+    EXPECT_FALSE(corrupt(4, 99)); // version
+    EXPECT_FALSE(corrupt(sizeof(ArchiveHeader) + 4, 100)); // code size of the first expression
+
+    // Every jump of the second expression pointed somewhere else
+    ArchiveHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    auto padded = [](size_t bytes) {return (bytes + 7) / 8 * 8;};
+    const size_t code = bytes.size() - padded(header.string_bytes) - padded(header.instructions * sizeof(Instruction));
+    for (size_t i = 0; i < exprs[1].bytecode().code.size(); ++i) {
+        const size_t at = code + (exprs[0].bytecode().code.size() + i) * sizeof(Instruction);
+        if (!is_jump(static_cast<OpCode>(bytes[at]))) {continue;}
+        for (char target : {0, 1, 100}) {EXPECT_FALSE(corrupt(at + 2, target)) << i;}
+    }
+
+    std::ofstream(path, std::ios::binary) << bytes.substr(0, bytes.size() - 8);
+    EXPECT_FALSE(archive.open(path.c_str(), funcs, &error));
+    EXPECT_EQ(error.code, ErrorCode::IO);
+    std::filesystem::remove(path);
+}
+
+TEST(SymbolTest, InternTest)
+{
+    SymbolTable symbols;
+    EXPECT_EQ(symbols.intern("x"), 0);
+    EXPECT_EQ(symbols.intern("y"), 1);
+    EXPECT_EQ(symbols.intern("x"), 0);
+    EXPECT_EQ(symbols.find("y"), 1);
+    EXPECT_EQ(symbols.find("z"), -1);
+    EXPECT_EQ(symbols.name(1), "y");
+    EXPECT_TRUE(std::isnan(symbols[0]));
+
+    // Values survive the array growing
+    symbols[0] = 1;
+    for (int i = 0; i < 100; ++i) {symbols[symbols.intern(std::string("v").append(std::to_string(i)))] = i;}
+    EXPECT_EQ(symbols[0], 1);
+    EXPECT_EQ(symbols[symbols.find("v99")], 99);
+
+    symbols.set({{"y", 2}, {"z", 3}});
+    SymbolTable copy = symbols;
+    copy[0] = 10;
+    EXPECT_EQ(symbols[0], 1);
+    Variables vars;
+    copy.get(vars);
+    EXPECT_EQ(vars.size(), 103);
+    EXPECT_EQ(vars["x"], 10);
+    EXPECT_EQ(vars["z"], 3);
+}
+
+TEST(SymbolTest, BindTest)
+{
+    struct State {double position = 1; double velocity = 2; double energy = 0;} state;
+    SymbolTable symbols;
+    symbols.bind("x", &state.position);
+    symbols.bind("v", &state.velocity);
+    symbols.bind("e", &state.energy);
+    symbols[symbols.intern("m")] = 4;
+
+    BoundExpression step(compile("e = m * v^2 / 2, x = x + v * dt"), symbols);
+    BoundExpression energy(compile("e = m * v^2 / 2"), symbols);
+    EXPECT_FALSE(step.expression().valid());
+    EXPECT_TRUE(std::isnan(step.evaluate()));
+
+    EXPECT_EQ(energy.evaluate(), 8);
+    EXPECT_EQ(state.energy, 8);
+    state.velocity = 3;
+    EXPECT_EQ(energy.evaluate(), 18);
+    EXPECT_EQ(state.energy, 18);
+
+    BoundExpression move(compile("x = x + v * dt"), symbols);
+    symbols[symbols.find("dt")] = 0.5;
+    move.evaluate();
+    EXPECT_EQ(state.position, 2.5);
+
+    // Bound memory is written as the assignment happens, not copied back afterwards
+    Functions funcs = common_functions();
+    funcs["position"] = [&state]() {return state.position;};
+    BoundExpression jump(compile("(x = 7) + position()", funcs), symbols);
+    EXPECT_EQ(jump.evaluate(), 14);
+    EXPECT_EQ(state.position, 7);
+    state.position = 2.5;
+
+    // Unbinding keeps the value, later writes stay in the table
+    symbols.unbind(symbols.find("x"));
+    EXPECT_FALSE(symbols.bound(symbols.find("x")));
+    move.evaluate();
+    EXPECT_EQ(state.position, 2.5);
+    EXPECT_EQ(symbols[symbols.find("x")], 4);
+}
+
+TEST(ScopeTest, LayerTest)
+{
+    EXPECT_EQ(&default_scope(), &default_scope());
+    EXPECT_NE(default_scope().find_function("sin"), nullptr);
+    EXPECT_EQ(*default_scope().find_variable("pi"), M_PI);
+
+    // A request overrides a variable and adds a function, the base is shared and untouched
+    Scope request(&default_scope());
+    request.variables()["pi"] = 3;
+    request.functions()["twice"] = Function([](double x) {return 2 * x;}, true);
+    EXPECT_EQ(eval("twice(pi) + cos(0)", request), 7);
+    EXPECT_EQ(*default_scope().find_variable("pi"), M_PI);
+    EXPECT_EQ(default_scope().find_function("twice"), nullptr);
+    EXPECT_TRUE(std::isnan(eval("twice(1)")));
+
+    // Assignments go into the innermost scope, variables that are only read are not copied
+    Scope inner(&request);
+    EXPECT_EQ(eval("x = pi + 1", inner), 4);
+    EXPECT_EQ(inner.variables().at("x"), 4);
+    EXPECT_FALSE(inner.variables().contains("pi"));
+    EXPECT_FALSE(request.variables().contains("x"));
+    EXPECT_EQ(eval("pi", request), 3);
+
+    const Result missing = try_eval("y + 1", inner);
+    EXPECT_EQ(missing.error.code, ErrorCode::UNKNOWN_VARIABLE);
+    EXPECT_EQ(eval("pi"), M_PI);
+}
+
+TEST(ScopeTest, ThreadTest)
+{
+    // Every thread evaluates in a scope of its own over the shared default scope
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong = 0;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t, &wrong] {
+            for (int i = 0; i < 200; ++i) {
+                Scope scope(&default_scope());
+                scope.variables()["t"] = t;
+                if (eval("x = t * 2 + sqrt(4) - e + e", scope) != t * 2 + 2 ||
+                    scope.variables().at("x") != t * 2 + 2) {++wrong;}
+            }
+        });
+    }
+    for (std::thread& thread : threads) {thread.join();}
+    EXPECT_EQ(wrong, 0);
+}
+
+TEST(ScalarTypeTest, FloatTest)
+{
+    BasicVariables<float> vars = common_variables<float>();
+    BasicFunctions<float> funcs = common_functions<float>();
+    vars["x"] = 2;
+    EXPECT_EQ(eval("y = x * pi", vars, funcs), 2 * std::numbers::pi_v<float>);
+    EXPECT_EQ(vars["y"], 2 * std::numbers::pi_v<float>);
+    EXPECT_EQ(eval("max(x, sqrt(16), 1) + (x > 1 ? 0.5 : 1)", vars, funcs), 4.5f);
+    EXPECT_FLOAT_EQ(eval("sin(x)^2 + cos(x)^2", vars, funcs), 1.0f);
+
+    // Registered functions take and return floats, arities are checked
+    funcs["half"] = pure<float>([](float v) {return v / 2;});
+    EXPECT_EQ(eval("half(x)", vars, funcs), 1.0f);
+    BasicExpression<float> expr;
+    EXPECT_FALSE(compile("half(x, 1)", funcs, expr));
+    EXPECT_EQ(expr.error().code, ErrorCode::WRONG_ARGUMENT_COUNT);
+    EXPECT_TRUE(std::isnan(expr.evaluate(vars)));
+
+    // Batches agree with the evaluator row by row
+    ASSERT_TRUE(compile("x > 0 && y > 0 ? a*x^2 + half(y) : -x / 3", funcs, expr));
+    std::vector<std::vector<float>> data(expr.slots().size());
+    for (size_t row = 0; row < 1000; ++row) {
+        for (size_t i = 0; i < data.size(); ++i) {data[i].push_back(std::sin(float(row * (i + 1))));}
+    }
+    std::vector<std::span<const float>> columns(data.begin(), data.end());
+    std::vector<float> out(1000);
+    ASSERT_TRUE(evaluate_batch(expr, columns, out));
+    for (size_t row = 0; row < out.size(); ++row) {
+        std::vector<float> values;
+        for (const auto& column : data) {values.push_back(column[row]);}
+        EXPECT_FLOAT_EQ(out[row], expr.evaluate(values));
+    }
+}
+
+TEST(ScalarTypeTest, LongDoubleTest)
+{
+    BasicVariables<long double> vars;
+    BasicFunctions<long double> funcs = common_functions<long double>();
+
+    // Literals keep the digits that double drops
+    EXPECT_EQ(eval("x = 0.1", vars, funcs), 0.1L);
+    EXPECT_EQ(vars["x"], 0.1L);
+    EXPECT_EQ(eval("x * 3 - 1e-1 * 3", vars, funcs), 0.1L * 3 - 0.1L * 3);
+    EXPECT_EQ(eval("1 / 3", vars, funcs), 1.0L / 3);
+    EXPECT_EQ(eval("pow(2, 0.5)", vars, funcs), std::pow(2.0L, 0.5L));
+
+    // Literals that are the same double are still different constants
+    const long double a = 0.1L, b = 0.1000000000000000001L;
+    ASSERT_EQ(static_cast<double>(a), static_cast<double>(b));
+    EXPECT_EQ(eval("0.1 - 0.1000000000000000001", vars, funcs), a - b);
+    if (a != b) {EXPECT_NE(eval("0.1 - 0.1000000000000000001", vars, funcs), 0.0L);}
+    EXPECT_EQ(eval("x = 3", vars, funcs), 3.0L);
+    EXPECT_EQ(eval("x ^ 2.0000000000000000002", vars, funcs), std::pow(3.0L, 2.0000000000000000002L));
+    EXPECT_TRUE(std::isnan(eval("unknown(1)", vars, funcs)));
+}
+
+TEST(ArrayTest, ReductionTest)
+{
+    std::vector<double> w(10000), x(10000);
+    for (size_t i = 0; i < w.size(); ++i) {w[i] = 1 + i % 3; x[i] = std::sin(double(i));}
+    Arrays arrays = {{"w", w}, {"x", x}};
+    Variables vars = {{"k", 2}};
+    Functions funcs = common_functions();
+
+    double sw = 0, swx = 0, sx = 0, mx = -INFINITY, mn = INFINITY;
+    for (size_t i = 0; i < w.size(); ++i) {
+        sw += w[i]; swx += w[i] * x[i]; sx += x[i];
+        mx = std::max(mx, x[i]); mn = std::min(mn, x[i]);
+    }
+
+    // Reductions at the same depth share one pass
+    ArrayExpression expr;
+    ASSERT_TRUE(compile("sum(w*x)/sum(w)", {"w", "x"}, funcs, expr));
+    EXPECT_FALSE(expr.is_array());
+    EXPECT_EQ(expr.passes(), 1);
+    EXPECT_NEAR(expr.evaluate(arrays, vars), swx / sw, 1e-12);
+
+    ASSERT_TRUE(compile("r = dot(w, x) * k + max(x) - min(x) + mean(w)", {"w", "x"}, funcs, expr));
+    EXPECT_EQ(expr.passes(), 1);
+    EXPECT_NEAR(expr.evaluate(arrays, vars), swx * 2 + mx - mn + sw / w.size(), 1e-9);
+    EXPECT_NEAR(vars["r"], swx * 2 + mx - mn + sw / w.size(), 1e-9);
+
+    // Nested reductions take one pass per depth, functions apply element-wise
+    ASSERT_TRUE(compile("sum((x - mean(x))^2) / sum(abs(x) > 2 ? 1 : 0 + 1)", {"x"}, funcs, expr));
+    EXPECT_EQ(expr.passes(), 2);
+    double ss = 0;
+    for (double v : x) {ss += (v - sx / x.size()) * (v - sx / x.size());}
+    EXPECT_NEAR(expr.evaluate(arrays, vars), ss / x.size(), 1e-9);
+
+    // Scalar functions of scalars stay as they are
+    ASSERT_TRUE(compile("max(k, 3) + sum(x)", {"x"}, funcs, expr));
+    EXPECT_NEAR(expr.evaluate(arrays, vars), 3 + sx, 1e-9);
+}
+
+TEST(ArrayTest, ElementWiseTest)
+{
+    std::vector<double> x = {1, 2, 3, 4, 5}, y = {5, 4, 3, 2, 1}, out(5);
+    Arrays arrays = {{"x", x}, {"y", y}};
+    Variables vars = {{"k", 10}};
+    ArrayExpression expr;
+    ASSERT_TRUE(compile("x * k + y - mean(x)", {"x", "y"}, common_functions(), expr));
+    EXPECT_TRUE(expr.is_array());
+    EXPECT_EQ(expr.passes(), 2);
+    ASSERT_TRUE(expr.evaluate(arrays, vars, out));
+    for (size_t i = 0; i < x.size(); ++i) {EXPECT_EQ(out[i], x[i] * 10 + y[i] - 3);}
+    EXPECT_TRUE(std::isnan(expr.evaluate(arrays, vars)));
+
+    // Lengths must agree and arrays cannot be assigned
+    std::vector<double> shorter = {1, 2};
+    EXPECT_FALSE(expr.evaluate(Arrays{{"x", x}, {"y", shorter}}, vars, out));
+    EXPECT_TRUE(std::isnan(out[0]));
+    EXPECT_FALSE(compile("x = x + 1", {"x"}, common_functions(), expr));
+    EXPECT_EQ(expr.error().code, ErrorCode::UNSUPPORTED);
+    EXPECT_FALSE(compile("dot(x)", {"x"}, common_functions(), expr));
+    EXPECT_EQ(expr.error().code, ErrorCode::WRONG_ARGUMENT_COUNT);
+    EXPECT_FALSE(expr.valid());
+}
+
+TEST(MemoTest, SharedCallTest)
+{
+    int calls = 0;
+    Functions funcs = common_functions();
+    funcs["f"] = pure([&](double x) {++calls; return 2 * x;});
+    funcs["g"] = [&](double x) {++calls; return 3 * x;};
+    auto count = [&](const char* text, Variables vars) {
+        calls = 0;
+        CompiledExpression expr = compile(text, funcs);
+        EXPECT_TRUE(expr.valid()) << text;
+        expr.evaluate(vars);
+        return calls;
+    };
+
+    // Pure calls with the same arguments run once, nested ones too
+    EXPECT_EQ(count("f(x)*f(x) + 1/f(x)", {{"x", 1}}), 1);
+    EXPECT_EQ(count("f(f(x+1)) - f(f(x+1)) + f(x+1)", {{"x", 1}}), 2);
+    EXPECT_EQ(count("f(x) + (x > 0 ? f(x) : 0)", {{"x", 1}}), 1);
+    EXPECT_EQ(count("f(x) + f(y)", {{"x", 1}, {"y", 1}}), 2);
+
+    // Impure calls, calls that may not run and reads of assigned variables are left alone
+    EXPECT_EQ(count("g(x) + g(x)", {{"x", 1}}), 2);
+    EXPECT_EQ(count("x > 0 ? f(x) : f(x) + 1", {{"x", 1}}), 1);
+    EXPECT_EQ(count("x > 0 && f(x) || f(x)", {{"x", 1}}), 1);
+    EXPECT_EQ(count("f(x) + (x = 3) + f(x)", {{"x", 1}}), 2);
+
+    // Results agree with the evaluators that interpret the bytecode
+    CompiledExpression expr = compile("f(x)^3 + (x > 0 ? f(x) : -f(x)) * y", funcs);
+    std::vector<double> x = {1, -2, 3}, y = {4, 5, 6}, out(3);
+    ASSERT_TRUE(evaluate_batch(expr, std::vector<std::span<const double>>{x, y}, out));
+    for (size_t i = 0; i < x.size(); ++i) {
+        Variables vars = {{"x", x[i]}, {"y", y[i]}};
+        const double f = 2 * x[i];
+        EXPECT_DOUBLE_EQ(expr.evaluate(vars), f * f * f + std::abs(f) * y[i]);
+        EXPECT_DOUBLE_EQ(out[i], f * f * f + std::abs(f) * y[i]);
+    }
+    std::vector<double> values = {1, 4}, partials(2);
+    EXPECT_DOUBLE_EQ(gradient(expr, values, partials), 16);
+    EXPECT_NEAR(partials[0], 3 * 4 * 2 + 2 * 4, 1e-6);
+    EXPECT_DOUBLE_EQ(partials[1], 2);
+}
+
+TEST(MemoTest, CacheTest)
+{
+    int calls = 0;
+    Functions funcs = common_functions();
+    funcs["f"] = memoized([&](double x, double y) {++calls; return x * y;}, 64);
+    EXPECT_TRUE(funcs["f"].pure);
+    EXPECT_EQ(funcs["f"].arity, 2);
+    std::shared_ptr<Memo> memo = memo_of(funcs["f"]);
+    ASSERT_TRUE(memo);
+    EXPECT_FALSE(memo_of(funcs["sin"]));
+
+    // Results are remembered across evaluations and expressions
+    CompiledExpression expr = compile("f(x, 2) + 1", funcs);
+    Variables vars = {{"x", 3}};
+    for (int i = 0; i < 10; ++i) {EXPECT_EQ(expr.evaluate(vars), 7);}
+    EXPECT_EQ(eval("f(3, 2)", vars, funcs), 6);
+    EXPECT_EQ(calls, 1);
+    MemoStats stats = memo->stats();
+    EXPECT_EQ(stats.hits, 10);
+    EXPECT_EQ(stats.misses, 1);
+    EXPECT_EQ(stats.entries, 1);
+    EXPECT_EQ(stats.capacity, 64);
+
+    // The memo is bounded and keys are compared bit by bit
+    for (int i = 0; i < 1000; ++i) {vars["x"] = i; expr.evaluate(vars);}
+    stats = memo->stats();
+    EXPECT_LE(stats.entries, 64);
+    EXPECT_GT(stats.evictions, 0);
+    const size_t misses = stats.misses;
+    EXPECT_EQ(eval("f(0, 7) + f(-0, 7)", vars, funcs), 0);
+    EXPECT_EQ(memo->stats().misses, misses + 2);
+    memo->clear();
+    EXPECT_EQ(memo->stats().entries, 0);
+
+    // Calls that report an error are not remembered and report it every time
+    funcs["g"] = memoized([](double x) {return x < 0 ? function_error(ErrorCode::INVALID_EXPRESSION, "g") : x;});
+    expr = compile("g(x)", funcs);
+    vars["x"] = -1;
+    for (int i = 0; i < 3; ++i) {EXPECT_EQ(expr.try_evaluate(vars).error.code, ErrorCode::INVALID_EXPRESSION);}
+    EXPECT_EQ(memo_of(funcs["g"])->stats().misses, 3);
+    EXPECT_EQ(memo_of(funcs["g"])->stats().entries, 0);
+
+    // Threads that miss on the same arguments at once store one entry
+    std::atomic<int> running = 0;
+    funcs["h"] = memoized([&](double x) {
+        ++running;
+        while (running < 4) {std::this_thread::yield();}
+        return x;
+    });
+    memo = memo_of(funcs["h"]);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {threads.emplace_back([&]() {EXPECT_EQ(eval("h(5)", vars, funcs), 5);});}
+    for (std::thread& thread : threads) {thread.join();}
+    stats = memo->stats();
+    EXPECT_EQ(stats.misses, 4);
+    EXPECT_EQ(stats.entries, 1);
+    EXPECT_EQ(stats.evictions, 0);
+}
+
+TEST(SpecializeTest, ParameterTest)
+{
+    Functions funcs = common_functions();
+    Specializer spec("a*x^2 + b*x + c + (mode > 1 ? sin(phase) : cos(phase)) * x", funcs);
+    ASSERT_TRUE(spec.valid());
+
+    // Only the inputs are left and the conditional is gone
+    Variables params = {{"a", 2}, {"b", -3}, {"c", 0.5}, {"mode", 2}, {"phase", 0.25}};
+    OptimizeStats stats;
+    CompiledExpression expr;
+    ASSERT_TRUE(spec.specialize(params, expr, &stats));
+    EXPECT_EQ(expr.slots(), std::vector<std::string>{"x"});
+    EXPECT_GT(stats.folded, 0);
+    EXPECT_TRUE(std::none_of(expr.bytecode().code.begin(), expr.bytecode().code.end(),
+                             [](const Instruction& ins) {return is_jump(ins.op) || ins.op == OpCode::CALL;}));
+    CompiledExpression generic = compile("a*x^2 + b*x + c + (mode > 1 ? sin(phase) : cos(phase)) * x", funcs);
+    for (double x : {-1.5, 0.0, 2.0, 7.25}) {
+        Variables vars = params;
+        vars["x"] = x;
+        std::vector<double> values = {x};
+        EXPECT_NEAR(expr.evaluate(values), generic.evaluate(vars), 1e-12);
+    }
+
+    // Specializing again for other parameters, missing ones stay variables
+    params["mode"] = 0;
+    params.erase("c");
+    expr = spec.specialize(params);
+    EXPECT_EQ(expr.slots(), (std::vector<std::string>{"x", "c"}));
+    Variables vars = {{"x", 2}, {"c", 1}};
+    EXPECT_NEAR(expr.evaluate(vars), 2 * 4 - 3 * 2 + 1 + std::cos(0.25) * 2, 1e-12);
+
+    // Assigned parameters stay variables
+    ASSERT_TRUE(specialize(generate_postfix(tokenize("k = k + x")), funcs, {{"k", 1}, {"x", 2}}, expr));
+    EXPECT_EQ(expr.slots(), std::vector<std::string>{"k"});
+    vars = {{"k", 5}};
+    EXPECT_EQ(expr.evaluate(vars), 7);
+
+    Specializer broken("(a + 1");
+    EXPECT_FALSE(broken.valid());
+    EXPECT_EQ(broken.error().code, ErrorCode::MISMATCHED_PARENTHESES);
+    EXPECT_FALSE(Specializer("f(x)", funcs).specialize({}, expr));
+    EXPECT_EQ(expr.error().code, ErrorCode::UNKNOWN_FUNCTION);
+}